@@ -28,9 +28,24 @@ Sources:
 #include <linux/gpio.h> // legacy GPIO interface
 #include <linux/gpio/consumer.h> // Gpio consumer interface
 #include <linux/interrupt.h>
-#include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h> /* mul_u64_u32_div() */
 #include <linux/jiffies.h>
 #include <linux/delay.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h> /* fls64() */
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#include <linux/time.h> /* sys_tz */
+
+#define CREATE_TRACE_POINTS
+#include "mytraffic_trace.h"
 
 // GPIO Numbers
 #define RED_LED  67 
@@ -41,6 +56,7 @@ Sources:
 
 #define DEBUG 0
 #define MIN(X,Y) ((X) < (Y)) ? (X) : (Y)
+#define NORMAL_CYCLE 6 // ticks of a green, yellow, red cycle
 
 MODULE_AUTHOR("Abin George, Justin Sadler");
 MODULE_DESCRIPTION("Traffic Light Driver");
@@ -53,6 +69,7 @@ static ssize_t mytraffic_read(struct file *filp,
 		char *buf, size_t count, loff_t *f_pos);
 static ssize_t mytraffic_write(struct file *filp,
 		const char *buf, size_t count, loff_t *f_pos);
+static __poll_t mytraffic_poll(struct file *filp, poll_table *wait);
 static void mytraffic_exit(void);
 static int mytraffic_init(void);
 
@@ -60,12 +77,32 @@ static irqreturn_t btn0_handler(int irq, void * dev_id);
 static irqreturn_t btn1_handler(int irq, void * dev_id);
 
 
+// Phase engine functions
+static enum hrtimer_restart phaseFun(struct hrtimer *timer);
+static void phaseStart(void);
+static void phaseGrid(ktime_t now);
+static void phaseRestart(void);
+static ktime_t phaseNext(void);
+static ktime_t phaseTickTime(u64 tick);
+static u64 phaseTickAt(ktime_t time);
+
 // LED display functions
-void displayFun(struct timer_list* timer);
+void displayFun(void);
 void normal_disp(void);
 void red_disp(void);
 void yellow_disp(void);
 void pedestrian_disp(void);
+static void trafficChanged(void);
+
+// Statistics functions
+static void statPhaseReset(void);
+static void statPhase(ktime_t due, ktime_t now);
+static void statPedestrianServed(void);
+static int statInit(void);
+static void statExit(void);
+
+// Plan scheduler functions
+static void planBoundary(void);
 
 
 /* Structure that declares the usual file */
@@ -74,7 +111,8 @@ struct file_operations mytraffic_fops = {
 	read: mytraffic_read,
 	write: mytraffic_write,
 	open: mytraffic_open,
-	release: mytraffic_release
+	release: mytraffic_release,
+	poll: mytraffic_poll
 };
 
 // Mode of traffic light
@@ -95,6 +133,16 @@ static unsigned bite = 256;
 module_param(capacity, uint, S_IRUGO);
 module_param(bite, uint, S_IRUGO);
 
+// With align_realtime the ticks are on a grid of the wall clock, from the
+// epoch plus align_offset_ms, so lights with synchronised clocks (NTP, GPS)
+// keep their cycles in step without talking to each other
+static bool align_realtime = 0;
+static int align_offset_ms = 0;
+module_param(align_realtime, bool, S_IRUGO);
+module_param(align_offset_ms, int, S_IRUGO);
+MODULE_PARM_DESC(align_realtime, "Phase lock the cycle to CLOCK_REALTIME");
+MODULE_PARM_DESC(align_offset_ms, "Start of the cycle after each whole cycle since the epoch (ms), with align_realtime");
+
 /* Major number */
 static int mytraffic_major = 61;
 // if pedestrian is called
@@ -115,17 +163,111 @@ static struct gpio gpios[] = {
 };
 
 // Global variables all stored in a struct
+// The ticks are at absolute times, tick N at origin + N / rate seconds. The
+// timer is set for the next one on that grid rather than a period after the
+// callback ran, so the callback latency does not add up and the cycle keeps
+// its phase over days.
 struct global{
   enum OperationalMode mode;
     int freq;
-    int time ;
-    struct timer_list timer;
+    struct hrtimer timer;
+    ktime_t origin; // tick 0, CLOCK_MONOTONIC or with align_realtime CLOCK_REALTIME
+    u64 tick;       // tick the timer is set for
+    int rate;       // freq the grid is drawn with, a new freq starts a new grid
+    ktime_t restart; // BTN0 came during a tick at this time, the timer starts a new grid from it
   int counter;  // coutner in cycle
   int status; // if LED is on or off
+    unsigned int lights;   // lights of the phase being timed, RED | YELLOW << 1 | GREEN << 2
+    ktime_t phaseStarted;  // when that phase started
+    ktime_t phaseDue;      // when it was planned to start, on the grid
+    ktime_t pedestrianAt;  // when the pedestrian call being served was made
 };
 
 static struct global* globalVar = NULL;
 
+// State seen by readers. The generation only changes when the lights, the
+// mode, the rate or the pedestrian flag do, not on every timer tick, so
+// a poll()ing reader sleeps between phase changes.
+static unsigned int trafficState = 0;
+static unsigned int trafficGeneration = 1;
+static DEFINE_SPINLOCK(trafficLock);
+
+// The grid, the mode and the counters, between the timer and BTN0. On
+// ti-rt both are threads and BTN0 can preempt the timer callback.
+static DEFINE_SPINLOCK(phaseLock);
+static DECLARE_WAIT_QUEUE_HEAD(trafficWait);
+
+// Per open file state
+struct trafficReader {
+	unsigned int generation;	// last generation read
+};
+
+// Statistics in /sys/kernel/mytraffic. Every CPU counts in its own copy,
+// without a lock or a shared cache line, and a read of the sysfs files sums
+// the copies, so they cost a few increments per tick and press and can stay
+// on in the field. The counters are unsigned long and wrap.
+#define STAT_BUCKETS 20 // histogram bucket i counts values from 2^(i-1) up to 2^i, the last one has no end
+
+struct trafficStats {
+	unsigned long buttons[2];       // button interrupts
+	unsigned long modeChanges;
+	unsigned long ticks;
+	unsigned long pedestrianCalls;  // presses while a call is waiting do not count
+	unsigned long pedestrianServed;
+	unsigned long pedestrianWaitMs; // total of the waits
+	unsigned long pedestrianWait[STAT_BUCKETS];     // ms from the call to its walk phase
+	unsigned long phases;           // light changes timed by the grid
+	unsigned long phasesLate;       // those that lasted longer than planned
+	unsigned long phaseError[STAT_BUCKETS];         // us between the duration of a phase and the planned one
+};
+
+static struct trafficStats __percpu *stats = NULL;
+static struct kobject *statKobj = NULL;
+
+// Time of day plans. A plan is a mode and a cycle rate, and the schedule
+// switches to a plan at a time of the day, local time of the kernel
+// timezone (sys_tz). The table is written in one go to
+// /sys/kernel/mytraffic/plans into the buffer the timer is not using, and
+// the two are swapped under planLock, so the timer only ever compares the
+// time with the next switch and copies a plan, with no allocation.
+#define PLAN_MAX 8
+#define PLAN_SWITCH_MAX 32
+#define PLAN_NAME 16
+#define PLAN_DAY (24 * 60 * 60)
+
+struct trafficPlan {
+	char name[PLAN_NAME];
+	enum OperationalMode mode;	// NORMAL, FLASHING_RED or FLASHING_YELLOW
+	int freq;
+};
+
+struct planSwitch {
+	int second;	// of the day
+	int plan;
+};
+
+struct planTable {
+	int plans;
+	struct trafficPlan plan[PLAN_MAX];
+	int switches;
+	struct planSwitch sw[PLAN_SWITCH_MAX];	// by time of day
+};
+
+static struct planTable planTables[2];
+static int planActive = 0;		// table the timer uses
+static int planEntry = 0;		// switch of the plan in force
+static time64_t planNextAt = 0;	// next switch, CLOCK_REALTIME seconds
+static bool planPending = 0;		// a new table waits for a cycle boundary
+static bool planRunning = 0;		// the lights follow planEntry
+static DEFINE_SPINLOCK(planLock);	// the above, with the timer
+static DEFINE_MUTEX(planUpload);	// the buffer the timer is not using
+
+static const char *const planModes[] = {
+	[NORMAL] = "normal",
+	[FLASHING_RED] = "flashing-red",
+	[FLASHING_YELLOW] = "flashing-yellow",
+};
+
 
 
 static int mytraffic_init(void)
@@ -145,6 +287,10 @@ static int mytraffic_init(void)
 		return result;
 	}
 
+	// Before the interrupt handlers count in them
+	result = statInit();
+	if(result)
+		goto fail;
 
 	// Request GPIO lines
 	err = gpio_request_array(gpios, ARRAY_SIZE(gpios));
@@ -186,14 +332,18 @@ static int mytraffic_init(void)
 
 	printk(KERN_ALERT "Inserting mytraffic module\n"); 
 
-	globalVar = (struct global*) kmalloc(sizeof(struct global), GFP_KERNEL);
+	globalVar = (struct global*) kzalloc(sizeof(struct global), GFP_KERNEL);
+	if(!globalVar) {
+		result = -ENOMEM;
+		goto fail;
+	}
 	globalVar-> freq = 1;
-	globalVar-> time = 1000; // in milliseconds
 	globalVar -> mode = NORMAL;
 	globalVar -> counter = 0;
 	globalVar -> status = 0;
-	timer_setup(&(globalVar->timer), displayFun, 0);
-	mod_timer(&(globalVar->timer), jiffies+ msecs_to_jiffies(globalVar->time));
+	hrtimer_init(&(globalVar->timer), CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	globalVar->timer.function = phaseFun;
+	phaseStart();
 
 	
 
@@ -212,7 +362,7 @@ static void mytraffic_exit(void)
 	/* Freeing the major number */
 	unregister_chrdev(mytraffic_major, "mytraffic");
 	if(globalVar) {
-		del_timer(&(globalVar->timer));
+		hrtimer_cancel(&(globalVar->timer));
 		kfree(globalVar);
 	}
 
@@ -222,6 +372,7 @@ static void mytraffic_exit(void)
 	gpio_set_value(GREEN_LED, 0);
 	gpio_set_value(YELLOW_LED, 0);
 	gpio_free_array(gpios, ARRAY_SIZE(gpios));
+	statExit();
 
 	printk(KERN_ALERT "Removing mytraffic module\n");
 
@@ -229,9 +380,17 @@ static void mytraffic_exit(void)
 
 static int mytraffic_open(struct inode *inode, struct file *filp)
 {
+	struct trafficReader *reader;
 
 	printk(KERN_DEBUG "open called: process id %d, command %s\n",
 		current->pid, current->comm);
+
+	// A new reader has not seen any state yet
+	reader = kzalloc(sizeof(struct trafficReader), GFP_KERNEL);
+	if(!reader)
+		return -ENOMEM;
+	filp->private_data = reader;
+
 	/* Success */
 	return 0;
 }
@@ -240,17 +399,34 @@ static int mytraffic_release(struct inode *inode, struct file *filp)
 {
 	printk(KERN_DEBUG "release called: process id %d, command %s\n",
 		current->pid, current->comm);
+	kfree(filp->private_data);
 	/* Success */
 	return 0;
 }
 
+// Readable when the state changed since this file last read it from offset 0
+static __poll_t mytraffic_poll(struct file *filp, poll_table *wait)
+{
+	struct trafficReader *reader = filp->private_data;
+
+	poll_wait(filp, &trafficWait, wait);
+	if(READ_ONCE(trafficGeneration) != reader->generation)
+		return EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
 static ssize_t mytraffic_read(struct file *filp, char *buf, 
 							size_t count, loff_t *f_pos)
 {
         char kernelBuf[128];
 	char * bufPtr = kernelBuf;
+	struct trafficReader *reader = filp->private_data;
 	int length;
 
+	// Reading from the start, e.g. with pread(fd, buf, n, 0), takes a new snapshot
+	if(*f_pos == 0)
+		reader->generation = READ_ONCE(trafficGeneration);
+
 	bufPtr += sprintf(bufPtr, "[MODE]: ");
 	switch(globalVar->mode) {
 		case NORMAL:
@@ -293,7 +469,7 @@ static ssize_t mytraffic_write(struct file *filp, const char *buf,
 {
 
 	// new frequency values
-	long int freqNew; 
+	long int freqNew = 0;
 	// checks if string to integer conversion works
 	int err;
 	char mytimer_buffer[32];
@@ -311,7 +487,11 @@ static ssize_t mytraffic_write(struct file *filp, const char *buf,
 	if (count > capacity - *f_pos)
 		count = capacity - *f_pos;
 
-	if (copy_from_user(mytimer_buffer + *f_pos, buf, count))
+	/* nor over the end of the buffer, a rate is a few digits */
+	if (count > sizeof(mytimer_buffer) - 1)
+		count = sizeof(mytimer_buffer) - 1;
+
+	if (copy_from_user(mytimer_buffer, buf, count))
 	{
 		return -EFAULT;
 	}
@@ -323,27 +503,31 @@ static ssize_t mytraffic_write(struct file *filp, const char *buf,
 	// converts the string to an integer
 	err = kstrtol(mytimer_buffer, 10, &freqNew);
 
+	if(err == 0 && (freqNew < 1 || freqNew > 1000))
+		err = -ERANGE;
+	trace_mytraffic_rate(freqNew, err);
 	if(err != 0){
 		printk(KERN_ALERT "Error occured in conversion\n");
+		return -EINVAL;
 	}
 
-	globalVar->freq = freqNew;
-	globalVar->time = 1000/freqNew;
-
-	#if DEBUG
-		printk(KERN_ALERT "FREQ = %ld\n", freqNew);
-	#endif
+	// The timer picks the new rate up at the next tick. It holds until
+	// the next switch of the plans.
+	WRITE_ONCE(globalVar->freq, freqNew);
+	planRunning = 0;
+	trafficChanged();
 
 	*f_pos = 0;
     return count;
 }
 
 static irqreturn_t btn0_handler(int irq, void * dev_id) {
+	unsigned long flags;
 
-#if DEBUG
-	printk(KERN_ALERT "Switching flashing modes\n");
-#endif
+	trace_mytraffic_button(0, globalVar->mode);
+	this_cpu_inc(stats->buttons[0]);
 
+	spin_lock_irqsave(&phaseLock, flags);
 	switch(globalVar->mode) {
 		case NORMAL:
 			globalVar->mode = FLASHING_RED;
@@ -355,6 +539,7 @@ static irqreturn_t btn0_handler(int irq, void * dev_id) {
 			globalVar->mode = NORMAL;
 			break;
          	case PEDESTRIAN:
+			spin_unlock_irqrestore(&phaseLock, flags);
 			return IRQ_HANDLED;
 		        break;
 	}
@@ -363,21 +548,34 @@ static irqreturn_t btn0_handler(int irq, void * dev_id) {
 	gpio_set_value(RED_LED, 0);
 	gpio_set_value(YELLOW_LED, 0);
 
+	this_cpu_inc(stats->modeChanges);
+	// Until the next switch of the plans
+	planRunning = 0;
+
 	globalVar->counter = 0;
 	globalVar->status = 0;
-	displayFun(&(globalVar->timer));
+	displayFun();
+	// The phase cut short is not timed, the new one is from now
+	statPhaseReset();
+	// The new mode starts its cycle now, unless the wall clock sets it
+	if(!align_realtime)
+		phaseRestart();
+	spin_unlock_irqrestore(&phaseLock, flags);
 	return IRQ_HANDLED;
 }
 
 static irqreturn_t btn1_handler(int irq, void * dev_id) {
 
-#if DEBUG
-	printk(KERN_ALERT "Pedestrian Called");
-#endif
+	trace_mytraffic_button(1, globalVar->mode);
+	this_cpu_inc(stats->buttons[1]);
 
 	if(globalVar->mode == NORMAL || globalVar -> mode == PEDESTRIAN){
+		if(!pedestrian_called) {
+			this_cpu_inc(stats->pedestrianCalls);
+			globalVar->pedestrianAt = ktime_get();
+		}
 		pedestrian_called = 1;
-
+		trafficChanged();
 	}
 
 
@@ -386,11 +584,111 @@ static irqreturn_t btn1_handler(int irq, void * dev_id) {
 
 
 
-void displayFun(struct timer_list* timer){
-  
-	#if DEBUG
-	printk(KERN_ALERT "Reached Display Function");
-	#endif
+// Phase engine, a tick of the lights at every point of the grid
+static enum hrtimer_restart phaseFun(struct hrtimer *timer){
+	u64 cycles;
+	enum OperationalMode mode;
+	ktime_t now = ktime_get();
+
+	spin_lock(&phaseLock);
+	// BTN0 just set the lights, this tick is the first of its new grid
+	if(globalVar->restart) {
+		phaseGrid(globalVar->restart);
+		globalVar->restart = 0;
+		hrtimer_set_expires(timer, phaseNext());
+		spin_unlock(&phaseLock);
+		return HRTIMER_RESTART;
+	}
+
+	cycles = globalVar->tick;
+	mode = globalVar->mode;
+	trace_mytraffic_tick(globalVar->mode, globalVar->counter, pedestrian_called, globalVar->tick,
+		ktime_to_ns(ktime_sub(now, hrtimer_get_expires(timer))));
+	this_cpu_inc(stats->ticks);
+
+	planBoundary();
+
+	// The wall clock says where in the cycle an aligned light is
+	if(align_realtime && globalVar->mode == NORMAL)
+		globalVar->counter = do_div(cycles, NORMAL_CYCLE);
+
+	displayFun();
+	if(globalVar->mode != mode)
+		this_cpu_inc(stats->modeChanges);
+	statPhase(hrtimer_get_expires(timer), now);
+	hrtimer_set_expires(timer, phaseNext());
+	spin_unlock(&phaseLock);
+	return HRTIMER_RESTART;
+}
+
+// Starts a grid with the first tick a period from now, or the one of the
+// wall clock with align_realtime
+static void phaseStart(void){
+	phaseGrid(ktime_get());
+	hrtimer_start(&(globalVar->timer), phaseNext(), HRTIMER_MODE_ABS);
+}
+
+// A new grid with tick 0 now, or at the epoch with align_realtime
+static void phaseGrid(ktime_t now){
+	globalVar->rate = READ_ONCE(globalVar->freq);
+	globalVar->origin = align_realtime ? ms_to_ktime(align_offset_ms) : now;
+	globalVar->tick = 0;
+	statPhaseReset();
+}
+
+// Restarts the grid from BTN0, under phaseLock. The timer is only started
+// again once it is off the queue; if its callback is running, waiting for
+// the lock, it starts the grid itself.
+static void phaseRestart(void){
+	if(hrtimer_try_to_cancel(&(globalVar->timer)) >= 0)
+		phaseStart();
+	else
+		globalVar->restart = ktime_get();
+}
+
+// Time of a tick of the grid
+static ktime_t phaseTickTime(u64 tick){
+	return ktime_add_ns(globalVar->origin, mul_u64_u32_div(tick, NSEC_PER_SEC, globalVar->rate));
+}
+
+// Ticks of the grid up to a time
+static u64 phaseTickAt(ktime_t time){
+	if(ktime_before(time, globalVar->origin))
+		return 0;
+	return mul_u64_u32_div(ktime_to_ns(ktime_sub(time, globalVar->origin)), globalVar->rate, NSEC_PER_SEC);
+}
+
+// Moves to the next tick of the grid and returns when it is due, on the
+// CLOCK_MONOTONIC of the timer. A tick more than a period late is skipped
+// rather than run in a burst. The wall clock is read again every tick, so
+// a light follows it when it is stepped or slewed.
+static ktime_t phaseNext(void){
+	ktime_t now, real;
+	int freq = READ_ONCE(globalVar->freq);
+
+	// A new rate starts a new grid at the tick just run
+	if(freq != globalVar->rate) {
+		if(!align_realtime)
+			globalVar->origin = phaseTickTime(globalVar->tick);
+		globalVar->tick = 0;
+		globalVar->rate = freq;
+	}
+
+	if(align_realtime) {
+		real = ktime_get_real();
+		now = ktime_get();
+		globalVar->tick = phaseTickAt(real) + 1;
+		return ktime_add(now, ktime_sub(phaseTickTime(globalVar->tick), real));
+	}
+
+	now = ktime_get();
+	globalVar->tick++;
+	if(ktime_before(phaseTickTime(globalVar->tick), now))
+		globalVar->tick = phaseTickAt(now) + 1;
+	return phaseTickTime(globalVar->tick);
+}
+
+void displayFun(void){
 
 	if(pedestrian_called && globalVar->counter == 4  && globalVar-> mode == NORMAL) {
 			globalVar->counter = 0;
@@ -423,14 +721,415 @@ void displayFun(struct timer_list* timer){
                 break;
 		}  
 	}
+
+	trafficChanged();
 }
 
+// Wakes the readers if anything they can see changed
+static void trafficChanged(void){
+	unsigned int state;
+	unsigned long flags;
 
-void normal_disp(void){
+	state = gpio_get_value(RED_LED) | gpio_get_value(YELLOW_LED) << 1 | gpio_get_value(GREEN_LED) << 2 |
+		(globalVar->mode == FLASHING_RED) << 3 | (globalVar->mode == FLASHING_YELLOW) << 4 |
+		pedestrian_called << 5 | globalVar->freq << 8;
 
-#if DEBUG
-  printk(KERN_ALERT "NORMAL");
-#endif
+	spin_lock_irqsave(&trafficLock, flags);
+	if(state == trafficState) {
+		spin_unlock_irqrestore(&trafficLock, flags);
+		return;
+	}
+	trafficState = state;
+	trafficGeneration++;
+	trace_mytraffic_phase(globalVar->mode, state, trafficGeneration);
+	spin_unlock_irqrestore(&trafficLock, flags);
+
+	wake_up_interruptible(&trafficWait);
+}
+
+// Histogram bucket of a value
+static unsigned int statBucket(u64 value){
+	return min_t(unsigned int, fls64(value), STAT_BUCKETS - 1);
+}
+
+// Starts timing the phase the lights are in now
+static void statPhaseReset(void){
+	globalVar->lights = gpio_get_value(RED_LED) | gpio_get_value(YELLOW_LED) << 1 | gpio_get_value(GREEN_LED) << 2;
+	globalVar->phaseStarted = ktime_get();
+	globalVar->phaseDue = globalVar->phaseStarted;
+}
+
+// After a tick due at due and run at now: if the lights changed, the phase
+// they leave lasted now - phaseStarted and was planned to last due - phaseDue
+static void statPhase(ktime_t due, ktime_t now){
+	unsigned int lights = gpio_get_value(RED_LED) | gpio_get_value(YELLOW_LED) << 1 | gpio_get_value(GREEN_LED) << 2;
+	s64 error;
+
+	if(lights == globalVar->lights)
+		return;
+
+	error = ktime_to_ns(ktime_sub(now, globalVar->phaseStarted)) - ktime_to_ns(ktime_sub(due, globalVar->phaseDue));
+	this_cpu_inc(stats->phases);
+	if(error > 0)
+		this_cpu_inc(stats->phasesLate);
+	this_cpu_inc(stats->phaseError[statBucket(div_u64(abs(error), NSEC_PER_USEC))]);
+
+	globalVar->lights = lights;
+	globalVar->phaseStarted = now;
+	globalVar->phaseDue = due;
+}
+
+// The walk phase of a pedestrian call starts
+static void statPedestrianServed(void){
+	s64 wait = ktime_to_ms(ktime_sub(ktime_get(), globalVar->pedestrianAt));
+
+	this_cpu_inc(stats->pedestrianServed);
+	this_cpu_add(stats->pedestrianWaitMs, wait);
+	this_cpu_inc(stats->pedestrianWait[statBucket(wait)]);
+}
+
+// Sum over the CPUs of the counter at an offset of struct trafficStats
+static unsigned long statSum(size_t offset){
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *(unsigned long *) ((char *) per_cpu_ptr(stats, cpu) + offset);
+	return sum;
+}
+
+// A histogram, a line per bucket with its lower end and its count
+static ssize_t statHistogram(char *buf, size_t offset){
+	char *bufPtr = buf;
+	int i;
+
+	for(i = 0; i < STAT_BUCKETS; i++)
+		bufPtr += sprintf(bufPtr, "%lu %lu\n", i ? 1UL << (i - 1) : 0,
+			statSum(offset + i * sizeof(unsigned long)));
+	return bufPtr - buf;
+}
+
+#define STAT_COUNTER(NAME, FIELD)							\
+static ssize_t NAME##_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf){	\
+	return sprintf(buf, "%lu\n", statSum(offsetof(struct trafficStats, FIELD)));		\
+}											\
+static struct kobj_attribute NAME##_attr = __ATTR_RO(NAME)
+
+#define STAT_HISTOGRAM(NAME, FIELD)							\
+static ssize_t NAME##_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf){	\
+	return statHistogram(buf, offsetof(struct trafficStats, FIELD));			\
+}											\
+static struct kobj_attribute NAME##_attr = __ATTR_RO(NAME)
+
+STAT_COUNTER(btn0_irqs, buttons[0]);
+STAT_COUNTER(btn1_irqs, buttons[1]);
+STAT_COUNTER(mode_changes, modeChanges);
+STAT_COUNTER(ticks, ticks);
+STAT_COUNTER(pedestrian_calls, pedestrianCalls);
+STAT_COUNTER(pedestrian_served, pedestrianServed);
+STAT_COUNTER(pedestrian_wait_total_ms, pedestrianWaitMs);
+STAT_HISTOGRAM(pedestrian_wait_ms, pedestrianWait);
+STAT_COUNTER(phases, phases);
+STAT_COUNTER(phases_late, phasesLate);
+STAT_HISTOGRAM(phase_error_us, phaseError);
+
+// Writing anything clears the statistics. A CPU counting at the same time
+// may keep an increment.
+static ssize_t reset_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count){
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(stats, cpu), 0, sizeof(struct trafficStats));
+	return count;
+}
+static struct kobj_attribute reset_attr = __ATTR(reset, S_IWUSR, NULL, reset_store);
+
+// Second of the day of a CLOCK_REALTIME time, in the kernel timezone
+static int planSecond(time64_t real){
+	s32 second;
+
+	div_s64_rem(real - sys_tz.tz_minuteswest * 60, PLAN_DAY, &second);
+	if(second < 0)
+		second += PLAN_DAY;
+	return second;
+}
+
+// When the switch after entry comes, the same one tomorrow if it is the only one
+static time64_t planNext(const struct planTable *table, int entry, time64_t real){
+	int next = (entry + 1) % table->switches;
+	time64_t at = real - planSecond(real) + table->sw[next].second;
+
+	if(at <= real)
+		at += PLAN_DAY;
+	return at;
+}
+
+// The switch in force at a time, the last one of the day before the first
+static int planFind(const struct planTable *table, time64_t real){
+	int second = planSecond(real);
+	int entry = table->switches - 1;
+	int i;
+
+	for(i = 0; i < table->switches && table->sw[i].second <= second; i++)
+		entry = i;
+	return entry;
+}
+
+// A cycle is about to start, or a flashing light to turn on
+static bool planAtBoundary(void){
+	u64 cycles = globalVar->tick;
+
+	switch(globalVar->mode) {
+		case NORMAL:
+			if(align_realtime)
+				return do_div(cycles, NORMAL_CYCLE) == 0;
+			return globalVar->counter == 0 || globalVar->counter >= NORMAL_CYCLE;
+		case FLASHING_RED:
+		case FLASHING_YELLOW:
+			return globalVar->status == 0;
+		case PEDESTRIAN:
+			break;
+	}
+	return 0;
+}
+
+// Puts a plan in force, from its first phase
+static void planApply(int entry){
+	const struct planTable *table = &planTables[planActive];
+	const struct trafficPlan *plan = &table->plan[table->sw[entry].plan];
+
+	trace_mytraffic_plan(table->sw[entry].plan, plan->mode, plan->freq);
+	if(plan->mode != globalVar->mode) {
+		gpio_set_value(GREEN_LED, 0);
+		gpio_set_value(RED_LED, 0);
+		gpio_set_value(YELLOW_LED, 0);
+		globalVar->mode = plan->mode;
+		globalVar->counter = 0;
+		globalVar->status = 0;
+	}
+	WRITE_ONCE(globalVar->freq, plan->freq);
+	planEntry = entry;
+	planRunning = 1;
+}
+
+// At every tick, switches plans if one is due and the cycle allows it
+static void planBoundary(void){
+	const struct planTable *table;
+	time64_t real;
+
+	spin_lock(&planLock);
+	table = &planTables[planActive];
+	if(!table->switches || !planAtBoundary()) {
+		spin_unlock(&planLock);
+		return;
+	}
+
+	real = ktime_get_real_seconds();
+	if(planPending) {
+		planPending = 0;
+		planApply(planFind(table, real));
+		planNextAt = planNext(table, planEntry, real);
+	} else if(real >= planNextAt) {
+		planApply((planEntry + 1) % table->switches);
+		planNextAt = planNext(table, planEntry, real);
+	}
+	spin_unlock(&planLock);
+}
+
+// A line of the plans: "plan NAME MODE RATE" or "HH:MM NAME", blank or # for a comment
+static int planParseLine(struct planTable *table, const char *line){
+	char name[PLAN_NAME], mode[PLAN_NAME];
+	int freq, hour, minute, second;
+	char c;
+	int i, m;
+
+	if(sscanf(line, " %c", &c) != 1 || c == '#')
+		return 0;
+
+	if(sscanf(line, " plan %15s %15s %d", name, mode, &freq) == 3) {
+		if(table->plans == PLAN_MAX || freq < 1 || freq > 1000)
+			return -EINVAL;
+		for(i = 0; i < table->plans; i++) {
+			if(!strcmp(table->plan[i].name, name))
+				return -EINVAL;
+		}
+		for(m = 0; m < ARRAY_SIZE(planModes); m++) {
+			if(planModes[m] && !strcmp(planModes[m], mode))
+				break;
+		}
+		if(m == ARRAY_SIZE(planModes))
+			return -EINVAL;
+		strcpy(table->plan[table->plans].name, name);
+		table->plan[table->plans].mode = m;
+		table->plan[table->plans].freq = freq;
+		table->plans++;
+		return 0;
+	}
+
+	if(sscanf(line, " %d:%d %15s", &hour, &minute, name) == 3) {
+		if(table->switches == PLAN_SWITCH_MAX || hour < 0 || hour > 23 || minute < 0 || minute > 59)
+			return -EINVAL;
+		second = (hour * 60 + minute) * 60;
+		for(i = 0; i < table->plans && strcmp(table->plan[i].name, name); i++)
+			;
+		if(i == table->plans)
+			return -EINVAL; // plans are defined before they are used
+
+		// Kept in time order
+		for(m = table->switches; m > 0 && table->sw[m - 1].second > second; m--)
+			table->sw[m] = table->sw[m - 1];
+		if(m > 0 && table->sw[m - 1].second == second)
+			return -EINVAL;
+		table->sw[m].second = second;
+		table->sw[m].plan = i;
+		table->switches++;
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+static int planParse(struct planTable *table, const char *buf, size_t count){
+	char line[64];
+	const char *end;
+	size_t length;
+	int err;
+
+	memset(table, 0, sizeof(struct planTable));
+	while(count) {
+		end = memchr(buf, '\n', count);
+		length = end ? end - buf : count;
+		if(length >= sizeof(line))
+			return -EINVAL;
+		memcpy(line, buf, length);
+		line[length] = '\0';
+
+		err = planParseLine(table, line);
+		if(err)
+			return err;
+		if(!end)
+			break;
+		buf += length + 1;
+		count -= length + 1;
+	}
+	return 0;
+}
+
+// A new table, in force from the next cycle boundary. An empty one stops
+// the scheduler and leaves the lights as they are.
+static ssize_t plans_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count){
+	unsigned long flags;
+	int err;
+
+	mutex_lock(&planUpload);
+	err = planParse(&planTables[!planActive], buf, count);
+	if(err) {
+		mutex_unlock(&planUpload);
+		return err;
+	}
+
+	spin_lock_irqsave(&planLock, flags);
+	planActive = !planActive;
+	planPending = planTables[planActive].switches > 0;
+	planRunning = 0;
+	spin_unlock_irqrestore(&planLock, flags);
+	mutex_unlock(&planUpload);
+	return count;
+}
+
+// The table in force, in the format it is written in
+static ssize_t plans_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf){
+	const struct planTable *table;
+	char *bufPtr = buf;
+	int i;
+
+	mutex_lock(&planUpload);
+	table = &planTables[planActive];
+	for(i = 0; i < table->plans; i++)
+		bufPtr += sprintf(bufPtr, "plan %s %s %d\n", table->plan[i].name,
+			planModes[table->plan[i].mode], table->plan[i].freq);
+	for(i = 0; i < table->switches; i++)
+		bufPtr += sprintf(bufPtr, "%02d:%02d %s\n", table->sw[i].second / 3600,
+			table->sw[i].second / 60 % 60, table->plan[table->sw[i].plan].name);
+	mutex_unlock(&planUpload);
+	return bufPtr - buf;
+}
+static struct kobj_attribute plans_attr = __ATTR(plans, S_IRUGO | S_IWUSR, plans_show, plans_store);
+
+// The plan the lights follow, none after a button or a rate written by hand
+static ssize_t plan_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf){
+	const struct planTable *table;
+	unsigned long flags;
+	ssize_t length;
+
+	spin_lock_irqsave(&planLock, flags);
+	table = &planTables[planActive];
+	if(planRunning)
+		length = sprintf(buf, "%s\n", table->plan[table->sw[planEntry].plan].name);
+	else
+		length = sprintf(buf, "none\n");
+	spin_unlock_irqrestore(&planLock, flags);
+	return length;
+}
+static struct kobj_attribute plan_attr = __ATTR_RO(plan);
+
+static struct attribute *statAttrs[] = {
+	&btn0_irqs_attr.attr,
+	&btn1_irqs_attr.attr,
+	&mode_changes_attr.attr,
+	&ticks_attr.attr,
+	&pedestrian_calls_attr.attr,
+	&pedestrian_served_attr.attr,
+	&pedestrian_wait_total_ms_attr.attr,
+	&pedestrian_wait_ms_attr.attr,
+	&phases_attr.attr,
+	&phases_late_attr.attr,
+	&phase_error_us_attr.attr,
+	&reset_attr.attr,
+	&plans_attr.attr,
+	&plan_attr.attr,
+	NULL,
+};
+
+static struct attribute_group statGroup = {
+	.attrs = statAttrs,
+};
+
+static int statInit(void){
+	int err;
+
+	stats = alloc_percpu(struct trafficStats);
+	if(!stats)
+		return -ENOMEM;
+
+	statKobj = kobject_create_and_add("mytraffic", kernel_kobj);
+	if(!statKobj) {
+		printk(KERN_ALERT "mytraffic: could not create the statistics in sysfs\n");
+		return -ENOMEM;
+	}
+
+	err = sysfs_create_group(statKobj, &statGroup);
+	if(err) {
+		printk(KERN_ALERT "mytraffic: could not create the statistics in sysfs\n");
+		return err;
+	}
+	return 0;
+}
+
+// Also after a statInit that failed half way
+static void statExit(void){
+	if(statKobj) {
+		kobject_put(statKobj); // removes the group with it
+		statKobj = NULL;
+	}
+	if(stats) {
+		free_percpu(stats);
+		stats = NULL;
+	}
+}
+
+
+void normal_disp(void){
 
   if(globalVar->counter > 5)
     globalVar -> counter = 0;
@@ -462,17 +1161,11 @@ void normal_disp(void){
 
 
 
-  mod_timer(&(globalVar->timer), jiffies+ msecs_to_jiffies(globalVar->time));
-
   
 }
 
 void red_disp(void){
 
-#if DEBUG
-  printk(KERN_ALERT "RED");
-#endif
-
 	if(globalVar->status == 0){
 		gpio_set_value(RED_LED, 1);
 		globalVar -> status = 1;
@@ -481,18 +1174,12 @@ void red_disp(void){
 		globalVar -> status = 0;
     }
 
-	mod_timer(&(globalVar->timer), jiffies+ msecs_to_jiffies(globalVar->time));
-
 }
 
 
 
 void yellow_disp(void){
 
-#if DEBUG
-  printk(KERN_ALERT "YELLOW");
-#endif
-
 	if(globalVar->status == 0){
 		gpio_set_value(YELLOW_LED, 1);
 		globalVar -> status = 1;
@@ -501,20 +1188,16 @@ void yellow_disp(void){
 		globalVar -> status = 0;
     }
 
-	mod_timer(&(globalVar->timer), jiffies+ msecs_to_jiffies(globalVar->time));
-
 }
 
 
 void pedestrian_disp(void){
 
-	#if DEBUG
-		printk(KERN_ALERT "PEDESTRIAN");
-	#endif
-
 	
 	if(globalVar->counter < 5){
 		if(globalVar->status == 0){
+			if(pedestrian_called)
+				statPedestrianServed();
 		        pedestrian_called = 0;
 			gpio_set_value(RED_LED, 1);
 			gpio_set_value(YELLOW_LED, 1);
@@ -542,6 +1225,4 @@ void pedestrian_disp(void){
 		globalVar->counter = 0;
 	}
 
-	mod_timer(&(globalVar->timer), jiffies+ msecs_to_jiffies(globalVar->time));
-
 }
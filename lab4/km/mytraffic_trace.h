@@ -0,0 +1,117 @@
+// Name: Justin Sadler, Abin George
+// Tracepoints of mytraffic.c. Enable them with
+//   echo 1 > /sys/kernel/debug/tracing/events/mytraffic/enable
+// or record them with perf record -e 'mytraffic:*'.
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM mytraffic
+
+#if !defined(_MYTRAFFIC_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _MYTRAFFIC_TRACE_H
+
+#include <linux/tracepoint.h>
+
+// Same order as enum OperationalMode
+#define show_traffic_mode(mode) __print_symbolic(mode,	\
+		{ 0, "normal" },			\
+		{ 1, "flashing_red" },			\
+		{ 2, "flashing_yellow" },		\
+		{ 3, "pedestrian" })
+
+// Every tick of the phase engine: the tick of the grid and how late the
+// timer ran, the latency does not add up from one tick to the next
+TRACE_EVENT(mytraffic_tick,
+	TP_PROTO(int mode, int counter, int pedestrian, u64 tick, s64 late_ns),
+	TP_ARGS(mode, counter, pedestrian, tick, late_ns),
+	TP_STRUCT__entry(
+		__field(int, mode)
+		__field(int, counter)
+		__field(int, pedestrian)
+		__field(u64, tick)
+		__field(s64, late_ns)
+	),
+	TP_fast_assign(
+		__entry->mode = mode;
+		__entry->counter = counter;
+		__entry->pedestrian = pedestrian;
+		__entry->tick = tick;
+		__entry->late_ns = late_ns;
+	),
+	TP_printk("%s counter %d pedestrian %d tick %llu late %lld ns", show_traffic_mode(__entry->mode),
+		__entry->counter, __entry->pedestrian, __entry->tick, __entry->late_ns)
+);
+
+// The lights, the mode, the rate or the pedestrian flag changed, readers are woken
+TRACE_EVENT(mytraffic_phase,
+	TP_PROTO(int mode, unsigned int state, unsigned int generation),
+	TP_ARGS(mode, state, generation),
+	TP_STRUCT__entry(
+		__field(int, mode)
+		__field(unsigned int, state)
+		__field(unsigned int, generation)
+	),
+	TP_fast_assign(
+		__entry->mode = mode;
+		__entry->state = state;
+		__entry->generation = generation;
+	),
+	TP_printk("%s red %d yellow %d green %d pedestrian %d %u Hz generation %u",
+		show_traffic_mode(__entry->mode), __entry->state & 1, (__entry->state >> 1) & 1,
+		(__entry->state >> 2) & 1, (__entry->state >> 5) & 1, __entry->state >> 8, __entry->generation)
+);
+
+// A button interrupt, in the mode it found the light in
+TRACE_EVENT(mytraffic_button,
+	TP_PROTO(int button, int mode),
+	TP_ARGS(button, mode),
+	TP_STRUCT__entry(
+		__field(int, button)
+		__field(int, mode)
+	),
+	TP_fast_assign(
+		__entry->button = button;
+		__entry->mode = mode;
+	),
+	TP_printk("BTN%d in %s", __entry->button, show_traffic_mode(__entry->mode))
+);
+
+// A new cycle rate written to the device
+TRACE_EVENT(mytraffic_rate,
+	TP_PROTO(long freq, int err),
+	TP_ARGS(freq, err),
+	TP_STRUCT__entry(
+		__field(long, freq)
+		__field(int, err)
+	),
+	TP_fast_assign(
+		__entry->freq = freq;
+		__entry->err = err;
+	),
+	TP_printk("%ld Hz err %d", __entry->freq, __entry->err)
+);
+
+// The plan scheduler switched to a plan, at a cycle boundary
+TRACE_EVENT(mytraffic_plan,
+	TP_PROTO(int plan, int mode, int freq),
+	TP_ARGS(plan, mode, freq),
+	TP_STRUCT__entry(
+		__field(int, plan)
+		__field(int, mode)
+		__field(int, freq)
+	),
+	TP_fast_assign(
+		__entry->plan = plan;
+		__entry->mode = mode;
+		__entry->freq = freq;
+	),
+	TP_printk("plan %d %s %d Hz", __entry->plan, show_traffic_mode(__entry->mode), __entry->freq)
+);
+
+#endif // _MYTRAFFIC_TRACE_H
+
+// The header is read again from this directory to generate the events
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE mytraffic_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,21 @@
+#include "trafficwindow.h"
+
+int main(int argc, char **argv)
+{
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("devices"),
+            QStringLiteral("mytraffic devices, one per intersection. /dev/mytraffic by default."), QStringLiteral("[device...]"));
+    parser.process(app);
+
+    QStringList devices = parser.positionalArguments();
+    if (devices.isEmpty())
+        devices << QStringLiteral("/dev/mytraffic");
+
+    TrafficWindow window(devices);
+    window.show();
+
+    return app.exec();
+}
@@ -0,0 +1,81 @@
+#include "trafficdevice.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+TrafficDevice::TrafficDevice(const QString &path, QObject *parent)
+    : QObject(parent)
+    , m_path(path)
+    , m_fd(-1)
+    , m_notifier(0)
+{
+    m_state.rate = 0;
+    m_state.red = m_state.yellow = m_state.green = false;
+    m_state.pedestrian = false;
+
+    m_fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        m_error = QStringLiteral("%1: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+        return;
+    }
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, QOverload<QSocketDescriptor, QSocketNotifier::Type>::of(&QSocketNotifier::activated),
+            this, &TrafficDevice::readState);
+
+    readState();
+}
+
+TrafficDevice::~TrafficDevice()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+// The status is a few "[Name]: value" lines
+void TrafficDevice::readState()
+{
+    char buf[256];
+    ssize_t n;
+
+    do {
+        n = ::pread(m_fd, buf, sizeof(buf) - 1, 0);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        m_error = QString::fromLocal8Bit(strerror(errno));
+        m_notifier->setEnabled(false);
+        emit stateChanged();
+        return;
+    }
+    buf[n] = '\0';
+
+    TrafficState state = m_state;
+    const QStringList lines = QString::fromLatin1(buf).split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+    for (const QString &line : lines) {
+        const int colon = line.indexOf(QLatin1String("]: "));
+        if (colon < 0)
+            continue;
+        const QString name = line.left(colon + 1);
+        const QString value = line.mid(colon + 3).trimmed();
+
+        if (name == QLatin1String("[MODE]")) {
+            state.mode = value;
+        } else if (name.startsWith(QLatin1String("[Current Cycle Rate]"))) {
+            state.rate = value.section(QLatin1Char(' '), 0, 0).toInt();
+        } else if (name.startsWith(QLatin1String("[Current Status")) && value.size() >= 3) {
+            state.red = value.at(0) == QLatin1Char('1');
+            state.yellow = value.at(1) == QLatin1Char('1');
+            state.green = value.at(2) == QLatin1Char('1');
+        } else if (name.startsWith(QLatin1String("[Pedestrian"))) {
+            state.pedestrian = value == QLatin1String("1");
+        }
+    }
+
+    if (state != m_state) {
+        m_state = state;
+        emit stateChanged();
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef TRAFFICDEVICE_H
+#define TRAFFICDEVICE_H
+
+#include <QtCore>
+
+// What mytraffic reports through read()
+struct TrafficState {
+    QString mode;
+    int rate;           // Hz
+    bool red;
+    bool yellow;
+    bool green;
+    bool pedestrian;
+
+    bool operator==(const TrafficState &other) const
+    {
+        return mode == other.mode && rate == other.rate && red == other.red && yellow == other.yellow
+                && green == other.green && pedestrian == other.pedestrian;
+    }
+    bool operator!=(const TrafficState &other) const { return !(*this == other); }
+};
+
+// Follows one mytraffic device. The module reports the device readable
+// only when its state changed, so the notifier stays quiet between phase
+// changes; each wakeup re-reads the status from offset 0 with pread().
+class TrafficDevice : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TrafficDevice(const QString &path = QStringLiteral("/dev/mytraffic"), QObject *parent = 0);
+    ~TrafficDevice();
+
+    bool isOpen() const { return m_fd >= 0; }
+    QString path() const { return m_path; }
+    QString errorString() const { return m_error; }
+    const TrafficState &state() const { return m_state; }
+
+signals:
+    void stateChanged();
+
+private slots:
+    void readState();
+
+private:
+    QString m_path;
+    int m_fd;
+    QSocketNotifier *m_notifier;
+    TrafficState m_state;
+    QString m_error;
+};
+
+#endif // TRAFFICDEVICE_H
@@ -0,0 +1,156 @@
+#include "trafficwindow.h"
+
+static const int margin = 6;
+static const QColor lampColors[] = { QColor(230, 40, 30), QColor(245, 190, 20), QColor(40, 200, 70) };
+
+TrafficWindow::TrafficWindow(const QStringList &devices, QWindow *parent)
+    : RasterWindow(parent)
+{
+    m_intersections.resize(devices.size());
+    for (int i = 0; i < devices.size(); ++i) {
+        Intersection &intersection = m_intersections[i];
+        intersection.device = new TrafficDevice(devices.at(i), this);
+        intersection.shown = intersection.device->state();
+        updateText(intersection);
+
+        connect(intersection.device, &TrafficDevice::stateChanged, this, [this, i] { stateChanged(i); });
+    }
+
+    // The 4.3" LCD cape of the BeagleBone
+    resize(480, 272);
+}
+
+void TrafficWindow::resizeEvent(QResizeEvent *event)
+{
+    RasterWindow::resizeEvent(event);
+    layoutPanels();
+}
+
+// One column per intersection: the name, the light, then mode, rate and pedestrian
+void TrafficWindow::layoutPanels()
+{
+    const int lineHeight = QFontMetrics(QGuiApplication::font()).height();
+    const int count = qMax(m_intersections.size(), 1);
+    const int panelWidth = (width() - margin) / count;
+
+    m_title = QRect(margin, margin, width() - 2 * margin, lineHeight + margin);
+    const int top = m_title.bottom() + margin;
+
+    for (int i = 0; i < m_intersections.size(); ++i) {
+        Intersection &intersection = m_intersections[i];
+        intersection.panel = QRect(margin + i * panelWidth, top, panelWidth - margin, height() - top - margin);
+        intersection.text = QRect(intersection.panel.left() + margin, intersection.panel.bottom() - 3 * lineHeight - margin,
+                                  intersection.panel.width() - 2 * margin, 3 * lineHeight);
+
+        // Lamps stacked in the space between the name and the text
+        const int lampTop = intersection.panel.top() + lineHeight + 2 * margin;
+        const int space = intersection.text.top() - margin - lampTop;
+        const int size = qMax(qMin(intersection.panel.width() / 3, space / LampCount - margin), 4);
+        const int x = intersection.panel.center().x() - size / 2;
+        for (int lamp = 0; lamp < LampCount; ++lamp)
+            intersection.lamps[lamp] = QRect(x, lampTop + margin + lamp * (size + margin), size, size);
+    }
+}
+
+void TrafficWindow::renderBackground(QPainter *painter)
+{
+    painter->fillRect(0, 0, width(), height(), QGradient::NightFade);
+    painter->setRenderHint(QPainter::Antialiasing);
+
+    QFont font = painter->font();
+    font.setBold(true);
+    painter->setFont(font);
+    painter->drawText(m_title, Qt::AlignLeft | Qt::AlignVCenter, QStringLiteral("Traffic lights"));
+    font.setBold(false);
+    painter->setFont(font);
+
+    for (const Intersection &intersection : qAsConst(m_intersections)) {
+        painter->setPen(QColor(40, 40, 60));
+        painter->setBrush(Qt::NoBrush);
+        painter->drawRect(intersection.panel.adjusted(0, 0, -1, -1));
+        painter->drawText(intersection.panel.adjusted(margin, margin, -margin, 0), Qt::AlignHCenter | Qt::AlignTop,
+                          QFileInfo(intersection.device->path()).fileName());
+
+        // Housing with the lamps off
+        const QRect housing = intersection.lamps[Red].united(intersection.lamps[Green]).adjusted(-margin, -margin, margin, margin);
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(QColor(35, 35, 40));
+        painter->drawRoundedRect(housing, margin, margin);
+        for (int lamp = 0; lamp < LampCount; ++lamp) {
+            painter->setBrush(lampColors[lamp].darker(400));
+            painter->drawEllipse(intersection.lamps[lamp]);
+        }
+    }
+}
+
+void TrafficWindow::render(QPainter *painter)
+{
+    const QRegion clip = painter->clipRegion();
+
+    painter->setRenderHint(QPainter::Antialiasing);
+    for (const Intersection &intersection : qAsConst(m_intersections)) {
+        if (clip.intersects(intersection.panel))
+            renderIntersection(painter, intersection);
+    }
+}
+
+void TrafficWindow::renderIntersection(QPainter *painter, const Intersection &intersection)
+{
+    const TrafficState &state = intersection.shown;
+    const bool lit[LampCount] = { state.red, state.yellow, state.green };
+
+    painter->setPen(Qt::NoPen);
+    for (int lamp = 0; lamp < LampCount; ++lamp) {
+        if (!lit[lamp])
+            continue;
+        painter->setBrush(lampColors[lamp]);
+        painter->drawEllipse(intersection.lamps[lamp]);
+    }
+
+    const int lineHeight = painter->fontMetrics().height();
+    QPoint line = intersection.text.topLeft();
+    painter->setPen(Qt::black);
+    painter->drawStaticText(line, intersection.modeText);
+    line.ry() += lineHeight;
+    painter->drawStaticText(line, intersection.rateText);
+    line.ry() += lineHeight;
+    painter->drawStaticText(line, intersection.pedestrianText);
+}
+
+void TrafficWindow::updateText(Intersection &intersection)
+{
+    const TrafficDevice *device = intersection.device;
+    const TrafficState &state = intersection.shown;
+
+    if (!device->errorString().isEmpty()) {
+        setStaticText(intersection.modeText, device->errorString());
+        setStaticText(intersection.rateText, QString());
+        setStaticText(intersection.pedestrianText, QString());
+        return;
+    }
+
+    setStaticText(intersection.modeText, state.mode);
+    setStaticText(intersection.rateText, QStringLiteral("%1 Hz").arg(state.rate));
+    setStaticText(intersection.pedestrianText, state.pedestrian ? QStringLiteral("Pedestrian waiting") : QString());
+}
+
+// Only what changed is repainted: the lamps that switched and the text
+void TrafficWindow::stateChanged(int index)
+{
+    Intersection &intersection = m_intersections[index];
+    const TrafficState &state = intersection.device->state();
+    const TrafficState old = intersection.shown;
+
+    intersection.shown = state;
+    updateText(intersection);
+
+    if (state.red != old.red)
+        renderLater(intersection.lamps[Red]);
+    if (state.yellow != old.yellow)
+        renderLater(intersection.lamps[Yellow]);
+    if (state.green != old.green)
+        renderLater(intersection.lamps[Green]);
+    if (state.mode != old.mode || state.rate != old.rate || state.pedestrian != old.pedestrian
+            || !intersection.device->errorString().isEmpty())
+        renderLater(intersection.text);
+}
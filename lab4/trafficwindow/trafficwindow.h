@@ -0,0 +1,45 @@
+#ifndef TRAFFICWINDOW_H
+#define TRAFFICWINDOW_H
+
+#include "rasterwindow.h"
+#include "trafficdevice.h"
+
+// Live state of one or more intersections, one mytraffic device each.
+// The housings and dark lamps are in the cached background; a state change
+// repaints only the lamps and text of its intersection.
+class TrafficWindow : public RasterWindow
+{
+    Q_OBJECT
+public:
+    explicit TrafficWindow(const QStringList &devices, QWindow *parent = 0);
+
+    void render(QPainter *painter) override;
+
+protected:
+    void renderBackground(QPainter *painter) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    enum Lamp { Red, Yellow, Green, LampCount };
+
+    struct Intersection {
+        TrafficDevice *device;
+        TrafficState shown;
+        QRect panel;
+        QRect lamps[LampCount];
+        QRect text;
+        QStaticText modeText;
+        QStaticText rateText;
+        QStaticText pedestrianText;
+    };
+
+    void layoutPanels();
+    void stateChanged(int index);
+    void updateText(Intersection &intersection);
+    void renderIntersection(QPainter *painter, const Intersection &intersection);
+
+    QVector<Intersection> m_intersections;
+    QRect m_title;
+};
+
+#endif // TRAFFICWINDOW_H
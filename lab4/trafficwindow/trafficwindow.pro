@@ -0,0 +1,10 @@
+include(../../lab5/rasterwindow/rasterwindow.pri)
+
+SOURCES += \
+    main.cpp \
+    trafficdevice.cpp \
+    trafficwindow.cpp
+
+HEADERS += \
+    trafficdevice.h \
+    trafficwindow.h
@@ -8,11 +8,11 @@
 #include <linux/fs.h> 
 #include <linux/notifier.h>
 #include <linux/slab.h> /* kmalloc() */
+#include <linux/vmalloc.h> /* vmalloc() */
 #include <linux/errno.h> /* error codes */
 #include <linux/types.h> /* size_t */
 #include <linux/proc_fs.h>
 #include <linux/fcntl.h> /* O_ACCMODE */
-#include <asm/system_misc.h> /* cli(), *_flags */
 #include <linux/uaccess.h>
 #include <asm/uaccess.h> /* copy_from/to_user */
 #include <linux/gpio.h> // legacy GPIO interface
@@ -23,6 +23,22 @@
 #include <linux/delay.h>
 #include <linux/pwm.h>
 #include <linux/gpio/driver.h> 
+#include <linux/input.h> // joystick input handler
+#include <linux/math64.h> /* div_s64() */
+#include <linux/firmware.h> /* request_firmware() */
+#include <linux/rcupdate.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/crc32.h>
+#include <linux/workqueue.h>
+#include <linux/atomic.h>
+#include <linux/iio/consumer.h> /* position feedback */
+#include "arm_ioctl.h"
+
+#define CREATE_TRACE_POINTS
+#include "arm_trace.h"
 // NOTE: ADded min, max macros
 /*
 Changed globalServo to stack from heap
@@ -34,7 +50,6 @@ MODULE_LICENSE("GPL");
 
 // Debugging purposes
 #define DEBUG 0
-#define DEBUG_SERVO 0
 
 // GPIOS to control servo
 #define ELBOW_GPIO 2
@@ -54,82 +69,583 @@ MODULE_LICENSE("GPL");
 #define KEY_ENTER	0xF201
 #define KEY_GRIP	0xFB67
 #define KEY_UNGRIP	0xFB68
+#define KEY_F1		0xF100	// F1-F3 choose the arm the keyboard drives
 
 
 // Definitions for the Servo 
-// Periods and duty cycles are in microseconds
+// Periods and duty cycles are in microseconds. The duty time a servo is at
+// is kept in ns, so it moves in steps finer than a us without floating point.
 #define PERIOD 20000
 #define HS422_MIN_DUTYCYCLE	200 // duty cycle
 #define HS422_MAX_DUTYCYCLE	900
 #define SG90_MIN_DUTYCYCLE  200
 #define SG90_MAX_DUTYCYCLE  900
-#define PWM_STEP			50
+#define DUTY_NS			1000	// ns per us of duty time
+#define DUTY_FROM_US(US)	((US) * DUTY_NS)
+#define DUTY_TO_US(NS)		DIV_ROUND_CLOSEST(NS, DUTY_NS)	// duty times are positive
+
+// Definitions for the joystick velocity mode
+// Axis positions are normalised to +-JOY_AXIS_MAX (per mille of full deflection)
+#define JOY_AXIS_MAX	1000
+#define JOY_AXIS_WRIST	ABS_Y
+#define JOY_AXIS_ELBOW	ABS_X
+#define JOY_AXIS_GRIP	ABS_RY
+
+// Definitions for the inverse kinematics
+// Lengths are in micrometres, angles in millidegrees
+#define IK_MAX_UM		(1 << 22)	// largest coordinate accepted
+#define IK_CORDIC_ITER		20
+#define IK_CORDIC_SHIFT		6		// headroom for the CORDIC gain in s32
+#define IK_CORDIC_GAIN_Q30	652032874	// 1/K of the CORDIC, in Q30
+#define IK_LUT_STEP		4000		// grid spacing of the lookup tables
+#define IK_LUT_MIN		(4 * IK_LUT_STEP) // radius under which the tables are not used
+#define IK_MOVE_MAX_MS		600000		// longest straight line move, 10 min
+
+// Definitions for the calibration tables
+#define CAL_ANGLE_STEP		100		// angle to duty table spacing, in millidegrees
+#define CAL_ANGLE_MAX		360000		// angles of the whole duty range within +-1 turn
+#define CAL_DUTY_MARGIN		500		// points may lie this far outside the duty range, in us
+
+// Safety envelope
+#define ENV_CELL_SHIFT		3		// keep-out bitmap cells are 8 us of duty time square
+#define ENV_CELLS		128		// per joint, covers 1024 us of duty range
+#define ENV_PAIRS		3		// wrist-elbow, wrist-grip, elbow-grip
+#define ENV_PAIR(A,B)		((A) + (B) - 1)	// A < B
+
+// Position feedback
+#define FB_SAMPLES		3		// readings in the median filter
+#define FB_SETTLE_TICK		(PERIOD / 1000)	// ms between checks while waiting for the servos
+
+// Definitions for the telemetry
+#define TELEM_JITTER_AVG_SHIFT	4	// running average over ~16 pulses
 
 // Definitions for sequence
-#define TOT_SEQUENCE	4
+#define TOT_SEQUENCE	4	// waypoints recorded with keys 1-4
 #define TOT_MOTOR 	3
-#define TIME_STAGE	100 // in milliseconds
+#define ARM_MAX_ARMS	3	// minors of /dev/arm
+#define TIME_STAGE	ARM_SEQ_TICK_MS // in milliseconds
+#define SEQ_KEY_DWELL	(TIME_STAGE * 10) // dwell of waypoints recorded with the keys
+#define SEQ_MAX_CAPACITY	(1 << 20)
+#define SEQ_RATE_RAMP	100 // per mille per tick, the rate changes by 1x per second at most
+#define SEQ_CYCLE_AVG_SHIFT	3 // running average over ~8 loops
+
+// Definitions for the input recording
+#define INPUT_DRAIN_CHUNK	64	// events copied to user space at a time
 
 // Useful Macros
 #define MIN(X,Y) ((X) < (Y)) ? (X) : (Y)
 #define MAX(X,Y) ((X) > (Y)) ? (X) : (Y)
 #define SIGN(X)	 ((X) == 0) ? 0 : ((X) < 0 ? -1 : 1)
+#define CLAMP(X,LO,HI) ((X) < (LO) ? (LO) : ((X) > (HI) ? (HI) : (X)))
 
 
 // STRUCTS 
 // Servo struct
 struct servo{
-	int dutyTime;
+	const char *name;
+	struct arm *arm;
+	int index;	// in wrist, elbow, grip order
+	int channel;	// in the PWM scheduler, over all the arms
+	int line;	// GPIO or PWM channel, as the output backend takes it
+	struct pwm_device *pwm;
+	int minDutyTime;
+	int maxDutyTime;
+	struct servoCal __rcu *cal;	// duty time <-> angle tables
+	int dutyTime;		// in ns, like targetDutyTime and setpoint
 	int targetDutyTime;
-	struct timer_list timer;
+	int setpoint;		// last duty time asked for, reached at the envelope max velocity
+	ktime_t lastMove;
+	unsigned long nextPulse;	// jiffies, keeps the phase of the PWM period, under pwmLock
+	int idle;		// pulses stopped or slowed down, see idle_hold_ms, under pwmLock
+	int resting;		// the hardware pulses and there is nothing to move, under pwmLock
+	int outDuty;		// duty time and period in ns the hardware is to pulse at,
+	int outPeriod;		// 0 for no pulses, applied by outWork
+	struct work_struct outWork;
+	int velocityCmd;	// joystick velocity request in us/s
+	int velocity;		// rate limited velocity in us/s
+	ktime_t lastPulse;
+	struct arm_jitter jitter;
+	struct iio_channel *fb;	// potentiometer, NULL without feedback
+	unsigned long fbRetry;	// jiffies of the next lookup of the channel
+	int fbSamples[FB_SAMPLES];	// last readings, as duty times
+	int fbCount;
+	int fbDuty;		// measured duty time, -1 unknown
+	struct work_struct fbWork;
 };
 	 
 
+// Output backend, how the pulses get to the servos. Backends with a pulse
+// op are pulsed by the PWM scheduler every period. The others have hardware
+// that pulses by itself: the scheduler only passes on the duty time and
+// period when they change, through update, from a work item as it may
+// sleep, and visits the servos that have nothing to move once a second.
+struct armOutput {
+	const char *name;
+	int (*attach)(struct servo * servo_ptr);
+	void (*detach)(struct servo * servo_ptr);
+	void (*pulse)(struct servo * servo_ptr);
+	int (*update)(struct servo * servo_ptr, int dutyTime, int period);
+	const int *lines;	// module parameter with the lines of the servos, three per arm
+};
+
 // Struct for sequence
+// The waypoints live in a store allocated once at init. Uploads are
+// written to the spare store and swapped in, under sequenceLock.
 struct sequence {
 	int ACTIVE; //if it is active or not
 	int STAGE;  //what stage we are on now
 	int TOTAL;  //total number of stages assigned
-	int MOTOR_PWM[TOT_MOTOR][TOT_SEQUENCE];
+	int CAPACITY; //size of the stores
+	unsigned int GENERATION; //changes with every edit of the waypoints
+	struct arm_waypoint *WAYPOINTS;
+	struct arm_waypoint *SPARE;
+	u8 *PROGRAM; //programs are encoded and decoded here
+	size_t PROGRAM_SIZE;
 	int SAFETY[TOT_SEQUENCE];
+	int RATE; //playback rate, per mille
+	int RATE_TARGET; //rate requested, RATE ramps to it
+	int WAIT; //ms the timer was last set for
+	int DWELL; //sequence time left to wait at the waypoint reached, in us
+	ktime_t CYCLE_START; //last arrival at the first waypoint
+	ktime_t SETTLE_START; //the waypoint was commanded, waiting for the servos to get there
+	u32 SETTLE_MS;
+	u32 FB_TIMEOUTS;
+	unsigned int CYCLES;
+	u32 CYCLE_US;
+	u32 CYCLE_AVG_US;
+	u32 CYCLE_MIN_US;
+	u32 CYCLE_MAX_US;
+	struct arm_sync SYNC; //sync points with the sequences of the other arms
+	int BARRIER; //barrier to wait at once the dwell is over, -1 for none
+	unsigned int BARRIER_GEN; //generation of the barrier when the sequence got there
+	ktime_t BARRIER_START; //waiting at the barrier since
+	u32 BARRIER_MS;
+	unsigned long TICK; //jiffies the tick is due, the next ones count from it
+	int BLEND; //blend radius of the via points, us of duty time
+	int BLEND_LEN; //blend under way, 0 if none: ns of travel it takes
+	int BLEND_DONE; //and ns of it covered
+	int BLEND_FROM[TOT_MOTOR]; //quadratic curve in ns from where the blend started,
+	int BLEND_VIA[TOT_MOTOR]; //pulled towards the via point,
+	int BLEND_TO[TOT_MOTOR]; //to a point on the next segment
+	struct arm *ARM; //the arm playing it
 	struct timer_list sequenceTimer;
 };
 
+// Barrier between the sequences of the arms. members has a bit for every
+// arm whose running sequence has it, arrived for those waiting at it. The
+// last one to arrive clears arrived and bumps the generation, which is all
+// the others read while they wait.
+struct armBarrier {
+	unsigned long members;
+	unsigned long arrived;
+	unsigned int generation;
+	unsigned long releaseTick;	// tick of the sequence that released it
+};
+
+
+// Calibration of a servo. The piecewise linear points are expanded into
+// dense tables when loaded, so lookups in the PWM path take constant time:
+// angle[] holds the angle of every whole us of duty time from minDutyTime,
+// duty[] the duty time every CAL_ANGLE_STEP from angleMin.
+struct servoCal {
+	struct rcu_head rcu;
+	struct arm_calibration points;
+	s32 angleMin;
+	s32 angleMax;
+	int nAngle;
+	int nDuty;
+	s32 *angle;
+	s32 *duty;
+	s32 data[];
+};
+
+// Safety envelope. The keep-out zones of each pair of joints are expanded
+// into a bitmap of cells when the envelope is set, so checking a setpoint
+// takes two bit lookups. Replaced as a whole under RCU like the calibration.
+struct armEnvelope {
+	struct rcu_head rcu;
+	struct arm_envelope spec;
+	unsigned long keepout[ENV_PAIRS][BITS_TO_LONGS(ENV_CELLS * ENV_CELLS)];
+};
+
+// Per open file state of /dev/arm
+struct armReader {
+	struct arm *arm;		// the minor of the file
+	unsigned int generation;	// telemetry generation last read
+};
+
+// Straight line Cartesian move, re-solved every PWM period
+struct cartesianMove {
+	int ACTIVE;
+	struct arm_cartesian from;
+	struct arm_cartesian to;
+	unsigned long start;	// jiffies
+	struct timer_list timer;
+};
+
+// Lookup table over a 2D grid. Each entry holds the angle and magnitude of
+// the vector (u, v), sampled every IK_LUT_STEP um from (u0, v0).
+struct ikLutEntry {
+	s32 angle;
+	s32 mag;
+};
+
+struct ikLut {
+	int u0;
+	int v0;
+	int nu;
+	int nv;
+	struct ikLutEntry *entries;
+};
+
+// One arm: its servos, sequence, safety envelope and telemetry. The module
+// drives num_arms of them, all the servos from the one PWM scheduler.
+struct arm {
+	int id;		// minor of /dev/arm
+	struct servo *wristServo;
+	struct servo *elbowServo;
+	struct servo *gripServo;
+	struct sequence *sequence;
+	struct armEnvelope __rcu *envelope;
+	struct mutex envelopeMutex;
+	atomic_t envLimited;		// setpoints the envelope limited, from any timer
+	atomic_t envRefused;		// and refused
+	struct cartesianMove cartesian;
+	spinlock_t cartesianLock;
+	// The keyboard notifier runs with interrupts off, so the sequence lock is
+	// taken with spin_lock_irqsave. The mutex serialises uploads and downloads.
+	spinlock_t sequenceLock;
+	struct mutex sequenceMutex;
+	unsigned long activity;		// jiffies of the last command
+	int idleCount;			// servos idle, under pwmLock
+	struct input_handle *joystick;	// bound to this arm
+	// Telemetry: the generation changes with every setpoint or sequence change,
+	// readers only see it once it is published by the PWM scheduler
+	unsigned int telemGeneration;
+	unsigned int telemPublished;
+	unsigned long telemNextWake;
+	unsigned long telemNextStats;
+	wait_queue_head_t telemWait;
+};
+
 
 // General Prototypes
 static void arm_exit(void);
 static int __init arm_init(void);
+static struct arm * armInit(int id);
+static void armFree(struct arm * arm);
 
 // Key Interrupts Prototypes
 static int keys_pressed(struct notifier_block *, unsigned long, void *); // Callback function for the Notification Chain
+static void keyEvent(unsigned long action, unsigned int value, int down, unsigned int shift);
+static void keyMove(struct servo * servo_ptr, int step);
+
+// Input Recording Prototypes
+static void inputRecord(u16 type, u16 action, u32 code, s32 value, s32 aux);
+int inputRecordStart(void);
+void inputRecordStop(void);
+int inputDrain(struct arm_input_io *io);
+
+// Joystick Prototypes
+static bool joy_match(struct input_handler *handler, struct input_dev *dev);
+static int joy_connect(struct input_handler *handler, struct input_dev *dev, const struct input_device_id *id);
+static void joy_disconnect(struct input_handle *handle);
+static void joy_event(struct input_handle *handle, unsigned int type, unsigned int code, int value);
 
 // Servo Control Prototypes
-static void wristServoFunction(struct timer_list* mytimer);
-static void elbowServoFunction(struct timer_list* mytimer);
-static void gripServoFunction(struct timer_list* mytimer);
+static void pwmFunction(struct timer_list* mytimer);
+static void pwmArm(void);
+static void servoPulse(struct servo * servo_ptr);
+static struct servo * servoInit(struct arm * arm, const char *name, int index, int line, int minDutyTime, int maxDutyTime);
+static void servoFree(struct servo * servo_ptr);
+int setDutyTime(struct servo * servo_ptr, int dutyTime);
+static int servoDutyNs(struct servo * servo_ptr, s32 dutyTime);
+static struct servo * servoByIndex(struct arm * arm, unsigned int motor);
+static void servoIntegrate(struct servo * servo_ptr);
+static unsigned long servoPhase(struct servo * servo_ptr);
+static void servoSchedule(struct servo * servo_ptr);
+static int servoIdle(struct servo * servo_ptr);
+static int servoResting(struct servo * servo_ptr);
+static void servoKick(struct servo * servo_ptr);
+void armWake(struct arm * arm);
+
+// Output Backend Prototypes
+static const struct armOutput * outputByName(const char *name);
+static void outputChanged(struct servo * servo_ptr);
+static void outputFunction(struct work_struct *work);
+static int gpioAttach(struct servo * servo_ptr);
+static void gpioDetach(struct servo * servo_ptr);
+static void gpioPulse(struct servo * servo_ptr);
+static void pulseDelay(int duty);
+static int pwmAttach(struct servo * servo_ptr);
+static void pwmDetach(struct servo * servo_ptr);
+static int pwmUpdate(struct servo * servo_ptr, int dutyTime, int period);
+static int simUpdate(struct servo * servo_ptr, int dutyTime, int period);
+
+// Character device Prototypes
+static int arm_open(struct inode *inode, struct file *filp);
+static int arm_release(struct inode *inode, struct file *filp);
+static long arm_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+static ssize_t arm_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos);
+static __poll_t arm_poll(struct file *filp, poll_table *wait);
+
+// Telemetry Prototypes
+void telemetryChanged(struct arm * arm);
+static void telemetryPublish(struct arm * arm);
+static void telemetrySnapshot(struct arm * arm, struct arm_telemetry *telem);
+
+// Kinematics Prototypes
+static s32 cordicAtan2(s32 y, s32 x, s32 *mag);
+static void cordicSinCos(s32 angle, s32 scale, s32 *cosine, s32 *sine);
+static int ikLutBuild(struct ikLut *lut, int u0, int v0, int nu, int nv);
+static int ikLutLookup(const struct ikLut *lut, s32 u, s32 v, s32 *angle, s32 *mag);
+int ikSolve(struct arm * arm, const struct arm_cartesian *target, struct arm_joints *joints, s32 *reachError);
+void fkSolve(struct arm * arm, struct arm_pose *pose);
+int angleToDuty(struct servo * servo_ptr, s32 angle, int *dutyTime);
+s32 dutyToAngle(struct servo * servo_ptr, int dutyTime);
+int cartesianStart(struct arm * arm, const struct arm_cartesian *target);
+void cartesianStop(struct arm * arm);
+static void cartesianFun(struct timer_list* mytimer);
+
+// Calibration Prototypes
+static struct servoCal * calBuild(struct servo * servo_ptr, const struct arm_calibration *points);
+int calApply(struct servo * servo_ptr, const struct arm_calibration *points);
+void calDefault(struct servo * servo_ptr, int minAngle, int maxAngle);
+static void calLoadFile(void);
 
 // Sequence Prototypes
 static void sequenceFun(struct timer_list* mytimer);
-void unsetMotors(void);
-int safetyCheck(void);
+void unsetMotors(struct arm * arm);
+int safetyCheck(struct arm * arm);
 int atTargetDutyTime(struct servo * servo_ptr);
-void setTargetDutyTimes(unsigned int stage);
+void setTargetDutyTimes(struct arm * arm, unsigned int stage);
+static void sequenceSave(struct arm * arm, int slot);
+int sequenceStart(struct arm * arm);
+static int sequenceStartAt(struct arm * arm, unsigned long tick);
+int sequenceStartArms(u32 mask);
+static u32 syncArms(void);
+void sequenceStop(struct arm * arm);
+int sequenceUpload(struct arm * arm, const struct arm_sequence_io *io);
+int sequenceDownload(struct arm * arm, struct arm_sequence_io *io);
+static int sequenceCommit(struct arm * arm, unsigned int count, u32 flags);
+static int programDecode(const u8 *data, size_t size, struct arm_waypoint *waypoints, unsigned int capacity);
+static size_t programEncode(u8 *data, const struct arm_waypoint *waypoints, unsigned int count);
+int programUpload(struct arm * arm, const struct arm_seq_program *program);
+int programDownload(struct arm * arm, struct arm_seq_program *program);
+static void programLoadFile(struct arm * arm);
+static void sequenceRamp(struct arm * arm, int elapsed);
+static void sequenceArrived(struct arm * arm);
+static int sequenceSettled(struct arm * arm);
+static int sequenceBarrier(struct arm * arm);
+static int sequenceVia(struct arm * arm);
+static void sequenceBlendStart(struct arm * arm);
+static int sequenceBlendStep(struct arm * arm, int step);
+int sequenceSetBlend(struct arm * arm, u32 blend);
+int sequenceSetSync(struct arm * arm, const struct arm_sync *sync);
+static int syncBarrier(struct arm * arm, int stage);
+static void barrierJoin(struct arm * arm);
+static void barrierLeave(struct arm * arm);
+static void barrierRelease(struct armBarrier * barrier, unsigned long tick, int self);
+int sequenceSetRate(struct arm * arm, u32 rate);
+int sequenceSetDwell(struct arm * arm, const struct arm_seq_dwell *dwell);
+
+// Safety Envelope Prototypes
+static int envelopeMove(struct servo * servo_ptr);
+static int envelopeKeepout(struct arm * arm, const struct armEnvelope *env, int motor, int dutyTime);
+int envelopeCheckPose(struct arm * arm, const s32 *duty);
+static struct armEnvelope * envelopeBuild(struct arm * arm, const struct arm_envelope *spec);
+int envelopeApply(struct arm * arm, const struct arm_envelope *spec);
+void envelopeDefault(struct arm * arm);
+
+// Position Feedback Prototypes
+static void fbFunction(struct work_struct *work);
+static void fbRelease(struct servo * servo_ptr);
+static int fbToDuty(struct servo * servo_ptr, int value);
+static int fbArrived(struct servo * servo_ptr);
+int armPulseDuty(unsigned int motor);
 
 module_init(arm_init);
 module_exit(arm_exit);
 
-// GPIOS Array
-static struct gpio gpios[] = {
-	{WRIST_GPIO,	GPIOF_OUT_INIT_LOW,	"Wrist Servo" }, /* default to OFF */
-	{ELBOW_GPIO, 	GPIOF_OUT_INIT_LOW, "Elbow Servo" }, /* default to OFF */
-	{GRIP_GPIO, 	GPIOF_OUT_INIT_LOW, "Grip Servo" }, /* default to OFF */
-};
-
 // Initializing the notifier_block
 static struct notifier_block nb = {
 	.notifier_call = keys_pressed
 };
 
+// Any device reporting an X axis is a candidate joystick; joy_match filters out touchscreens
+static const struct input_device_id joy_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT | INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { BIT_MASK(ABS_X) },
+	},
+	{ },
+};
+
+// Initializing the joystick input handler
+static struct input_handler joy_handler = {
+	.event		= joy_event,
+	.match		= joy_match,
+	.connect	= joy_connect,
+	.disconnect	= joy_disconnect,
+	.name		= "arm_joystick",
+	.id_table	= joy_ids,
+};
+
+// Character device operations
+static const struct file_operations arm_fops = {
+	.owner		= THIS_MODULE,
+	.open		= arm_open,
+	.release	= arm_release,
+	.unlocked_ioctl	= arm_ioctl,
+	.read		= arm_read,
+	.poll		= arm_poll,
+	.llseek		= no_llseek,
+};
+
+// Arms driven by the module, /dev/arm minor N is arm N. Their servos are on
+// arm_gpios, three per arm in wrist, elbow, grip order.
+static int num_arms = 1;
+static int arm_gpios[ARM_MAX_ARMS * TOT_MOTOR] = { WRIST_GPIO, ELBOW_GPIO, GRIP_GPIO, -1, -1, -1, -1, -1, -1 };
+static int arm_gpios_cnt;
+module_param(num_arms, int, S_IRUGO);
+module_param_array(arm_gpios, int, &arm_gpios_cnt, S_IRUGO);
+MODULE_PARM_DESC(num_arms, "Number of arms (1-3)");
+MODULE_PARM_DESC(arm_gpios, "GPIOs of the servos, wrist,elbow,grip of each arm in turn");
+
+// Duty time an arrow or grip key moves a servo by, finer than a us if need be
+static int key_step_ns = 50000;
+module_param(key_step_ns, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(key_step_ns, "Duty time a jog key moves a servo by (ns)");
+
+// Output backend: gpio pulses arm_gpios from the CPU, pwm hands the pulses
+// to the PWM channels arm_pwms (the eHRPWMs) and sim only traces them, for
+// testing without the servos
+static char *output = "gpio";
+static int arm_pwms[ARM_MAX_ARMS * TOT_MOTOR] = { -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+static int arm_pwms_cnt;
+module_param(output, charp, S_IRUGO);
+module_param_array(arm_pwms, int, &arm_pwms_cnt, S_IRUGO);
+MODULE_PARM_DESC(output, "Output backend of the servos: gpio, pwm or sim");
+MODULE_PARM_DESC(arm_pwms, "PWM channels of the servos for output=pwm, wrist,elbow,grip of each arm in turn");
+
+// Joystick tuning
+static unsigned int joy_deadzone = 80;		// per mille of full deflection
+static unsigned int joy_max_rate = 700;		// us of duty time per second at full deflection
+static unsigned int joy_max_accel = 3500;	// us/s per second
+module_param(joy_deadzone, uint, S_IRUGO | S_IWUSR);
+module_param(joy_max_rate, uint, S_IRUGO | S_IWUSR);
+module_param(joy_max_accel, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(joy_deadzone, "Joystick deadzone in per mille of full deflection");
+MODULE_PARM_DESC(joy_max_rate, "Joint velocity at full deflection (us of duty time per second)");
+MODULE_PARM_DESC(joy_max_accel, "Joint acceleration limit (us/s per second)");
+
+// Arm geometry and linear calibration, in the order wrist, elbow, grip.
+// The elbow servo turns the arm about the base (yaw), the wrist servo
+// raises it (pitch) and the grip sits at the end of a single link.
+static int ik_link_um = 120000;		// pivot to grip
+static int ik_base_um = 60000;		// table to pivot
+static int ik_reach_tol_um = 5000;	// how far off the reachable shell a target may be
+static bool ik_lut = 1;			// use the lookup tables where they cover the target
+static int cal_min_angle[TOT_MOTOR] = { 0, -90000, 0 };
+static int cal_max_angle[TOT_MOTOR] = { 90000, 90000, 90000 };
+static int cal_min_angle_cnt, cal_max_angle_cnt;
+module_param(ik_link_um, int, S_IRUGO);
+module_param(ik_base_um, int, S_IRUGO);
+module_param(ik_reach_tol_um, int, S_IRUGO | S_IWUSR);
+module_param(ik_lut, bool, S_IRUGO | S_IWUSR);
+module_param_array(cal_min_angle, int, &cal_min_angle_cnt, S_IRUGO);
+module_param_array(cal_max_angle, int, &cal_max_angle_cnt, S_IRUGO);
+MODULE_PARM_DESC(ik_link_um, "Length of the arm from the wrist pivot to the grip (um)");
+MODULE_PARM_DESC(ik_base_um, "Height of the wrist pivot above the base (um)");
+MODULE_PARM_DESC(ik_reach_tol_um, "Tolerance on the reach of Cartesian targets (um)");
+MODULE_PARM_DESC(ik_lut, "Solve inverse kinematics from the precomputed tables");
+MODULE_PARM_DESC(cal_min_angle, "Joint angle at the minimum duty time, wrist,elbow,grip (mdeg), used without a calibration file");
+MODULE_PARM_DESC(cal_max_angle, "Joint angle at the maximum duty time, wrist,elbow,grip (mdeg), used without a calibration file");
+
+// Telemetry readers are woken at most this often
+static unsigned int telem_interval_ms = 20;
+module_param(telem_interval_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(telem_interval_ms, "Minimum time between telemetry wakeups (ms)");
+
+// Waypoints the sequence store holds
+static int seq_capacity = 4096;
+module_param(seq_capacity, int, S_IRUGO);
+MODULE_PARM_DESC(seq_capacity, "Maximum number of waypoints in a sequence");
+
+// Playback rate the sequence starts with, per mille
+static int seq_rate = ARM_SEQ_RATE_NOMINAL;
+module_param(seq_rate, int, S_IRUGO);
+MODULE_PARM_DESC(seq_rate, "Initial playback rate of sequences (per mille, 100-4000)");
+
+// Via points are passed within this radius instead of stopped at
+static int seq_blend_us = 0;
+module_param(seq_blend_us, int, S_IRUGO);
+MODULE_PARM_DESC(seq_blend_us, "Blend radius of the via points of sequences (us of duty time, 0 for none)");
+
+// Room for input events between two drains of a recording
+static int rec_events = 8192;
+module_param(rec_events, int, S_IRUGO);
+MODULE_PARM_DESC(rec_events, "Events the input recording holds (0 disables recording)");
+
+// Sequence program in /lib/firmware, written by armseq
+static char *seq_file = ARM_SEQ_FIRMWARE;
+module_param(seq_file, charp, S_IRUGO);
+MODULE_PARM_DESC(seq_file, "Sequence program loaded at init");
+MODULE_FIRMWARE(ARM_SEQ_FIRMWARE);
+
+// Calibration file in /lib/firmware, written by armcal
+static char *cal_file = ARM_CAL_FIRMWARE;
+module_param(cal_file, charp, S_IRUGO);
+MODULE_PARM_DESC(cal_file, "Calibration tables loaded at init");
+MODULE_FIRMWARE(ARM_CAL_FIRMWARE);
+
+// Power. The servos start one after the other, and the periods of all the
+// servos of all the arms are spread evenly over PERIOD (PERIOD / (3 * num_arms)
+// apart, see servoPhase), so their current peaks do not add up.
+static int pwm_stagger_ms = 250;
+module_param(pwm_stagger_ms, int, S_IRUGO);
+MODULE_PARM_DESC(pwm_stagger_ms, "Delay between the start of the servos (ms)");
+
+// Idle servos hold their position with fewer pulses, or none
+static int idle_hold_ms = 0;
+static int idle_period_ms = 0;
+module_param(idle_hold_ms, int, S_IRUGO | S_IWUSR);
+module_param(idle_period_ms, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(idle_hold_ms, "Time without commands before the servos go idle (ms, 0 never)");
+MODULE_PARM_DESC(idle_period_ms, "Pulse period of idle servos (ms, 0 stops the pulses)");
+
+// Velocity limit of the default safety envelope
+static int env_max_velocity = 0;
+module_param(env_max_velocity, int, S_IRUGO);
+MODULE_PARM_DESC(env_max_velocity, "Maximum joint velocity (us of duty time per second, 0 for no limit)");
+
+// Position feedback from the servo potentiometers, read through IIO. The
+// channels are looked up by the consumer channel names wrist, elbow and grip,
+// fb_min and fb_max are their readings at the ends of the duty range.
+static bool fb_enable = 0;
+static int fb_min[TOT_MOTOR] = { 0, 0, 0 };
+static int fb_max[TOT_MOTOR] = { 1800, 1800, 1800 };	// mV, the AM335x ADC range
+static int fb_min_cnt, fb_max_cnt;
+static int fb_tolerance_us = 15;
+static int fb_timeout_ms = 1000;
+module_param(fb_enable, bool, S_IRUGO | S_IWUSR);
+module_param_array(fb_min, int, &fb_min_cnt, S_IRUGO);
+module_param_array(fb_max, int, &fb_max_cnt, S_IRUGO);
+module_param(fb_tolerance_us, int, S_IRUGO | S_IWUSR);
+module_param(fb_timeout_ms, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(fb_enable, "Advance sequences when the servos are measured at the waypoints");
+MODULE_PARM_DESC(fb_min, "Feedback reading at the minimum duty time, wrist,elbow,grip");
+MODULE_PARM_DESC(fb_max, "Feedback reading at the maximum duty time, wrist,elbow,grip");
+MODULE_PARM_DESC(fb_tolerance_us, "How close to a waypoint a servo must be measured (us of duty time)");
+MODULE_PARM_DESC(fb_timeout_ms, "Longest wait for the servos at a waypoint before going on (ms)");
+
+// atan(2^-i) in microdegrees
+static const s32 cordicAngles[IK_CORDIC_ITER] = {
+	45000000, 26565051, 14036243, 7125016, 3576334, 1789911, 895174, 447614, 223811, 111906,
+	55953, 27976, 13988, 6994, 3497, 1749, 874, 437, 219, 109
+};
+
 
 // Operation mode enum
 enum SERVO {
@@ -140,59 +656,151 @@ enum SERVO {
 
 
 
-struct sequence * globalSequence = NULL;
-struct servo * wristServo = NULL;
-struct servo * elbowServo = NULL;
-struct servo * gripServo = NULL;
+static struct arm * arms[ARM_MAX_ARMS];
+static int keyArm = 0;		// driven by the keyboard
+
+// PWM scheduler. One timer for the servos of all the arms, due at the
+// earliest next pulse. The servos re-arm it under pwmLock, so a wakeup
+// cannot race with a servo going idle.
+static struct servo * pwmServos[ARM_MAX_ARMS * TOT_MOTOR];
+static int pwmCount = 0;
+static struct timer_list pwmTimer;
+static DEFINE_SPINLOCK(pwmLock);
+
+static const struct armOutput outputs[] = {
+	{ .name = "gpio", .attach = gpioAttach, .detach = gpioDetach, .pulse = gpioPulse, .lines = arm_gpios },
+	{ .name = "pwm", .attach = pwmAttach, .detach = pwmDetach, .update = pwmUpdate, .lines = arm_pwms },
+	{ .name = "sim", .update = simUpdate },
+};
+static const struct armOutput *armOutput;
+
+// Barriers of the sequences, taken under the sequenceLock of an arm
+static struct armBarrier barriers[ARM_SYNC_BARRIERS];
+static DEFINE_SPINLOCK(barrierLock);
+
+// Input recording, a ring of rec_events events from head to tail. The
+// keyboard notifier adds to it with interrupts off, ARM_IOC_GET_RECORDING
+// drains it.
+static struct arm_input_event *recEvents = NULL;
+static unsigned int recHead, recTail, recLost;
+static int recActive = 0;
+static struct arm_input_start recStart;
+static DEFINE_SPINLOCK(recLock);
+
+// Calibration updates, one at a time
+static DEFINE_MUTEX(calMutex);
+
+static const char * const fbChannels[TOT_MOTOR] = { "wrist", "elbow", "grip" };
+
 int setServos = 0;
+static int joyRegistered = 0;
+static int keyboardRegistered = 0;
+static int chrdevRegistered = 0;
+
+// Lookup tables: yaw over (x, y) and pitch over (rho, z)
+static struct ikLut yawLut;
+static struct ikLut pitchLut;
 
 // Init module
 static int __init arm_init(void){
 
-	int err;
+	unsigned long flags;
+	int err, i;
 
-	// Keyboard Interrupts init
-	printk(KERN_ALERT "Keylogger loaded\n");
-	register_keyboard_notifier(&nb);
+	timer_setup(&pwmTimer, pwmFunction, 0);
+
+	// Feedback channels are looked up once the servos pulse, their provider may come later
+	for(i = 0; i < TOT_MOTOR; i++) {
+		if(fb_min[i] == fb_max[i]) {
+			printk(KERN_ALERT "Invalid feedback range of %s, feedback disabled\n", fbChannels[i]);
+			fb_enable = 0;
+		}
+	}
+
+	armOutput = outputByName(output);
+	if(!armOutput) {
+		printk(KERN_ALERT "Unknown output backend %s\n", output);
+		goto fail;
+	}
+
+	// Arms init, each with its servos, envelope and sequence store
+	if(num_arms < 1 || num_arms > ARM_MAX_ARMS) {
+		printk(KERN_ALERT "Invalid number of arms %d\n", num_arms);
+		goto fail;
+	}
+	if(seq_capacity < TOT_SEQUENCE || seq_capacity > SEQ_MAX_CAPACITY) {
+		printk(KERN_ALERT "Invalid sequence capacity %d\n", seq_capacity);
+		goto fail;
+	}
+	for(i = 0; i < num_arms; i++) {
+		arms[i] = armInit(i);
+		if(!arms[i])
+			goto fail;
+	}
+	calLoadFile();
+	programLoadFile(arms[0]);
+
+	// Input recording, allocated once so the keyboard notifier never allocates
+	if(rec_events > 0) {
+		recEvents = vmalloc(rec_events * sizeof(struct arm_input_event));
+		if(!recEvents)
+			printk(KERN_ALERT "Could not allocate input recording, recording disabled\n");
+	}
 
+	// starting the PWM, the servos staggered to spread the inrush current
+	spin_lock_irqsave(&pwmLock, flags);
+	for(i = 0; i < pwmCount; i++)
+		pwmServos[i]->nextPulse = jiffies + msecs_to_jiffies(1000 + i * pwm_stagger_ms) + servoPhase(pwmServos[i]);
+	pwmArm();
+	spin_unlock_irqrestore(&pwmLock, flags);
 #if DEBUG
-	printk(KERN_ALERT "Keylogger initialization successfull\n");
+	printk(KERN_ALERT "Servo initialization successfull\n");
 #endif
 
-	// Servo init
+	// Kinematics init, the tables span a little more than the reach of the arm
+	if(ik_link_um <= 0 || ik_link_um > IK_MAX_UM / 2) {
+		printk(KERN_ALERT "Invalid arm length %d um\n", ik_link_um);
+		goto fail;
+	}
+	if(ik_lut) {
+		int span = DIV_ROUND_UP(ik_link_um + ik_link_um / 4, IK_LUT_STEP);
+
+		if(ikLutBuild(&yawLut, -span * IK_LUT_STEP, -span * IK_LUT_STEP, 2 * span + 1, 2 * span + 1) ||
+		   ikLutBuild(&pitchLut, 0, -span * IK_LUT_STEP, span + 1, 2 * span + 1)) {
+			printk(KERN_ALERT "Could not allocate IK tables, solving directly\n");
+			ik_lut = 0;
+		}
+	}
+
+	// Character device for the Cartesian interface, minor N is arm N
+	err = register_chrdev(ARM_MAJOR, "arm", &arm_fops);
+	if(err < 0) {
+		printk(KERN_ALERT "arm: cannot obtain major number %d\n", ARM_MAJOR);
+		goto fail;
+	}
+	chrdevRegistered = 1;
+
+	// The inputs last, once the arms they drive are set up.
+	// Joystick init, devices are bound as they appear
+	err = input_register_handler(&joy_handler);
+	if(err) {
+		printk(KERN_ALERT "Could not register joystick handler\n");
+		goto fail;
+	}
+	joyRegistered = 1;
 
-	// Request GPIO lines
-	err = gpio_request_array(gpios, ARRAY_SIZE(gpios));
+	// Keyboard Interrupts init
+	printk(KERN_ALERT "Keylogger loaded\n");
+	err = register_keyboard_notifier(&nb);
 	if(err) {
-		printk(KERN_ALERT "Could not request GPIOs\n"); 
-		goto fail; 
+		printk(KERN_ALERT "Could not register keyboard notifier\n");
+		goto fail;
 	}
-	wristServo = (struct servo*) kmalloc(sizeof(struct servo*), GFP_KERNEL);
-	elbowServo = (struct servo*) kmalloc(sizeof(struct servo*), GFP_KERNEL);
-	gripServo  = (struct servo*) kmalloc(sizeof(struct servo*), GFP_KERNEL);
-	
-	wristServo->dutyTime = HS422_MIN_DUTYCYCLE;
-	elbowServo->dutyTime = HS422_MIN_DUTYCYCLE;	
-	gripServo->dutyTime = SG90_MIN_DUTYCYCLE;
-	
-	// timer setup
-	timer_setup(&(wristServo->timer), wristServoFunction, 0);
-	timer_setup(&(elbowServo->timer), elbowServoFunction, 0);
-	timer_setup(&(gripServo->timer), gripServoFunction, 0);
-
-	// starting timer
-	mod_timer(&(wristServo->timer), jiffies+ msecs_to_jiffies(1000));
-	mod_timer(&(elbowServo->timer), jiffies+ msecs_to_jiffies(1000));
-	mod_timer(&(gripServo->timer), jiffies+ msecs_to_jiffies(1000));
+	keyboardRegistered = 1;
+
 #if DEBUG
-	printk(KERN_ALERT "Servo initialization successfull\n");
+	printk(KERN_ALERT "Keylogger initialization successfull\n");
 #endif
-
-	globalSequence = (struct sequence*) kmalloc(sizeof(struct sequence*), GFP_KERNEL);
-	globalSequence->TOTAL = 0;
-	unsetMotors();
-	// timer setup
-	timer_setup(&(globalSequence->sequenceTimer), sequenceFun, 0);
 	
 	return 0;
 	
@@ -205,33 +813,161 @@ fail:
 
 //Exit module
 static void arm_exit(void){
+	int i;
 	
 	// removing all the keyboard logger resources
-	unregister_keyboard_notifier(&nb);
-	gpio_free_array(gpios, ARRAY_SIZE(gpios));
+	if(keyboardRegistered) {
+		unregister_keyboard_notifier(&nb);
+		keyboardRegistered = 0;
+	}
+	if(joyRegistered) {
+		input_unregister_handler(&joy_handler);
+		joyRegistered = 0;
+	}
+	if(chrdevRegistered) {
+		unregister_chrdev(ARM_MAJOR, "arm");
+		chrdevRegistered = 0;
+	}
 
-	if(wristServo) {
-		del_timer(&(wristServo->timer));
-		kfree(wristServo);
+	// The sequences and moves set the servos and wake the scheduler, stop them first.
+	// A sequence at a barrier can bring the timers of the others forward, so
+	// they all leave the barriers before any timer is deleted.
+	for(i = 0; i < ARM_MAX_ARMS; i++) {
+		if(arms[i] && arms[i]->sequence)
+			sequenceStop(arms[i]);
+	}
+	for(i = 0; i < ARM_MAX_ARMS; i++) {
+		if(!arms[i])
+			continue;
+		del_timer_sync(&(arms[i]->cartesian.timer));
+		if(arms[i]->sequence)
+			del_timer_sync(&(arms[i]->sequence->sequenceTimer));
 	}
+	del_timer_sync(&pwmTimer);
 
-	if(elbowServo) {
-		del_timer(&(elbowServo->timer));
-		kfree(elbowServo);
+	for(i = 0; i < ARM_MAX_ARMS; i++) {
+		armFree(arms[i]);
+		arms[i] = NULL;
 	}
+	pwmCount = 0;
+
+	vfree(yawLut.entries);
+	vfree(pitchLut.entries);
+	vfree(recEvents);
+	recEvents = NULL;
+	yawLut.entries = NULL;
+	pitchLut.entries = NULL;
+
+	printk(KERN_ALERT "Arm exit successfull\n");
+}
 
-	if(gripServo) {
-		del_timer(&(gripServo->timer));
-		kfree(gripServo);
+// Allocates an arm with its servos on its lines of arm_gpios or arm_pwms, the default
+// envelope and an empty sequence store. Returns NULL if anything is
+// missing, after freeing what was set up.
+static struct arm * armInit(int id){
+	int line[TOT_MOTOR] = { -1, -1, -1 };
+	struct arm * arm;
+
+	arm = (struct arm*) kzalloc(sizeof(struct arm), GFP_KERNEL);
+	if(!arm) {
+		printk(KERN_ALERT "Could not allocate arm %d\n", id);
+		return NULL;
 	}
-	
-	if(globalSequence){
-		del_timer(&(globalSequence->sequenceTimer));
-		kfree(globalSequence);
+	arm->id = id;
+	arm->activity = jiffies;
+	arm->telemGeneration = 1;
+	mutex_init(&arm->envelopeMutex);
+	atomic_set(&arm->envLimited, 0);
+	atomic_set(&arm->envRefused, 0);
+	spin_lock_init(&arm->cartesianLock);
+	spin_lock_init(&arm->sequenceLock);
+	mutex_init(&arm->sequenceMutex);
+	init_waitqueue_head(&arm->telemWait);
+	timer_setup(&(arm->cartesian.timer), cartesianFun, 0);
+
+	// Servo init, on the GPIO or PWM lines of this arm
+	if(armOutput->lines)
+		memcpy(line, &armOutput->lines[id * TOT_MOTOR], sizeof(line));
+	arm->wristServo = servoInit(arm, "WRIST", WRIST, line[WRIST], HS422_MIN_DUTYCYCLE, HS422_MAX_DUTYCYCLE);
+	arm->elbowServo = servoInit(arm, "ELBOW", ELBOW, line[ELBOW], HS422_MIN_DUTYCYCLE, HS422_MAX_DUTYCYCLE);
+	arm->gripServo  = servoInit(arm, "GRIP", GRIP, line[GRIP], SG90_MIN_DUTYCYCLE, SG90_MAX_DUTYCYCLE);
+	if(!arm->wristServo || !arm->elbowServo || !arm->gripServo) {
+		printk(KERN_ALERT "Could not set up the servos of arm %d\n", id);
+		goto fail;
 	}
-	
 
-	printk(KERN_ALERT "Arm exit successfull\n");
+	// Linear calibration from the module parameters, the calibration file goes on top
+	calDefault(arm->wristServo, cal_min_angle[WRIST], cal_max_angle[WRIST]);
+	calDefault(arm->elbowServo, cal_min_angle[ELBOW], cal_max_angle[ELBOW]);
+	calDefault(arm->gripServo, cal_min_angle[GRIP], cal_max_angle[GRIP]);
+	if(!arm->wristServo->cal || !arm->elbowServo->cal || !arm->gripServo->cal) {
+		printk(KERN_ALERT "Could not allocate calibration tables\n");
+		goto fail;
+	}
+
+	// Safety envelope over the whole duty range until one is set
+	envelopeDefault(arm);
+	if(!rcu_access_pointer(arm->envelope)) {
+		printk(KERN_ALERT "Could not allocate safety envelope\n");
+		goto fail;
+	}
+
+	arm->sequence = (struct sequence*) kzalloc(sizeof(struct sequence), GFP_KERNEL);
+	if(!arm->sequence) {
+		printk(KERN_ALERT "Could not allocate sequence\n");
+		goto fail;
+	}
+	arm->sequence->ARM = arm;
+	arm->sequence->TOTAL = 0;
+	arm->sequence->BARRIER = -1;
+	arm->sequence->RATE = CLAMP(seq_rate, ARM_SEQ_RATE_MIN, ARM_SEQ_RATE_MAX);
+	arm->sequence->RATE_TARGET = arm->sequence->RATE;
+	arm->sequence->BLEND = CLAMP(seq_blend_us, 0, ARM_SEQ_MAX_BLEND_US);
+	unsetMotors(arm);
+	// timer setup
+	timer_setup(&(arm->sequence->sequenceTimer), sequenceFun, 0);
+
+	// Sequence store, allocated once so uploads never allocate
+	arm->sequence->CAPACITY = seq_capacity;
+	arm->sequence->WAYPOINTS = vzalloc(seq_capacity * sizeof(struct arm_waypoint));
+	arm->sequence->SPARE = vzalloc(seq_capacity * sizeof(struct arm_waypoint));
+	if(!arm->sequence->WAYPOINTS || !arm->sequence->SPARE) {
+		printk(KERN_ALERT "Could not allocate sequence store\n");
+		goto fail;
+	}
+	arm->sequence->PROGRAM_SIZE = ARM_SEQ_PROGRAM_MAX(seq_capacity);
+	arm->sequence->PROGRAM = vmalloc(arm->sequence->PROGRAM_SIZE);
+	if(!arm->sequence->PROGRAM) {
+		printk(KERN_ALERT "Could not allocate program buffer\n");
+		goto fail;
+	}
+
+	return arm;
+
+fail:
+	armFree(arm);
+	return NULL;
+}
+
+// Frees an arm. Its servos must not be pulsing any more.
+static void armFree(struct arm * arm){
+	if(!arm)
+		return;
+
+	del_timer_sync(&(arm->cartesian.timer));
+	if(arm->sequence){
+		del_timer_sync(&(arm->sequence->sequenceTimer));
+		vfree(arm->sequence->WAYPOINTS);
+		vfree(arm->sequence->SPARE);
+		vfree(arm->sequence->PROGRAM);
+		kfree(arm->sequence);
+	}
+
+	servoFree(arm->wristServo);
+	servoFree(arm->elbowServo);
+	servoFree(arm->gripServo);
+	kfree(rcu_access_pointer(arm->envelope));
+	kfree(arm);
 }
 
 
@@ -239,259 +975,2735 @@ static void arm_exit(void){
 // Keyboard interrupt main function
 static int keys_pressed(struct notifier_block *nb, unsigned long action, void *data) {
 	struct keyboard_notifier_param *param = data;
-	
+
+	keyEvent(action, param->value, param->down, param->shift);
+	return NOTIFY_OK; // We return NOTIFY_OK, as "Notification was processed correctly"
+}
+
+// A keyboard event, from the notifier or replayed with ARM_IOC_INPUT_KEY.
+// The recording gets every event, whether it is acted on or not.
+static void keyEvent(unsigned long action, unsigned int value, int down, unsigned int shift){
+	struct arm * arm;
+	int step = READ_ONCE(key_step_ns);
+
+	inputRecord(ARM_INPUT_KEY, action, value, down, shift);
+
 	// We are only interested in certain keys
-	if (action == KBD_KEYSYM && param->down && param->shift == 0) {
-
-		if(param->value == KEY_UP) {
-			#if DEBUG
-			printk(KERN_ALERT "UP\n");
-			#endif
-			wristServo->dutyTime += PWM_STEP;
-			wristServo->dutyTime = MIN(HS422_MAX_DUTYCYCLE, wristServo->dutyTime);
-
-		} else if(param->value == KEY_DOWN) {
-			#if DEBUG
-			printk(KERN_ALERT "DOWN\n");
-			#endif
-
-			wristServo->dutyTime -= PWM_STEP;
-			wristServo->dutyTime = MAX(HS422_MIN_DUTYCYCLE, wristServo->dutyTime);
-
-		} else if(param->value == KEY_LEFT) {
-			#if DEBUG
-			printk(KERN_ALERT "LEFT\n");
-			#endif
-
-			elbowServo->dutyTime -= PWM_STEP;
-			elbowServo->dutyTime = MAX(HS422_MIN_DUTYCYCLE, elbowServo->dutyTime);
-
-		} else if(param->value == KEY_RIGHT) {
-			#if DEBUG
-			printk(KERN_ALERT "RIGHT\n");
-			#endif
-			
-			elbowServo->dutyTime += PWM_STEP;
-			elbowServo->dutyTime = MIN(HS422_MAX_DUTYCYCLE, elbowServo->dutyTime);
-
-
-		}  else if(param->value == KEY_GRIP) {
-			#if DEBUG
-			printk(KERN_ALERT "GRIP\n");
-			#endif
-
-			gripServo->dutyTime -= PWM_STEP;
-			gripServo->dutyTime = MIN(SG90_MAX_DUTYCYCLE, gripServo->dutyTime);
-		} else if(param->value == KEY_UNGRIP) {
-			#if DEBUG
-			printk(KERN_ALERT "UNGRIP\n");
-			#endif
-
-			gripServo->dutyTime += PWM_STEP;
-			gripServo->dutyTime = MAX(SG90_MIN_DUTYCYCLE, gripServo->dutyTime);
-		} else if(param->value == KEY_1) {
-			#if DEBUG
-			printk(KERN_ALERT "Saved state 1\n");
-			#endif
-			
-			globalSequence->TOTAL = MAX(1, globalSequence->TOTAL);
-			globalSequence->MOTOR_PWM[WRIST][0] = wristServo->dutyTime;
-			globalSequence->MOTOR_PWM[ELBOW][0] = elbowServo->dutyTime;
-			globalSequence->MOTOR_PWM[GRIP][0] = gripServo->dutyTime;
-			globalSequence->SAFETY[0] = 1;			
-
-		} else if(param->value == KEY_2) {
-			#if DEBUG
-			printk(KERN_ALERT "Saved state 2\n");
-			#endif
-			
-			globalSequence->TOTAL = MAX(2, globalSequence->TOTAL);
-			globalSequence->MOTOR_PWM[WRIST][1] = wristServo->dutyTime;
-			globalSequence->MOTOR_PWM[ELBOW][1] = elbowServo->dutyTime;
-			globalSequence->MOTOR_PWM[GRIP][1] = gripServo->dutyTime;
-			globalSequence->SAFETY[1] = 1;
-
-
-		} else if(param->value == KEY_3) {
-			#if DEBUG
-			printk(KERN_ALERT "Saved state 3\n");
-			#endif
-
-			globalSequence->TOTAL = MAX(3, globalSequence->TOTAL);
-			globalSequence->MOTOR_PWM[WRIST][2] = wristServo->dutyTime;
-			globalSequence->MOTOR_PWM[ELBOW][2] = elbowServo->dutyTime;
-			globalSequence->MOTOR_PWM[GRIP][2] = gripServo->dutyTime;
-			globalSequence->SAFETY[2] = 1;
-			
-			//globalSequence->TOTAL = (globalSequence->TOTAL < 3) ? 3 : globalSequence->TOTAL;
-
-		} else if(param->value == KEY_4) {
-			#if DEBUG
-			printk(KERN_ALERT "Saved state 4\n");
-			#endif
-
-			globalSequence->TOTAL = 4;
-			globalSequence->MOTOR_PWM[WRIST][3] = wristServo->dutyTime;
-			globalSequence->MOTOR_PWM[ELBOW][3] = elbowServo->dutyTime;
-			globalSequence->MOTOR_PWM[GRIP][3] = gripServo->dutyTime;
-			globalSequence->SAFETY[3] = 1;
-
-
-		}else if(param->value == KEY_ENTER) {
-			int err;
+	if (action == KBD_KEYSYM && down && shift == 0) {
+		trace_arm_key(value);
+
+		// F1-F3 hand the keyboard to another arm
+		if(value >= KEY_F1 && value < KEY_F1 + num_arms) {
+			keyArm = value - KEY_F1;
+			printk(KERN_INFO "Keyboard drives arm %d\n", keyArm);
+			return;
+		}
+		arm = arms[keyArm];
 
-			#if DEBUG
-			printk(KERN_ALERT "Starting sequence of moves\n");
-			#endif
-			
-			// do a safety check
-			err = safetyCheck();
-			if(err == 0){
-				globalSequence->ACTIVE = 1;
-				globalSequence->STAGE = 0;
-				setTargetDutyTimes(0);
-				mod_timer(&(globalSequence->sequenceTimer), jiffies+ msecs_to_jiffies(TIME_STAGE));
-			}else{
-				globalSequence->ACTIVE = 0;
-				#if DEBUG
-					printk(KERN_ALERT "Stages not set properly\n");
-				#endif
-			}
+		if(value == KEY_UP) {
+			keyMove(arm->wristServo, step);
+
+		} else if(value == KEY_DOWN) {
+			keyMove(arm->wristServo, -step);
+
+		} else if(value == KEY_LEFT) {
+			keyMove(arm->elbowServo, -step);
+
+		} else if(value == KEY_RIGHT) {
+			keyMove(arm->elbowServo, step);
+
+		}  else if(value == KEY_GRIP) {
+			keyMove(arm->gripServo, -step);
 
-		} else if(param->value == KEY_ESC) {
-			#if DEBUG
-			printk(KERN_ALERT "Stopping sequence\n");
-			#endif
+		} else if(value == KEY_UNGRIP) {
+			keyMove(arm->gripServo, step);
 
-			globalSequence->ACTIVE = 0;
-			globalSequence->TOTAL = 0;
-			unsetMotors();
-			mod_timer(&(globalSequence->sequenceTimer), jiffies+ msecs_to_jiffies(0));
+		} else if(value == KEY_1) {
+			sequenceSave(arm, 0);
+
+		} else if(value == KEY_2) {
+			sequenceSave(arm, 1);
+
+		} else if(value == KEY_3) {
+			sequenceSave(arm, 2);
+
+		} else if(value == KEY_4) {
+			sequenceSave(arm, 3);
+
+		}else if(value == KEY_ENTER) {
+			int err;
+
+			// do a safety check, the arms with sync points start together
+			if(arm->sequence->SYNC.count)
+				err = sequenceStartArms(syncArms());
+			else
+				err = sequenceStart(arm);
+			if(err)
+				printk(KERN_ALERT "Stages not set properly\n");
+
+		} else if(value == KEY_ESC) {
+			unsigned long flags;
+
+			trace_arm_seq_run(arm->id, 0, 0, arm->sequence->RATE);
+			spin_lock_irqsave(&arm->sequenceLock, flags);
+			arm->sequence->ACTIVE = 0;
+			barrierLeave(arm);
+			arm->sequence->TOTAL = 0;
+			arm->sequence->GENERATION++;
+			unsetMotors(arm);
+			spin_unlock_irqrestore(&arm->sequenceLock, flags);
+			cartesianStop(arm);
+			mod_timer(&(arm->sequence->sequenceTimer), jiffies+ msecs_to_jiffies(0));
 		}
+
+		// Saved waypoints and sequence changes show up in the telemetry
+		telemetryChanged(arm);
 	}
-	return NOTIFY_OK; // We return NOTIFY_OK, as "Notification was processed correctly"
 }
 
+// A jog key moves a servo a step. The duty time it got to is recorded with
+// the key, that is what a replay is compared on.
+static void keyMove(struct servo * servo_ptr, int step){
+	int err;
+
+	err = setDutyTime(servo_ptr, servo_ptr->dutyTime + step);
+	inputRecord(ARM_INPUT_SETPOINT, 0, servo_ptr->channel, servo_ptr->dutyTime, err);
+}
 
-// wristServo control
-static void wristServoFunction(struct timer_list* timer){
-	
-	gpio_set_value(WRIST_GPIO, 1);
-	udelay(wristServo->dutyTime);
-	gpio_set_value(WRIST_GPIO, 0);
 
+// Allocates a servo on its GPIO line and adds it to the PWM scheduler
+static struct servo * servoInit(struct arm * arm, const char *name, int index, int line, int minDutyTime, int maxDutyTime){
+	struct servo * servo_ptr;
 
-	#if DEBUG_SERVO
-	printk(KERN_ALERT "WRIST PWM is %d\n", wristServo->dutyTime);
-	#endif
+	servo_ptr = (struct servo*) kzalloc(sizeof(struct servo), GFP_KERNEL);
+	if(!servo_ptr)
+		return NULL;
 
-	// resetting timer
-	mod_timer(&(wristServo->timer), jiffies+ usecs_to_jiffies(PERIOD-wristServo->dutyTime));
+	// Request the output line, default to OFF
+	servo_ptr->name = name;
+	servo_ptr->line = line;
+	if(armOutput->attach && armOutput->attach(servo_ptr)) {
+		kfree(servo_ptr);
+		return NULL;
+	}
 
+	servo_ptr->arm = arm;
+	servo_ptr->index = index;
+	servo_ptr->minDutyTime = minDutyTime;
+	servo_ptr->maxDutyTime = maxDutyTime;
+	servo_ptr->dutyTime = DUTY_FROM_US(minDutyTime);
+	servo_ptr->targetDutyTime = servo_ptr->dutyTime;
+	servo_ptr->setpoint = servo_ptr->dutyTime;
+	servo_ptr->fbDuty = -1;
+	servo_ptr->fbRetry = jiffies;
+	INIT_WORK(&(servo_ptr->fbWork), fbFunction);
+	INIT_WORK(&(servo_ptr->outWork), outputFunction);
+
+	// The scheduler is not running yet
+	servo_ptr->channel = pwmCount;
+	pwmServos[pwmCount++] = servo_ptr;
+
+	return servo_ptr;
 }
 
-// elbowServo control
-static void elbowServoFunction(struct timer_list* timer){
-	
-	gpio_set_value(ELBOW_GPIO, 1);
-	udelay(elbowServo->dutyTime);
-	gpio_set_value(ELBOW_GPIO, 0);
+// Frees a servo, the PWM scheduler must be stopped
+static void servoFree(struct servo * servo_ptr){
+	if(!servo_ptr)
+		return;
 
+	cancel_work_sync(&(servo_ptr->fbWork));
+	cancel_work_sync(&(servo_ptr->outWork));
+	fbRelease(servo_ptr);
+	if(armOutput->detach)
+		armOutput->detach(servo_ptr);
+	kfree(rcu_access_pointer(servo_ptr->cal));
+	kfree(servo_ptr);
+}
 
-	#if DEBUG_SERVO
-	printk(KERN_ALERT "ELBOW PWM is %d\n", elbowServo->dutyTime);
-	#endif
+// Sets the duty time in ns, clamped to the range of the servo
+// Every setpoint goes through the safety envelope. Returns -EDOM if it was
+// refused for entering a keep-out zone, the servo then stays where it is.
+int setDutyTime(struct servo * servo_ptr, int dutyTime){
+	struct arm * arm = servo_ptr->arm;
+
+	WRITE_ONCE(arm->activity, jiffies);
+	if(READ_ONCE(arm->idleCount))
+		armWake(arm);
+	if(READ_ONCE(servo_ptr->resting))
+		servoKick(servo_ptr);
+	servo_ptr->setpoint = CLAMP(dutyTime, DUTY_FROM_US(servo_ptr->minDutyTime), DUTY_FROM_US(servo_ptr->maxDutyTime));
+	return envelopeMove(servo_ptr);
+}
 
-	// resetting timer
-	mod_timer(&(elbowServo->timer), jiffies+ usecs_to_jiffies(PERIOD-elbowServo->dutyTime));
+// Duty time in ns of one in us, as the interface has them. Clamped to the
+// range of the servo first, so any value fits.
+static int servoDutyNs(struct servo * servo_ptr, s32 dutyTime){
+	return DUTY_FROM_US(CLAMP(dutyTime, servo_ptr->minDutyTime, servo_ptr->maxDutyTime));
 }
 
+// Integrates the joystick velocity over one PWM period
+static void servoIntegrate(struct servo * servo_ptr){
+	struct arm * arm = servo_ptr->arm;
+	int maxDelta, delta, step;
 
-// elbowServo control
-static void gripServoFunction(struct timer_list* timer){
-	
-	gpio_set_value(GRIP_GPIO, 1);
-	udelay(gripServo->dutyTime);
-	gpio_set_value(GRIP_GPIO, 0);
+	// The sequence or a Cartesian move owns the servos while it runs
+	if(arm->sequence->ACTIVE == 1 || arm->cartesian.ACTIVE == 1 || !arm->joystick) {
+		servo_ptr->velocity = 0;
+		return;
+	}
+
+	// Rate limit the change in velocity
+	maxDelta = (joy_max_accel * (PERIOD / 1000)) / 1000;
+	delta = servo_ptr->velocityCmd - servo_ptr->velocity;
+	servo_ptr->velocity += CLAMP(delta, -maxDelta, maxDelta);
+
+	// us/s * ms is ns, the duty time takes the whole step
+	step = servo_ptr->velocity * (PERIOD / 1000);
+	if(step != 0)
+		setDutyTime(servo_ptr, servo_ptr->dutyTime + step);
+}
+
+// PWM scheduler, one timer for the servos of every arm. Pulses the servos
+// that are due, in channel order, and sets the timer for the next one.
+// The cost is per pulse, whatever the number of arms.
+static void pwmFunction(struct timer_list* timer){
+	struct servo * servo_ptr;
+	unsigned long flags;
+	int i;
+
+	for(i = 0; i < pwmCount; i++) {
+		servo_ptr = pwmServos[i];
+		if(time_before(jiffies, READ_ONCE(servo_ptr->nextPulse)))
+			continue;
 
+		servoPulse(servo_ptr);
 
-	#if DEBUG_SERVO
-	printk(KERN_ALERT "GRIP PWM is %d\n", gripServo->dutyTime);
-	#endif
+		spin_lock_irqsave(&pwmLock, flags);
+		servoSchedule(servo_ptr);
+		spin_unlock_irqrestore(&pwmLock, flags);
+	}
 
-	// resetting timer
-	mod_timer(&(gripServo->timer), jiffies+ usecs_to_jiffies(PERIOD-gripServo->dutyTime));
+	spin_lock_irqsave(&pwmLock, flags);
+	pwmArm();
+	spin_unlock_irqrestore(&pwmLock, flags);
 }
 
+// Sets the scheduler timer for the earliest next pulse. Called with pwmLock held.
+static void pwmArm(void){
+	unsigned long next;
+	int i;
 
-// Sequence main function
-static void sequenceFun(struct timer_list* mytimer){
-	
-	if(globalSequence->ACTIVE == 1){
-		
-		if(atTargetDutyTime(wristServo) && atTargetDutyTime(elbowServo) && atTargetDutyTime(wristServo)){
-			globalSequence->STAGE = (globalSequence->STAGE + 1) % globalSequence->TOTAL;
-			setTargetDutyTimes(globalSequence->STAGE);
-			mod_timer(&(globalSequence->sequenceTimer), jiffies+ msecs_to_jiffies(TIME_STAGE * 10));
-		} else {
-			wristServo->dutyTime += SIGN(wristServo->targetDutyTime - wristServo->dutyTime) * PWM_STEP;
-			elbowServo->dutyTime += SIGN(elbowServo->targetDutyTime - elbowServo->dutyTime) * PWM_STEP;
-			gripServo->dutyTime  += SIGN(gripServo ->targetDutyTime - gripServo ->dutyTime) * PWM_STEP;
-			mod_timer(&(globalSequence->sequenceTimer), jiffies+ msecs_to_jiffies(TIME_STAGE));
-			
-		}
-		
-		#if DEBUG
-			printk(KERN_ALERT "STAGE IS %d\n", globalSequence->STAGE);
-		#endif
+	if(pwmCount == 0)
+		return;
+	next = pwmServos[0]->nextPulse;
+	for(i = 1; i < pwmCount; i++) {
+		if(time_before(pwmServos[i]->nextPulse, next))
+			next = pwmServos[i]->nextPulse;
+	}
+	mod_timer(&pwmTimer, next);
+}
 
+// Servo control, runs once per PWM period for each servo
+static void servoPulse(struct servo * servo_ptr){
+	struct arm * arm = servo_ptr->arm;
+	ktime_t now = ktime_get();
+	s64 period;
+	u32 jitter;
+
+	// Pulses stopped: only keep the telemetry going, once a second
+	if(servo_ptr->idle && idle_period_ms <= 0) {
+		if(!armOutput->pulse)
+			outputChanged(servo_ptr);
+		telemetryPublish(arm);
+		return;
+	}
 
+	// Jitter is how far the period between two pulses is from PERIOD, idle
+	// periods do not count. The hardware backends time their own pulses.
+	if(armOutput->pulse && servo_ptr->jitter.pulses > 0 && servo_ptr->lastPulse) {
+		period = ktime_us_delta(now, servo_ptr->lastPulse);
+		jitter = (u32) min_t(s64, abs(period - PERIOD), U32_MAX);
+		servo_ptr->jitter.last_us = jitter;
+		servo_ptr->jitter.max_us = max(servo_ptr->jitter.max_us, jitter);
+		servo_ptr->jitter.avg_us += ((s32) jitter - (s32) servo_ptr->jitter.avg_us) >> TELEM_JITTER_AVG_SHIFT;
+	}
+	servo_ptr->lastPulse = now;
+	servo_ptr->jitter.pulses++;
+
+	servoIntegrate(servo_ptr);
+
+	// Setpoints held back by the velocity limit are approached every period
+	if(servo_ptr->setpoint != servo_ptr->dutyTime)
+		envelopeMove(servo_ptr);
+	telemetryPublish(arm);
+
+	// Traced outside the pulse, so tracing does not stretch it
+	if(armOutput->pulse) {
+		trace_arm_pwm_rise(servo_ptr->channel, servo_ptr->dutyTime);
+		armOutput->pulse(servo_ptr);
+		trace_arm_pwm_fall(servo_ptr->channel, servo_ptr->dutyTime);
+	} else {
+		outputChanged(servo_ptr);
 	}
-	//else do nothing
 
+	// Sample the potentiometer between pulses, IIO reads may sleep
+	if(fb_enable || servo_ptr->fb)
+		queue_work(system_highpri_wq, &(servo_ptr->fbWork));
 }
 
+// Offset of the PWM period of a servo from the first one. The servos of all
+// the arms share the period, so their pulses do not overlap.
+static unsigned long servoPhase(struct servo * servo_ptr){
+	return usecs_to_jiffies(servo_ptr->channel * PERIOD / pwmCount);
+}
 
-// Used for Safety
-void unsetMotors(void){
-	int i;
+// Sets the next pulse, one PERIOD after the last one was due so the phase
+// does not drift, or later when the servo goes idle. Called with pwmLock held.
+static void servoSchedule(struct servo * servo_ptr){
+	struct arm * arm = servo_ptr->arm;
 
-	for(i=0 ; i<TOT_SEQUENCE; i++){
-		globalSequence->SAFETY[i] = -1;
+	if(!servo_ptr->idle && servoIdle(servo_ptr)) {
+		servo_ptr->idle = 1;
+		arm->idleCount++;
+		trace_arm_idle(servo_ptr->channel, 1);
+		telemetryChanged(arm);
 	}
 
+	servo_ptr->resting = !servo_ptr->idle && servoResting(servo_ptr);
+	if(servo_ptr->idle) {
+		servo_ptr->lastPulse = 0;
+		servo_ptr->nextPulse = jiffies + (idle_period_ms > 0 ? msecs_to_jiffies(idle_period_ms) : HZ);
+	} else if(servo_ptr->resting) {
+		servo_ptr->nextPulse = jiffies + HZ; // the hardware holds it, keep the telemetry going
+	} else {
+		servo_ptr->nextPulse += usecs_to_jiffies(PERIOD);
+		if(time_before_eq(servo_ptr->nextPulse, jiffies))
+			servo_ptr->nextPulse = jiffies + 1; // late, skip rather than burst
+	}
 }
 
-// Safety Check
-int safetyCheck(void){
+// Whether a servo has nothing to do for idle_hold_ms
+static int servoIdle(struct servo * servo_ptr){
+	struct arm * arm = servo_ptr->arm;
+
+	if(idle_hold_ms <= 0 || !time_after(jiffies, READ_ONCE(arm->activity) + msecs_to_jiffies(idle_hold_ms)))
+		return 0;
+	if(arm->sequence->ACTIVE == 1 || arm->cartesian.ACTIVE == 1)
+		return 0;
+	return servo_ptr->velocityCmd == 0 && servo_ptr->velocity == 0 && servo_ptr->setpoint == servo_ptr->dutyTime;
+}
+
+// Whether the hardware can hold a servo where it is with no visits from the
+// scheduler: nothing to move and no position feedback to sample
+static int servoResting(struct servo * servo_ptr){
+	if(armOutput->pulse || fb_enable)
+		return 0;
+	return servo_ptr->velocityCmd == 0 && servo_ptr->velocity == 0 && servo_ptr->setpoint == servo_ptr->dutyTime &&
+	       servo_ptr->outDuty == servo_ptr->dutyTime;
+}
+
+// A command for a resting servo, the scheduler visits it on the next tick
+static void servoKick(struct servo * servo_ptr){
+	unsigned long flags;
+
+	spin_lock_irqsave(&pwmLock, flags);
+	if(servo_ptr->resting) {
+		servo_ptr->resting = 0;
+		servo_ptr->nextPulse = jiffies;
+		pwmArm();
+	}
+	spin_unlock_irqrestore(&pwmLock, flags);
+}
+
+// Any command brings the idle servos of an arm back to full rate, in their phase
+void armWake(struct arm * arm){
+	struct servo * servo_ptr;
+	unsigned long flags;
+	int motor;
+
+	spin_lock_irqsave(&pwmLock, flags);
+	arm->activity = jiffies;
+	for(motor = 0; motor < TOT_MOTOR && arm->idleCount; motor++) {
+		servo_ptr = servoByIndex(arm, motor);
+		if(!servo_ptr->idle)
+			continue;
+		servo_ptr->idle = 0;
+		arm->idleCount--;
+		trace_arm_idle(servo_ptr->channel, 0);
+		servo_ptr->nextPulse = jiffies + 1 + servoPhase(servo_ptr);
+	}
+	pwmArm();
+	spin_unlock_irqrestore(&pwmLock, flags);
+	telemetryChanged(arm);
+}
+
+
+// Output backends
+static const struct armOutput * outputByName(const char *name){
 	int i;
 
-	if(globalSequence->TOTAL < 2) {
-		return -1;
+	for(i = 0; i < ARRAY_SIZE(outputs); i++) {
+		if(!strcmp(outputs[i].name, name))
+			return &outputs[i];
 	}
+	return NULL;
+}
 
-	for(i=0 ; i<globalSequence->TOTAL; i++){
-		if(globalSequence->SAFETY[i] < 0){
-			printk(KERN_ALERT "ERROR: Position %d is undefined\n", i + 1);
-			return -1;
-		}
+// Passes the duty time and period a servo is to pulse at on to the hardware
+// when they change. Only the PWM scheduler calls it, the work item applies
+// the last ones it set.
+static void outputChanged(struct servo * servo_ptr){
+	int period = 0;
+
+	if(!servo_ptr->idle)
+		period = PERIOD * NSEC_PER_USEC;
+	else if(idle_period_ms > 0)
+		period = min(idle_period_ms, MSEC_PER_SEC) * NSEC_PER_MSEC;
+
+	if(servo_ptr->dutyTime == servo_ptr->outDuty && period == servo_ptr->outPeriod)
+		return;
+	WRITE_ONCE(servo_ptr->outDuty, servo_ptr->dutyTime);
+	WRITE_ONCE(servo_ptr->outPeriod, period);
+	queue_work(system_highpri_wq, &(servo_ptr->outWork));
+}
+
+static void outputFunction(struct work_struct *work){
+	struct servo * servo_ptr = container_of(work, struct servo, outWork);
+	int dutyTime = READ_ONCE(servo_ptr->outDuty);
+	int period = READ_ONCE(servo_ptr->outPeriod);
+	int err;
+
+	err = armOutput->update(servo_ptr, dutyTime, period);
+	trace_arm_output(servo_ptr->channel, dutyTime, period, err);
+	if(err)
+		printk_ratelimited(KERN_ALERT "arm: could not set the PWM of %s (%d)\n", servo_ptr->name, err);
+}
 
+// GPIO bit-bang: the CPU holds the line high for the pulse
+static int gpioAttach(struct servo * servo_ptr){
+	if(servo_ptr->line < 0 || gpio_request_one(servo_ptr->line, GPIOF_OUT_INIT_LOW, servo_ptr->name)) {
+		printk(KERN_ALERT "Could not request GPIO %d for %s\n", servo_ptr->line, servo_ptr->name);
+		return -EBUSY;
 	}
+	return 0;
+}
+
+static void gpioDetach(struct servo * servo_ptr){
+	gpio_free(servo_ptr->line);
+}
+
+static void gpioPulse(struct servo * servo_ptr){
+	gpio_set_value(servo_ptr->line, 1);
+	pulseDelay(servo_ptr->dutyTime);
+	gpio_set_value(servo_ptr->line, 0);
+}
+
+// Busy waits for a pulse of duty ns. ndelay() rounds up to whole us on ARM,
+// so the wait is udelay() for all but the last us, then the clocksource
+// (24 MHz on the AM335x) for the rest.
+static void pulseDelay(int duty){
+	ktime_t end = ktime_add_ns(ktime_get(), duty);
+
+	if(duty > DUTY_NS)
+		udelay(duty / DUTY_NS - 1);
+	while(ktime_before(ktime_get(), end))
+		cpu_relax();
+}
+
+// Hardware PWM through the PWM framework, the eHRPWMs on the BeagleBone.
+// The channel generates the waveform, the CPU only sets it when it changes.
+static int pwmAttach(struct servo * servo_ptr){
+	struct pwm_device *pwm;
 
+	if(servo_ptr->line < 0) {
+		printk(KERN_ALERT "No PWM channel for %s, see arm_pwms\n", servo_ptr->name);
+		return -EINVAL;
+	}
+	pwm = pwm_request(servo_ptr->line, servo_ptr->name);
+	if(IS_ERR(pwm)) {
+		printk(KERN_ALERT "Could not request PWM %d for %s\n", servo_ptr->line, servo_ptr->name);
+		return PTR_ERR(pwm);
+	}
+	servo_ptr->pwm = pwm;
 	return 0;
-	
 }
 
-void setTargetDutyTimes(unsigned int stage) {
-	if(stage >= globalSequence->TOTAL) {
-		printk(KERN_ALERT "Error: Invalid stage %u!", stage);
-		return;
+static void pwmDetach(struct servo * servo_ptr){
+	pwm_disable(servo_ptr->pwm);
+	pwm_free(servo_ptr->pwm);
+}
+
+static int pwmUpdate(struct servo * servo_ptr, int dutyTime, int period){
+	struct pwm_state state;
+
+	pwm_get_state(servo_ptr->pwm, &state);
+	state.polarity = PWM_POLARITY_NORMAL;
+	state.enabled = period > 0;
+	if(period > 0) {
+		state.period = period;
+		state.duty_cycle = dutyTime;
 	}
-	wristServo->targetDutyTime = globalSequence->MOTOR_PWM[WRIST][stage];
-	elbowServo->targetDutyTime = globalSequence->MOTOR_PWM[ELBOW][stage];
-	gripServo->targetDutyTime  = globalSequence->MOTOR_PWM[GRIP][stage];
+	return pwm_apply_state(servo_ptr->pwm, &state);
 }
 
-int atTargetDutyTime(struct servo * servo_ptr) {
-	return (servo_ptr->dutyTime == servo_ptr->targetDutyTime);
+// Simulated: takes the duty times as the hardware would, they show up in
+// the arm_output trace, so the module runs on any machine
+static int simUpdate(struct servo * servo_ptr, int dutyTime, int period){
+	return 0;
+}
+
+
+// Maps a joystick axis to the servo it drives
+static struct servo * joyAxisServo(struct arm * arm, unsigned int code){
+	switch(code) {
+		case JOY_AXIS_WRIST:
+			return arm->wristServo;
+		case JOY_AXIS_ELBOW:
+			return arm->elbowServo;
+		case JOY_AXIS_GRIP:
+			return arm->gripServo;
+	}
+	return NULL;
+}
+
+// Converts a raw axis value to a joint velocity in us/s
+static int joyAxisVelocity(struct input_dev *dev, unsigned int code, int value){
+	int min = input_abs_get_min(dev, code);
+	int max = input_abs_get_max(dev, code);
+	int half = (max - min) / 2;
+	int pos;
+
+	if(half <= 0)
+		return 0;
+
+	// Normalise to +-JOY_AXIS_MAX around the centre of the axis
+	pos = ((value - (min + half)) * JOY_AXIS_MAX) / half;
+	pos = CLAMP(pos, -JOY_AXIS_MAX, JOY_AXIS_MAX);
+
+	// Apply the deadzone and rescale so the output starts from zero at its edge
+	if(joy_deadzone >= JOY_AXIS_MAX || abs(pos) <= joy_deadzone)
+		return 0;
+	pos = SIGN(pos) * (((abs(pos) - (int) joy_deadzone) * JOY_AXIS_MAX) / (JOY_AXIS_MAX - (int) joy_deadzone));
+
+	// Pushing the stick forward reports a negative Y, which should raise the arm
+	if(code == JOY_AXIS_WRIST)
+		pos = -pos;
+
+	return (pos * (int) joy_max_rate) / JOY_AXIS_MAX;
+}
+
+// Skip touchscreens and tablets, they report absolute X too
+static bool joy_match(struct input_handler *handler, struct input_dev *dev){
+	return !test_bit(BTN_TOUCH, dev->keybit) && !test_bit(BTN_DIGI, dev->keybit);
+}
+
+// Called when a matching input device appears, it drives the first arm
+// without a joystick. The input core serialises connects and disconnects.
+static int joy_connect(struct input_handler *handler, struct input_dev *dev, const struct input_device_id *id){
+	struct input_handle *handle;
+	struct arm * arm = NULL;
+	int err, i;
+
+	for(i = 0; i < num_arms && !arm; i++) {
+		if(!arms[i]->joystick)
+			arm = arms[i];
+	}
+	if(!arm)
+		return -EBUSY;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if(!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "arm_joystick";
+	handle->private = arm;
+
+	err = input_register_handle(handle);
+	if(err)
+		goto fail_free;
+
+	err = input_open_device(handle);
+	if(err)
+		goto fail_unregister;
+
+	WRITE_ONCE(arm->joystick, handle);
+	printk(KERN_ALERT "Joystick %s connected to arm %d\n", dev->name, arm->id);
+	return 0;
+
+fail_unregister:
+	input_unregister_handle(handle);
+fail_free:
+	kfree(handle);
+	return err;
+}
+
+// Called when the joystick goes away, stop any motion it requested
+static void joy_disconnect(struct input_handle *handle){
+	struct arm * arm = handle->private;
+
+	printk(KERN_ALERT "Joystick %s disconnected\n", handle->dev->name);
+
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+
+	WRITE_ONCE(arm->joystick, NULL);
+	arm->wristServo->velocityCmd = 0;
+	arm->elbowServo->velocityCmd = 0;
+	arm->gripServo->velocityCmd = 0;
+}
+
+// Joystick event callback, only records the requested velocity.
+// The servo timers integrate it once per PWM period.
+static void joy_event(struct input_handle *handle, unsigned int type, unsigned int code, int value){
+	struct arm * arm = handle->private;
+	struct servo * servo_ptr;
+
+	if(type != EV_ABS)
+		return;
+
+	servo_ptr = joyAxisServo(arm, code);
+	if(!servo_ptr)
+		return;
+
+	servo_ptr->velocityCmd = joyAxisVelocity(handle->dev, code, value);
+	trace_arm_joy(servo_ptr->channel, servo_ptr->velocityCmd);
+	if(servo_ptr->velocityCmd)
+		setDutyTime(servo_ptr, servo_ptr->setpoint); // wakes the servos
+}
+
+
+// Character device
+static int arm_open(struct inode *inode, struct file *filp)
+{
+	struct armReader *reader;
+	unsigned int minor = iminor(inode);
+
+	if(minor >= num_arms)
+		return -ENODEV;
+
+	reader = kzalloc(sizeof(struct armReader), GFP_KERNEL);
+	if(!reader)
+		return -ENOMEM;
+
+	reader->arm = arms[minor];
+	filp->private_data = reader;
+	return 0;
+}
+
+static int arm_release(struct inode *inode, struct file *filp)
+{
+	kfree(filp->private_data);
+	return 0;
+}
+
+// Returns one telemetry snapshot, blocking until there is a new one
+static ssize_t arm_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
+{
+	struct armReader *reader = filp->private_data;
+	struct arm * arm = reader->arm;
+	struct arm_telemetry telem;
+
+	if(count < sizeof(telem))
+		return -EINVAL;
+
+	if(READ_ONCE(arm->telemPublished) == reader->generation) {
+		if(filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if(wait_event_interruptible(arm->telemWait, READ_ONCE(arm->telemPublished) != reader->generation))
+			return -ERESTARTSYS;
+	}
+
+	reader->generation = READ_ONCE(arm->telemPublished);
+	telemetrySnapshot(arm, &telem);
+
+	if(copy_to_user(buf, &telem, sizeof(telem)))
+		return -EFAULT;
+	return sizeof(telem);
+}
+
+static __poll_t arm_poll(struct file *filp, poll_table *wait)
+{
+	struct armReader *reader = filp->private_data;
+	struct arm * arm = reader->arm;
+
+	poll_wait(filp, &arm->telemWait, wait);
+	if(READ_ONCE(arm->telemPublished) != reader->generation)
+		return EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
+// The ioctls that move the arm or change its settings, which need the
+// device open for writing
+static int armIoctlWrites(unsigned int cmd)
+{
+	switch(cmd) {
+		case ARM_IOC_MOVE_CARTESIAN:
+		case ARM_IOC_SET_CAL:
+		case ARM_IOC_SET_DUTY:
+		case ARM_IOC_SET_DUTY_NS:
+		case ARM_IOC_SET_SEQUENCE:
+		case ARM_IOC_RUN_SEQUENCE:
+		case ARM_IOC_SET_PROGRAM:
+		case ARM_IOC_SET_RATE:
+		case ARM_IOC_SET_DWELL:
+		case ARM_IOC_SET_ENVELOPE:
+		case ARM_IOC_SET_SYNC:
+		case ARM_IOC_START_ARMS:
+		case ARM_IOC_SET_BLEND:
+		case ARM_IOC_RECORD:
+		case ARM_IOC_GET_RECORDING:
+		case ARM_IOC_INPUT_KEY:
+			return 1;
+	}
+	return 0;
+}
+
+static long arm_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+
+	struct arm * arm = ((struct armReader *) filp->private_data)->arm;
+	void __user *argp = (void __user *) arg;
+	struct arm_cartesian target;
+	struct arm_ik_query query;
+	struct arm_pose pose;
+	struct arm_calibration calibration;
+	struct arm_joints joints;
+	struct arm_sequence_io seqio;
+	struct arm_seq_program program;
+	struct servo * servo_ptr;
+	struct servoCal * cal;
+	struct arm_seq_dwell dwell;
+	struct arm_envelope *spec;
+	struct armEnvelope *env;
+	struct arm_sync sync;
+	struct arm_input_io inputio;
+	struct arm_input_start start;
+	struct arm_input_event event;
+	unsigned long flags;
+	__u32 run, rate, mask, blend, record;
+	int motor, err;
+
+	if(armIoctlWrites(cmd) && !(filp->f_mode & FMODE_WRITE))
+		return -EBADF;
+
+	switch(cmd) {
+		case ARM_IOC_MOVE_CARTESIAN:
+			if(copy_from_user(&target, argp, sizeof(target)))
+				return -EFAULT;
+			return cartesianStart(arm, &target);
+
+		case ARM_IOC_SOLVE_CARTESIAN:
+			if(copy_from_user(&query, argp, sizeof(query)))
+				return -EFAULT;
+			err = ikSolve(arm, &query.target, &query.joints, &query.reach_error);
+			if(err)
+				return err;
+			if(copy_to_user(argp, &query, sizeof(query)))
+				return -EFAULT;
+			return 0;
+
+		case ARM_IOC_GET_POSE:
+			fkSolve(arm, &pose);
+			if(copy_to_user(argp, &pose, sizeof(pose)))
+				return -EFAULT;
+			return 0;
+
+		case ARM_IOC_SET_CAL:
+			if(copy_from_user(&calibration, argp, sizeof(calibration)))
+				return -EFAULT;
+			servo_ptr = servoByIndex(arm, calibration.motor);
+			if(!servo_ptr)
+				return -EINVAL;
+			return calApply(servo_ptr, &calibration);
+
+		case ARM_IOC_GET_CAL:
+			if(copy_from_user(&calibration, argp, sizeof(calibration)))
+				return -EFAULT;
+			servo_ptr = servoByIndex(arm, calibration.motor);
+			if(!servo_ptr)
+				return -EINVAL;
+			rcu_read_lock();
+			cal = rcu_dereference(servo_ptr->cal);
+			calibration = cal->points;
+			rcu_read_unlock();
+			if(copy_to_user(argp, &calibration, sizeof(calibration)))
+				return -EFAULT;
+			return 0;
+
+		case ARM_IOC_SET_DUTY:
+		case ARM_IOC_SET_DUTY_NS:
+			if(copy_from_user(&joints, argp, sizeof(joints)))
+				return -EFAULT;
+			if(arm->sequence->ACTIVE == 1)
+				return -EBUSY;
+			cartesianStop(arm);
+			err = 0;
+			for(motor = 0; motor < TOT_MOTOR; motor++) {
+				if(joints.duty[motor] < 0)
+					continue;
+				servo_ptr = servoByIndex(arm, motor);
+				err = setDutyTime(servo_ptr, cmd == ARM_IOC_SET_DUTY ? servoDutyNs(servo_ptr, joints.duty[motor]) : joints.duty[motor]) ?: err;
+			}
+			return err;
+
+		case ARM_IOC_SET_SEQUENCE:
+			if(copy_from_user(&seqio, argp, sizeof(seqio)))
+				return -EFAULT;
+			return sequenceUpload(arm, &seqio);
+
+		case ARM_IOC_GET_SEQUENCE:
+			if(copy_from_user(&seqio, argp, sizeof(seqio)))
+				return -EFAULT;
+			err = sequenceDownload(arm, &seqio);
+			if(err)
+				return err;
+			if(copy_to_user(argp, &seqio, sizeof(seqio)))
+				return -EFAULT;
+			return 0;
+
+		case ARM_IOC_RUN_SEQUENCE:
+			if(get_user(run, (__u32 __user *) argp))
+				return -EFAULT;
+			if(run)
+				return sequenceStart(arm);
+			sequenceStop(arm);
+			return 0;
+
+		case ARM_IOC_SET_PROGRAM:
+			if(copy_from_user(&program, argp, sizeof(program)))
+				return -EFAULT;
+			return programUpload(arm, &program);
+
+		case ARM_IOC_GET_PROGRAM:
+			if(copy_from_user(&program, argp, sizeof(program)))
+				return -EFAULT;
+			err = programDownload(arm, &program);
+			// The size needed is returned with ENOSPC too
+			if((err == 0 || err == -ENOSPC) && copy_to_user(argp, &program, sizeof(program)))
+				return -EFAULT;
+			return err;
+
+		case ARM_IOC_SET_RATE:
+			if(get_user(rate, (__u32 __user *) argp))
+				return -EFAULT;
+			return sequenceSetRate(arm, rate);
+
+		case ARM_IOC_SET_DWELL:
+			if(copy_from_user(&dwell, argp, sizeof(dwell)))
+				return -EFAULT;
+			return sequenceSetDwell(arm, &dwell);
+
+		case ARM_IOC_SET_ENVELOPE:
+			spec = memdup_user(argp, sizeof(*spec));
+			if(IS_ERR(spec))
+				return PTR_ERR(spec);
+			err = envelopeApply(arm, spec);
+			kfree(spec);
+			return err;
+
+		case ARM_IOC_GET_ENVELOPE:
+			spec = kmalloc(sizeof(*spec), GFP_KERNEL);
+			if(!spec)
+				return -ENOMEM;
+			rcu_read_lock();
+			env = rcu_dereference(arm->envelope);
+			*spec = env->spec;
+			rcu_read_unlock();
+			err = copy_to_user(argp, spec, sizeof(*spec)) ? -EFAULT : 0;
+			kfree(spec);
+			return err;
+
+		case ARM_IOC_SET_SYNC:
+			if(copy_from_user(&sync, argp, sizeof(sync)))
+				return -EFAULT;
+			return sequenceSetSync(arm, &sync);
+
+		case ARM_IOC_GET_SYNC:
+			spin_lock_irqsave(&arm->sequenceLock, flags);
+			sync = arm->sequence->SYNC;
+			spin_unlock_irqrestore(&arm->sequenceLock, flags);
+			if(copy_to_user(argp, &sync, sizeof(sync)))
+				return -EFAULT;
+			return 0;
+
+		case ARM_IOC_START_ARMS:
+			if(get_user(mask, (__u32 __user *) argp))
+				return -EFAULT;
+			return sequenceStartArms(mask);
+
+		case ARM_IOC_SET_BLEND:
+			if(get_user(blend, (__u32 __user *) argp))
+				return -EFAULT;
+			return sequenceSetBlend(arm, blend);
+
+		case ARM_IOC_RECORD:
+			if(get_user(record, (__u32 __user *) argp))
+				return -EFAULT;
+			if(record)
+				return inputRecordStart();
+			inputRecordStop();
+			return 0;
+
+		case ARM_IOC_GET_RECORDING:
+			if(copy_from_user(&inputio, argp, sizeof(inputio)))
+				return -EFAULT;
+			err = inputDrain(&inputio);
+			if(err)
+				return err;
+			if(copy_to_user(argp, &inputio, sizeof(inputio)))
+				return -EFAULT;
+			return 0;
+
+		case ARM_IOC_GET_INPUT_START:
+			spin_lock_irqsave(&recLock, flags);
+			start = recStart;
+			spin_unlock_irqrestore(&recLock, flags);
+			if(copy_to_user(argp, &start, sizeof(start)))
+				return -EFAULT;
+			return 0;
+
+		case ARM_IOC_INPUT_KEY:
+			if(copy_from_user(&event, argp, sizeof(event)))
+				return -EFAULT;
+			if(event.type != ARM_INPUT_KEY)
+				return -EINVAL;
+			keyEvent(event.action, event.code, event.value, event.aux);
+			return 0;
+	}
+
+	return -ENOTTY;
+}
+
+
+// CORDIC in vectoring mode: atan2(y, x) in microdegrees, and optionally
+// the length of (x, y). Only shifts and adds, so it is cheap enough to run
+// every PWM period in timer context.
+static s32 cordicAtan2(s32 y, s32 x, s32 *mag)
+{
+	s32 angle = 0;
+	s32 nx;
+	int i;
+
+	// Rotate the left half plane onto the right one
+	if(x < 0) {
+		angle = (y >= 0) ? 180000000 : -180000000;
+		x = -x;
+		y = -y;
+	}
+
+	x <<= IK_CORDIC_SHIFT;
+	y <<= IK_CORDIC_SHIFT;
+
+	for(i = 0; i < IK_CORDIC_ITER; i++) {
+		if(y > 0) {
+			nx = x + (y >> i);
+			y -= x >> i;
+			angle += cordicAngles[i];
+		} else {
+			nx = x - (y >> i);
+			y += x >> i;
+			angle -= cordicAngles[i];
+		}
+		x = nx;
+	}
+
+	if(mag)
+		*mag = (s32) (((s64) x * IK_CORDIC_GAIN_Q30) >> (30 + IK_CORDIC_SHIFT));
+
+	return angle;
+}
+
+// CORDIC in rotation mode: scale*cos(angle) and scale*sin(angle), angle in microdegrees
+static void cordicSinCos(s32 angle, s32 scale, s32 *cosine, s32 *sine)
+{
+	s32 x, y = 0, nx;
+	int sign = 1;
+	int i;
+
+	// The rotation only converges within +-99 degrees
+	if(angle > 90000000) {
+		angle -= 180000000;
+		sign = -1;
+	} else if(angle < -90000000) {
+		angle += 180000000;
+		sign = -1;
+	}
+
+	x = (s32) (((s64) scale * IK_CORDIC_GAIN_Q30) >> (30 - IK_CORDIC_SHIFT));
+
+	for(i = 0; i < IK_CORDIC_ITER; i++) {
+		if(angle >= 0) {
+			nx = x - (y >> i);
+			y += x >> i;
+			angle -= cordicAngles[i];
+		} else {
+			nx = x + (y >> i);
+			y -= x >> i;
+			angle += cordicAngles[i];
+		}
+		x = nx;
+	}
+
+	*cosine = sign * (x >> IK_CORDIC_SHIFT);
+	*sine = sign * (y >> IK_CORDIC_SHIFT);
+}
+
+// Samples atan2(v, u) and |(u, v)| over a grid, done once at init
+static int ikLutBuild(struct ikLut *lut, int u0, int v0, int nu, int nv)
+{
+	int iu, iv;
+	struct ikLutEntry *entry;
+
+	lut->entries = vmalloc(nu * nv * sizeof(struct ikLutEntry));
+	if(!lut->entries)
+		return -ENOMEM;
+
+	lut->u0 = u0;
+	lut->v0 = v0;
+	lut->nu = nu;
+	lut->nv = nv;
+
+	entry = lut->entries;
+	for(iv = 0; iv < nv; iv++) {
+		for(iu = 0; iu < nu; iu++, entry++) {
+			entry->angle = cordicAtan2(v0 + iv * IK_LUT_STEP, u0 + iu * IK_LUT_STEP, &entry->mag) / 1000;
+		}
+	}
+
+	return 0;
+}
+
+// Bilinear interpolation in a table. Returns -1 where the table does not
+// cover the point, or where the angle wraps around inside the cell.
+static int ikLutLookup(const struct ikLut *lut, s32 u, s32 v, s32 *angle, s32 *mag)
+{
+	const struct ikLutEntry *e00, *e10, *e01, *e11;
+	s32 a0, a1, m0, m1;
+	int iu, iv, fu, fv;
+
+	if(!lut->entries)
+		return -1;
+
+	u -= lut->u0;
+	v -= lut->v0;
+	if(u < 0 || v < 0)
+		return -1;
+
+	iu = u / IK_LUT_STEP;
+	iv = v / IK_LUT_STEP;
+	if(iu >= lut->nu - 1 || iv >= lut->nv - 1)
+		return -1;
+
+	fu = u - iu * IK_LUT_STEP;
+	fv = v - iv * IK_LUT_STEP;
+
+	e00 = &lut->entries[iv * lut->nu + iu];
+	e10 = e00 + 1;
+	e01 = e00 + lut->nu;
+	e11 = e01 + 1;
+
+	if(abs(e10->angle - e00->angle) > 90000 || abs(e01->angle - e00->angle) > 90000 ||
+	   abs(e11->angle - e00->angle) > 90000)
+		return -1;
+
+	a0 = e00->angle + ((e10->angle - e00->angle) * fu) / IK_LUT_STEP;
+	a1 = e01->angle + ((e11->angle - e01->angle) * fu) / IK_LUT_STEP;
+	m0 = e00->mag + ((e10->mag - e00->mag) * fu) / IK_LUT_STEP;
+	m1 = e01->mag + ((e11->mag - e01->mag) * fu) / IK_LUT_STEP;
+
+	*angle = a0 + ((a1 - a0) * fv) / IK_LUT_STEP;
+	*mag = m0 + ((m1 - m0) * fv) / IK_LUT_STEP;
+	return 0;
+}
+
+// Joint angle to duty time from the calibration table of the servo
+int angleToDuty(struct servo * servo_ptr, s32 angle, int *dutyTime)
+{
+	const struct servoCal *cal;
+	int i, frac, err = 0;
+
+	rcu_read_lock();
+	cal = rcu_dereference(servo_ptr->cal);
+
+	if(angle < cal->angleMin || angle > cal->angleMax) {
+		err = -ERANGE;
+	} else {
+		i = (angle - cal->angleMin) / CAL_ANGLE_STEP;
+		frac = (angle - cal->angleMin) - i * CAL_ANGLE_STEP;
+		*dutyTime = cal->duty[i];
+		if(frac && i + 1 < cal->nAngle)
+			*dutyTime += ((cal->duty[i + 1] - cal->duty[i]) * frac) / CAL_ANGLE_STEP;
+	}
+
+	rcu_read_unlock();
+	return err;
+}
+
+// Duty time in ns to joint angle, the inverse of angleToDuty. The table has
+// a whole us per entry, the angles in between are interpolated.
+s32 dutyToAngle(struct servo * servo_ptr, int dutyTime)
+{
+	const struct servoCal *cal;
+	s32 angle;
+	int i, frac;
+
+	dutyTime = CLAMP(dutyTime, DUTY_FROM_US(servo_ptr->minDutyTime), DUTY_FROM_US(servo_ptr->maxDutyTime));
+	i = dutyTime / DUTY_NS - servo_ptr->minDutyTime;
+	frac = dutyTime % DUTY_NS;
+
+	rcu_read_lock();
+	cal = rcu_dereference(servo_ptr->cal);
+	angle = cal->angle[i];
+	if(frac)
+		angle += ((cal->angle[i + 1] - cal->angle[i]) * frac) / DUTY_NS;
+	rcu_read_unlock();
+
+	return angle;
+}
+
+// Inverse kinematics: yaw = atan2(y, x), pitch = atan2(z, rho).
+// The reach error is left to the caller, so a move can pass inside the shell.
+int ikSolve(struct arm * arm, const struct arm_cartesian *target, struct arm_joints *joints, s32 *reachError)
+{
+	s32 z = target->z - ik_base_um;
+	s32 yaw, pitch, rho, reach;
+	int err;
+
+	if(abs(target->x) > IK_MAX_UM || abs(target->y) > IK_MAX_UM || abs(z) > IK_MAX_UM)
+		return -ERANGE;
+
+	if(!ik_lut || ikLutLookup(&yawLut, target->x, target->y, &yaw, &rho) || rho < IK_LUT_MIN) {
+		yaw = cordicAtan2(target->y, target->x, &rho) / 1000;
+	}
+
+	if(!ik_lut || ikLutLookup(&pitchLut, rho, z, &pitch, &reach) || reach < IK_LUT_MIN) {
+		pitch = cordicAtan2(z, rho, &reach) / 1000;
+	}
+
+	joints->angle[WRIST] = pitch;
+	joints->angle[ELBOW] = yaw;
+	err = angleToDuty(arm->wristServo, pitch, &joints->duty[WRIST]);
+	if(err)
+		return err;
+	err = angleToDuty(arm->elbowServo, yaw, &joints->duty[ELBOW]);
+	if(err)
+		return err;
+
+	joints->duty[GRIP] = (target->grip < 0) ? DUTY_TO_US(arm->gripServo->dutyTime) : target->grip;
+	joints->duty[GRIP] = CLAMP(joints->duty[GRIP], arm->gripServo->minDutyTime, arm->gripServo->maxDutyTime);
+	joints->angle[GRIP] = dutyToAngle(arm->gripServo, DUTY_FROM_US(joints->duty[GRIP]));
+
+	*reachError = reach - ik_link_um;
+	return 0;
+}
+
+// Forward kinematics of the current duty times
+void fkSolve(struct arm * arm, struct arm_pose *pose)
+{
+	s32 rho, z;
+
+	pose->joints.duty[WRIST] = DUTY_TO_US(arm->wristServo->dutyTime);
+	pose->joints.duty[ELBOW] = DUTY_TO_US(arm->elbowServo->dutyTime);
+	pose->joints.duty[GRIP] = DUTY_TO_US(arm->gripServo->dutyTime);
+	pose->joints.angle[WRIST] = dutyToAngle(arm->wristServo, arm->wristServo->dutyTime);
+	pose->joints.angle[ELBOW] = dutyToAngle(arm->elbowServo, arm->elbowServo->dutyTime);
+	pose->joints.angle[GRIP] = dutyToAngle(arm->gripServo, arm->gripServo->dutyTime);
+
+	cordicSinCos(pose->joints.angle[WRIST] * 1000, ik_link_um, &rho, &z);
+	cordicSinCos(pose->joints.angle[ELBOW] * 1000, rho, &pose->position.x, &pose->position.y);
+	pose->position.z = z + ik_base_um;
+	pose->position.grip = DUTY_TO_US(arm->gripServo->dutyTime);
+	pose->position.duration_ms = 0;
+}
+
+// Marks the telemetry as changed, readers see it at the next publish
+void telemetryChanged(struct arm * arm)
+{
+	WRITE_ONCE(arm->telemGeneration, arm->telemGeneration + 1);
+}
+
+// Called every PWM period, wakes the readers if there is something new.
+// Rate limited, so a fast jog does not wake the display 150 times a second.
+static void telemetryPublish(struct arm * arm)
+{
+	unsigned int generation;
+
+	// The jitter statistics change every pulse, refresh them once a second
+	if(time_after_eq(jiffies, READ_ONCE(arm->telemNextStats))) {
+		WRITE_ONCE(arm->telemNextStats, jiffies + HZ);
+		telemetryChanged(arm);
+	}
+
+	generation = READ_ONCE(arm->telemGeneration);
+	if(generation == READ_ONCE(arm->telemPublished) || time_before(jiffies, READ_ONCE(arm->telemNextWake)))
+		return;
+
+	WRITE_ONCE(arm->telemNextWake, jiffies + msecs_to_jiffies(telem_interval_ms));
+	WRITE_ONCE(arm->telemPublished, generation);
+	wake_up_interruptible(&arm->telemWait);
+}
+
+static void telemetryServo(struct arm_telemetry *telem, int motor, struct servo * servo_ptr)
+{
+	telem->joints.duty[motor] = DUTY_TO_US(servo_ptr->dutyTime);
+	telem->duty_ns[motor] = servo_ptr->dutyTime;
+	telem->joints.angle[motor] = dutyToAngle(servo_ptr, servo_ptr->dutyTime);
+	telem->target[motor] = DUTY_TO_US(servo_ptr->targetDutyTime);
+	telem->duty_min[motor] = servo_ptr->minDutyTime;
+	telem->duty_max[motor] = servo_ptr->maxDutyTime;
+	telem->jitter[motor] = servo_ptr->jitter;
+	if(servo_ptr->idle)
+		telem->idle_mask |= 1 << motor;
+	telem->fb_duty[motor] = READ_ONCE(servo_ptr->fbDuty);
+}
+
+static void telemetrySnapshot(struct arm * arm, struct arm_telemetry *telem)
+{
+	unsigned long flags;
+	int i;
+
+	memset(telem, 0, sizeof(*telem));
+	telem->generation = READ_ONCE(arm->telemPublished);
+	telem->period_us = PERIOD;
+	telem->timestamp_ns = ktime_get_ns();
+
+	telemetryServo(telem, WRIST, arm->wristServo);
+	telemetryServo(telem, ELBOW, arm->elbowServo);
+	telemetryServo(telem, GRIP, arm->gripServo);
+
+	spin_lock_irqsave(&arm->sequenceLock, flags);
+	telem->seq_active = (arm->sequence->ACTIVE == 1);
+	telem->seq_stage = arm->sequence->STAGE;
+	telem->seq_total = arm->sequence->TOTAL;
+	telem->seq_generation = arm->sequence->GENERATION;
+	telem->seq_rate = arm->sequence->RATE;
+	telem->seq_rate_target = arm->sequence->RATE_TARGET;
+	telem->seq_cycles = arm->sequence->CYCLES;
+	telem->seq_cycle_us = arm->sequence->CYCLE_US;
+	telem->seq_cycle_avg_us = arm->sequence->CYCLE_AVG_US;
+	telem->seq_cycle_min_us = arm->sequence->CYCLE_MIN_US;
+	telem->seq_cycle_max_us = arm->sequence->CYCLE_MAX_US;
+	telem->seq_settle_ms = arm->sequence->SETTLE_MS;
+	telem->seq_fb_timeouts = arm->sequence->FB_TIMEOUTS;
+	telem->seq_barrier = arm->sequence->BARRIER_START ? arm->sequence->BARRIER : -1;
+	telem->seq_barrier_ms = arm->sequence->BARRIER_MS;
+	telem->seq_blend_us = arm->sequence->BLEND;
+	telem->env_limited = atomic_read(&arm->envLimited);
+	telem->env_refused = atomic_read(&arm->envRefused);
+	for(i = 0; i < arm->sequence->TOTAL && i < ARM_TELEM_WAYPOINTS; i++) {
+		telem->waypoints[i][WRIST] = arm->sequence->WAYPOINTS[i].duty[WRIST];
+		telem->waypoints[i][ELBOW] = arm->sequence->WAYPOINTS[i].duty[ELBOW];
+		telem->waypoints[i][GRIP] = arm->sequence->WAYPOINTS[i].duty[GRIP];
+	}
+	spin_unlock_irqrestore(&arm->sequenceLock, flags);
+}
+
+
+// Maps a motor index of the user interface to its servo
+static struct servo * servoByIndex(struct arm * arm, unsigned int motor)
+{
+	switch(motor) {
+		case WRIST:
+			return arm->wristServo;
+		case ELBOW:
+			return arm->elbowServo;
+		case GRIP:
+			return arm->gripServo;
+	}
+	return NULL;
+}
+
+// Piecewise linear interpolation over points sorted by x, extrapolating past the ends
+static s32 calInterp(const s32 *xs, const s32 *ys, int n, s32 x)
+{
+	int i = 1;
+
+	while(i < n - 1 && x > xs[i])
+		i++;
+
+	return ys[i - 1] + (s32) div_s64((s64) (ys[i] - ys[i - 1]) * (x - xs[i - 1]), xs[i] - xs[i - 1]);
+}
+
+// Checks a calibration and expands it into the dense tables
+static struct servoCal * calBuild(struct servo * servo_ptr, const struct arm_calibration *points)
+{
+	s32 duty[ARM_CAL_POINTS], angle[ARM_CAL_POINTS];
+	struct servoCal *cal;
+	int n = points->count;
+	int increasing, i, nDuty, nAngle;
+	s32 angleMin, angleMax;
+
+	if(n < 2 || n > ARM_CAL_POINTS)
+		return ERR_PTR(-EINVAL);
+
+	// Bounded, so the differences in calInterp cannot overflow
+	for(i = 0; i < n; i++) {
+		if(points->points[i].duty < servo_ptr->minDutyTime - CAL_DUTY_MARGIN ||
+		   points->points[i].duty > servo_ptr->maxDutyTime + CAL_DUTY_MARGIN ||
+		   points->points[i].angle < -CAL_ANGLE_MAX || points->points[i].angle > CAL_ANGLE_MAX)
+			return ERR_PTR(-EINVAL);
+	}
+
+	increasing = points->points[1].angle > points->points[0].angle;
+	for(i = 1; i < n; i++) {
+		if(points->points[i].duty <= points->points[i - 1].duty)
+			return ERR_PTR(-EINVAL);
+		if((points->points[i].angle > points->points[i - 1].angle) != increasing ||
+		   points->points[i].angle == points->points[i - 1].angle)
+			return ERR_PTR(-EINVAL);
+	}
+
+	for(i = 0; i < n; i++) {
+		duty[i] = points->points[i].duty;
+		angle[i] = points->points[i].angle;
+	}
+
+	// The tables cover the whole duty range of the servo
+	nDuty = servo_ptr->maxDutyTime - servo_ptr->minDutyTime + 1;
+	angleMin = calInterp(duty, angle, n, increasing ? servo_ptr->minDutyTime : servo_ptr->maxDutyTime);
+	angleMax = calInterp(duty, angle, n, increasing ? servo_ptr->maxDutyTime : servo_ptr->minDutyTime);
+	if(angleMax <= angleMin || angleMin < -CAL_ANGLE_MAX || angleMax > CAL_ANGLE_MAX)
+		return ERR_PTR(-EINVAL);
+	nAngle = (angleMax - angleMin) / CAL_ANGLE_STEP + 1;
+
+	cal = kzalloc(sizeof(struct servoCal) + (nDuty + nAngle) * sizeof(s32), GFP_KERNEL);
+	if(!cal)
+		return ERR_PTR(-ENOMEM);
+
+	cal->points = *points;
+	cal->angleMin = angleMin;
+	cal->angleMax = angleMin + (nAngle - 1) * CAL_ANGLE_STEP;
+	cal->nDuty = nDuty;
+	cal->nAngle = nAngle;
+	cal->angle = cal->data;
+	cal->duty = cal->data + nDuty;
+
+	for(i = 0; i < nDuty; i++)
+		cal->angle[i] = calInterp(duty, angle, n, servo_ptr->minDutyTime + i);
+
+	// Invert with the points sorted by angle
+	if(!increasing) {
+		for(i = 0; i < n; i++) {
+			duty[i] = points->points[n - 1 - i].duty;
+			angle[i] = points->points[n - 1 - i].angle;
+		}
+	}
+	for(i = 0; i < nAngle; i++)
+		cal->duty[i] = calInterp(angle, duty, n, angleMin + i * CAL_ANGLE_STEP);
+
+	return cal;
+}
+
+// Swaps in a new calibration. Readers in the timers see either table whole.
+int calApply(struct servo * servo_ptr, const struct arm_calibration *points)
+{
+	struct servoCal *cal, *old;
+
+	cal = calBuild(servo_ptr, points);
+	if(IS_ERR(cal))
+		return PTR_ERR(cal);
+
+	mutex_lock(&calMutex);
+	old = rcu_dereference_protected(servo_ptr->cal, lockdep_is_held(&calMutex));
+	rcu_assign_pointer(servo_ptr->cal, cal);
+	mutex_unlock(&calMutex);
+
+	if(old)
+		kfree_rcu(old, rcu);
+
+	return 0;
+}
+
+// Two point calibration from the module parameters
+void calDefault(struct servo * servo_ptr, int minAngle, int maxAngle)
+{
+	struct arm_calibration points;
+
+	memset(&points, 0, sizeof(points));
+	points.count = 2;
+	points.points[0].duty = servo_ptr->minDutyTime;
+	points.points[0].angle = minAngle;
+	points.points[1].duty = servo_ptr->maxDutyTime;
+	points.points[1].angle = maxAngle;
+
+	if(calApply(servo_ptr, &points))
+		printk(KERN_ALERT "%s: invalid angle range %d..%d\n", servo_ptr->name, minAngle, maxAngle);
+}
+
+// Loads the calibration file, if there is one. A bad record keeps the
+// previous calibration of that servo. Motors 3-5 are those of the second
+// arm, and so on.
+static void calLoadFile(void)
+{
+	const struct firmware *fw;
+	const struct arm_cal_header *header;
+	struct arm_calibration record;
+	struct servo * servo_ptr;
+	int i, err;
+
+	if(!cal_file || !cal_file[0])
+		return;
+
+	if(request_firmware(&fw, cal_file, NULL)) {
+		printk(KERN_ALERT "No calibration file %s, using linear calibration\n", cal_file);
+		return;
+	}
+
+	header = (const struct arm_cal_header *) fw->data;
+	if(fw->size < sizeof(*header) || le32_to_cpu(header->magic) != ARM_CAL_MAGIC ||
+	   le16_to_cpu(header->version) != ARM_CAL_VERSION ||
+	   fw->size < sizeof(*header) + le16_to_cpu(header->count) * sizeof(struct arm_calibration)) {
+		printk(KERN_ALERT "Invalid calibration file %s\n", cal_file);
+		goto out;
+	}
+
+	for(i = 0; i < le16_to_cpu(header->count); i++) {
+		memcpy(&record, fw->data + sizeof(*header) + i * sizeof(record), sizeof(record));
+		if(record.motor >= num_arms * TOT_MOTOR) {
+			printk(KERN_ALERT "Calibration for unknown motor %u\n", record.motor);
+			continue;
+		}
+		servo_ptr = servoByIndex(arms[record.motor / TOT_MOTOR], record.motor % TOT_MOTOR);
+		record.motor %= TOT_MOTOR;
+		err = calApply(servo_ptr, &record);
+		if(err)
+			printk(KERN_ALERT "%s %d: invalid calibration (%d)\n", servo_ptr->name, servo_ptr->arm->id, err);
+		else
+			printk(KERN_ALERT "%s %d: loaded %u point calibration\n", servo_ptr->name, servo_ptr->arm->id, record.count);
+	}
+
+out:
+	release_firmware(fw);
+}
+
+// Starts a straight line move from the current pose to a target
+int cartesianStart(struct arm * arm, const struct arm_cartesian *target)
+{
+	struct arm_joints joints;
+	struct arm_pose pose;
+	unsigned long flags;
+	s32 reachError;
+	int err;
+
+	if(arm->sequence->ACTIVE == 1)
+		return -EBUSY;
+	// Also keeps the duration a positive divisor for div_s64
+	if(target->duration_ms > IK_MOVE_MAX_MS)
+		return -EINVAL;
+
+	// Only the end point has to lie on the reachable shell
+	err = ikSolve(arm, target, &joints, &reachError);
+	if(err)
+		return err;
+	if(abs(reachError) > ik_reach_tol_um)
+		return -EDOM;
+
+	fkSolve(arm, &pose);
+
+	spin_lock_irqsave(&arm->cartesianLock, flags);
+	arm->cartesian.from = pose.position;
+	arm->cartesian.to = *target;
+	if(arm->cartesian.to.grip < 0)
+		arm->cartesian.to.grip = DUTY_TO_US(arm->gripServo->dutyTime);
+	arm->cartesian.start = jiffies;
+	arm->cartesian.ACTIVE = 1;
+	spin_unlock_irqrestore(&arm->cartesianLock, flags);
+
+	trace_arm_cartesian(arm->id, target);
+
+	mod_timer(&(arm->cartesian.timer), jiffies);
+	return 0;
+}
+
+// Also called from the keyboard notifier, with interrupts off
+void cartesianStop(struct arm * arm)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&arm->cartesianLock, flags);
+	arm->cartesian.ACTIVE = 0;
+	spin_unlock_irqrestore(&arm->cartesianLock, flags);
+}
+
+// Cartesian move, runs once per PWM period while a move is active
+static void cartesianFun(struct timer_list* mytimer){
+	struct arm * arm = from_timer(arm, mytimer, cartesian.timer);
+	struct arm_cartesian point;
+	struct arm_joints joints;
+	unsigned int elapsed;
+	unsigned long flags;
+	s32 reachError;
+	int done;
+
+	spin_lock_irqsave(&arm->cartesianLock, flags);
+	if(arm->cartesian.ACTIVE == 0) {
+		spin_unlock_irqrestore(&arm->cartesianLock, flags);
+		return;
+	}
+
+	elapsed = jiffies_to_msecs(jiffies - arm->cartesian.start);
+	done = (elapsed >= arm->cartesian.to.duration_ms);
+	if(done) {
+		point = arm->cartesian.to;
+		arm->cartesian.ACTIVE = 0;
+	} else {
+		point.x = arm->cartesian.from.x + (s32) div_s64((s64) (arm->cartesian.to.x - arm->cartesian.from.x) * elapsed, arm->cartesian.to.duration_ms);
+		point.y = arm->cartesian.from.y + (s32) div_s64((s64) (arm->cartesian.to.y - arm->cartesian.from.y) * elapsed, arm->cartesian.to.duration_ms);
+		point.z = arm->cartesian.from.z + (s32) div_s64((s64) (arm->cartesian.to.z - arm->cartesian.from.z) * elapsed, arm->cartesian.to.duration_ms);
+		point.grip = arm->cartesian.from.grip + (s32) div_s64((s64) (arm->cartesian.to.grip - arm->cartesian.from.grip) * elapsed, arm->cartesian.to.duration_ms);
+	}
+	spin_unlock_irqrestore(&arm->cartesianLock, flags);
+
+	if(ikSolve(arm, &point, &joints, &reachError)) {
+		printk(KERN_ALERT "Cartesian move left the workspace\n");
+		cartesianStop(arm);
+		return;
+	}
+
+	if(setDutyTime(arm->wristServo, DUTY_FROM_US(joints.duty[WRIST])) || setDutyTime(arm->elbowServo, DUTY_FROM_US(joints.duty[ELBOW])) ||
+	   setDutyTime(arm->gripServo, DUTY_FROM_US(joints.duty[GRIP]))) {
+		printk(KERN_ALERT "Cartesian move stopped by the safety envelope\n");
+		cartesianStop(arm);
+		return;
+	}
+
+	if(!done)
+		mod_timer(&(arm->cartesian.timer), jiffies + usecs_to_jiffies(PERIOD));
+}
+
+
+// Sequence main function
+// Every tick the sequence time advances by the tick times the playback rate.
+// It is spent dwelling at the waypoint reached or stepping towards the next.
+static void sequenceFun(struct timer_list* mytimer){
+	struct sequence * sequence = from_timer(sequence, mytimer, sequenceTimer);
+	struct arm * arm = sequence->ARM;
+	unsigned long flags;
+	int step, waiting, wait = TIME_STAGE;
+	
+	spin_lock_irqsave(&arm->sequenceLock, flags);
+	if(arm->sequence->ACTIVE == 1){
+		sequenceRamp(arm, arm->sequence->WAIT);
+
+		if(arm->sequence->DWELL > 0)
+			arm->sequence->DWELL -= arm->sequence->WAIT * arm->sequence->RATE;
+
+		// After the dwell, a sync point holds the sequence until the other arms get there
+		waiting = arm->sequence->DWELL <= 0 && arm->sequence->BARRIER >= 0 && !sequenceBarrier(arm);
+
+		if(!waiting && !arm->sequence->BLEND_LEN && arm->sequence->DWELL <= 0 && atTargetDutyTime(arm->wristServo) && atTargetDutyTime(arm->elbowServo) && atTargetDutyTime(arm->gripServo)) {
+			if(sequenceSettled(arm))
+				sequenceArrived(arm);
+			else
+				wait = FB_SETTLE_TICK; // check again every PWM period
+		}
+
+		if(waiting) {
+			wait = FB_SETTLE_TICK; // check the barrier again every PWM period
+		} else if(arm->sequence->DWELL > 0) {
+			// Wake up when the dwell ends if that is before the next tick
+			wait = MIN(TIME_STAGE, DIV_ROUND_UP(arm->sequence->DWELL, arm->sequence->RATE));
+		} else {
+			// us times per mille is ns, the step is exact at any rate
+			step = ARM_SEQ_STEP_US * arm->sequence->RATE;
+			// Close enough to a via point, turn onto the next segment
+			if(!arm->sequence->BLEND_LEN && sequenceVia(arm))
+				sequenceBlendStart(arm);
+			if(arm->sequence->BLEND_LEN ? sequenceBlendStep(arm, step) :
+			   setDutyTime(arm->wristServo, arm->wristServo->dutyTime + CLAMP(arm->wristServo->targetDutyTime - arm->wristServo->dutyTime, -step, step)) ||
+			   setDutyTime(arm->elbowServo, arm->elbowServo->dutyTime + CLAMP(arm->elbowServo->targetDutyTime - arm->elbowServo->dutyTime, -step, step)) ||
+			   setDutyTime(arm->gripServo, arm->gripServo->dutyTime + CLAMP(arm->gripServo->targetDutyTime - arm->gripServo->dutyTime, -step, step))) {
+				// The next waypoint is behind a keep-out zone, it would never be reached
+				printk(KERN_ALERT "Sequence stopped by the safety envelope at stage %d\n", arm->sequence->STAGE);
+				arm->sequence->ACTIVE = 0;
+				barrierLeave(arm);
+				trace_arm_seq_run(arm->id, 0, arm->sequence->TOTAL, arm->sequence->RATE);
+				telemetryChanged(arm);
+			}
+		}
+		arm->sequence->WAIT = wait;
+		if(arm->sequence->ACTIVE == 1) {
+			// Ticks count from the start, not from when this one ran, so the
+			// arms started together stay in step. A late tick is caught up
+			// unless it is more than a tick behind.
+			arm->sequence->TICK += msecs_to_jiffies(wait);
+			if(time_before(arm->sequence->TICK + msecs_to_jiffies(TIME_STAGE), jiffies))
+				arm->sequence->TICK = jiffies;
+			mod_timer(&(arm->sequence->sequenceTimer), arm->sequence->TICK);
+		}
+
+
+	}
+	//else do nothing
+	spin_unlock_irqrestore(&arm->sequenceLock, flags);
+
+}
+
+// Moves the playback rate towards the one requested, 'elapsed' ms after the
+// last tick. Called with sequenceLock held.
+static void sequenceRamp(struct arm * arm, int elapsed){
+	int ramp = MAX(SEQ_RATE_RAMP * elapsed / TIME_STAGE, 1);
+	int diff = arm->sequence->RATE_TARGET - arm->sequence->RATE;
+
+	if(diff == 0)
+		return;
+	arm->sequence->RATE += CLAMP(diff, -ramp, ramp);
+	telemetryChanged(arm);
+}
+
+// The waypoint of STAGE is reached: wait there, then head for the next one.
+// Arriving at the first waypoint closes a loop. Called with sequenceLock held.
+static void sequenceArrived(struct arm * arm){
+	ktime_t now;
+	u32 cycle;
+
+	if(arm->sequence->STAGE == 0) {
+		now = ktime_get();
+		if(arm->sequence->CYCLE_START) {
+			cycle = (u32) ktime_us_delta(now, arm->sequence->CYCLE_START);
+			arm->sequence->CYCLE_US = cycle;
+			if(arm->sequence->CYCLES == 0) {
+				arm->sequence->CYCLE_AVG_US = cycle;
+				arm->sequence->CYCLE_MIN_US = cycle;
+				arm->sequence->CYCLE_MAX_US = cycle;
+			} else {
+				arm->sequence->CYCLE_AVG_US += ((s32) cycle - (s32) arm->sequence->CYCLE_AVG_US) >> SEQ_CYCLE_AVG_SHIFT;
+				arm->sequence->CYCLE_MIN_US = MIN(arm->sequence->CYCLE_MIN_US, cycle);
+				arm->sequence->CYCLE_MAX_US = MAX(arm->sequence->CYCLE_MAX_US, cycle);
+			}
+			arm->sequence->CYCLES++;
+		}
+		arm->sequence->CYCLE_START = now;
+	}
+
+	arm->sequence->DWELL = READ_ONCE(arm->sequence->WAYPOINTS[arm->sequence->STAGE].dwell_ms) * 1000;
+	arm->sequence->BARRIER = syncBarrier(arm, arm->sequence->STAGE);
+	trace_arm_seq_stage(arm->id, arm->sequence->STAGE, (arm->sequence->STAGE + 1) % arm->sequence->TOTAL,
+		arm->sequence->DWELL / 1000, arm->sequence->RATE);
+	arm->sequence->STAGE = (arm->sequence->STAGE + 1) % arm->sequence->TOTAL;
+	setTargetDutyTimes(arm, arm->sequence->STAGE);
+	telemetryChanged(arm);
+}
+
+// The pose of the waypoint is commanded, wait until the servos are measured
+// there. Without feedback they are taken at their word. Gives up after
+// fb_timeout_ms, so a stalled servo or a bad reading does not stop the
+// sequence. Called with sequenceLock held.
+static int sequenceSettled(struct arm * arm){
+	ktime_t now;
+	s64 settle;
+	int arrived;
+
+	if(!fb_enable)
+		return 1;
+
+	now = ktime_get();
+	if(!arm->sequence->SETTLE_START)
+		arm->sequence->SETTLE_START = now;
+	settle = ktime_ms_delta(now, arm->sequence->SETTLE_START);
+	arrived = fbArrived(arm->wristServo) && fbArrived(arm->elbowServo) && fbArrived(arm->gripServo);
+	if(!arrived && settle < fb_timeout_ms)
+		return 0;
+
+	if(!arrived)
+		arm->sequence->FB_TIMEOUTS++;
+	arm->sequence->SETTLE_MS = (u32) settle;
+	arm->sequence->SETTLE_START = 0;
+	trace_arm_seq_settle(arm->id, arm->sequence->STAGE, arm->sequence->SETTLE_MS, !arrived);
+	return 1;
+}
+
+// The sequence heads for a via point and every joint is within the blend
+// radius of it. Called with sequenceLock held.
+static int sequenceVia(struct arm * arm){
+	const struct arm_waypoint *via = &arm->sequence->WAYPOINTS[arm->sequence->STAGE];
+	int blend = arm->sequence->BLEND;
+
+	if(!blend || READ_ONCE(via->dwell_ms) || syncBarrier(arm, arm->sequence->STAGE) >= 0)
+		return 0;
+	blend = DUTY_FROM_US(blend);
+	return abs(arm->wristServo->dutyTime - DUTY_FROM_US(via->duty[WRIST])) <= blend &&
+	       abs(arm->elbowServo->dutyTime - DUTY_FROM_US(via->duty[ELBOW])) <= blend &&
+	       abs(arm->gripServo->dutyTime - DUTY_FROM_US(via->duty[GRIP])) <= blend;
+}
+
+// Starts the blend around the via point the sequence heads for: a quadratic
+// Bezier curve from the pose now to the point a blend radius along the next
+// segment, with the via point as its control point. The via point counts as
+// reached, so only the segment after it is looked at and the blend takes
+// the same memory whatever the length of the sequence. Called with
+// sequenceLock held.
+static void sequenceBlendStart(struct arm * arm){
+	struct sequence * sequence = arm->sequence;
+	const struct arm_waypoint *next = &sequence->WAYPOINTS[(sequence->STAGE + 1) % sequence->TOTAL];
+	int i, in = 0, out = 0, radius = DUTY_FROM_US(sequence->BLEND);
+
+	for(i = 0; i < TOT_MOTOR; i++) {
+		sequence->BLEND_FROM[i] = servoByIndex(arm, i)->dutyTime;
+		sequence->BLEND_VIA[i] = DUTY_FROM_US(sequence->WAYPOINTS[sequence->STAGE].duty[i]);
+		in = max(in, abs(sequence->BLEND_VIA[i] - sequence->BLEND_FROM[i]));
+		out = max(out, abs(DUTY_FROM_US(next->duty[i]) - sequence->BLEND_VIA[i]));
+	}
+	for(i = 0; i < TOT_MOTOR; i++) {
+		sequence->BLEND_TO[i] = sequence->BLEND_VIA[i];
+		if(out > 0)
+			sequence->BLEND_TO[i] += (int) div_s64((s64) (DUTY_FROM_US(next->duty[i]) - sequence->BLEND_VIA[i]) * min(out, radius), out);
+	}
+
+	// The curve moves a joint at most twice as fast as the longer of its
+	// two legs, over that length no joint goes faster than a step a tick
+	sequence->BLEND_LEN = max(2 * max(in, min(out, radius)), 1);
+	sequence->BLEND_DONE = 0;
+	sequenceArrived(arm);
+}
+
+// Moves along the blend by a step, returns what setDutyTime did. The last
+// step lands on the next segment, and the sequence carries on towards the
+// waypoint after the via point. Called with sequenceLock held.
+static int sequenceBlendStep(struct arm * arm, int step){
+	struct sequence * sequence = arm->sequence;
+	s64 t, u, duty;
+	int i, err = 0;
+
+	sequence->BLEND_DONE = min(sequence->BLEND_DONE + step, sequence->BLEND_LEN);
+	t = div_s64((s64) sequence->BLEND_DONE << 16, sequence->BLEND_LEN);	// Q16
+	u = (1 << 16) - t;
+	for(i = 0; i < TOT_MOTOR; i++) {
+		duty = u * u * sequence->BLEND_FROM[i] + 2 * u * t * sequence->BLEND_VIA[i] + t * t * sequence->BLEND_TO[i];
+		err = setDutyTime(servoByIndex(arm, i), (int) ((duty + (1LL << 31)) >> 32)) ?: err;
+	}
+	if(sequence->BLEND_DONE == sequence->BLEND_LEN)
+		sequence->BLEND_LEN = 0;
+	return err;
+}
+
+// Waits at the barrier of the waypoint reached for the other arms, returns 1
+// once they are all there. The first call arrives; the next ones only read
+// the generation of the barrier, so waiting costs a load every PWM period.
+// Called with sequenceLock held.
+static int sequenceBarrier(struct arm * arm){
+	struct armBarrier * barrier = &barriers[arm->sequence->BARRIER];
+	ktime_t now;
+
+	if(!arm->sequence->BARRIER_START) {
+		arm->sequence->BARRIER_START = ktime_get();
+		spin_lock(&barrierLock);
+		arm->sequence->BARRIER_GEN = barrier->generation;
+		barrier->arrived |= BIT(arm->id);
+		if((barrier->arrived & barrier->members) == barrier->members)
+			barrierRelease(barrier, arm->sequence->TICK, arm->id);
+		spin_unlock(&barrierLock);
+		telemetryChanged(arm);
+	}
+	if(READ_ONCE(barrier->generation) == arm->sequence->BARRIER_GEN)
+		return 0;
+
+	// Leave on the tick of the arm that arrived last, in step with it
+	spin_lock(&barrierLock);
+	arm->sequence->TICK = barrier->releaseTick;
+	spin_unlock(&barrierLock);
+
+	now = ktime_get();
+	arm->sequence->BARRIER_MS = (u32) ktime_ms_delta(now, arm->sequence->BARRIER_START);
+	arm->sequence->BARRIER_START = 0;
+	trace_arm_seq_barrier(arm->id, arm->sequence->BARRIER, arm->sequence->BARRIER_MS);
+	arm->sequence->BARRIER = -1;
+	telemetryChanged(arm);
+	return 1;
+}
+
+// Barrier of a waypoint, or -1 if it has no sync point
+static int syncBarrier(struct arm * arm, int stage){
+	const struct arm_sync *sync = &arm->sequence->SYNC;
+	int i;
+
+	for(i = 0; i < sync->count; i++) {
+		if(sync->points[i].waypoint == stage)
+			return sync->points[i].barrier;
+	}
+	return -1;
+}
+
+// Makes the arm a member of the barriers of its sequence, so the other arms
+// wait for it there. Called with sequenceLock held.
+static void barrierJoin(struct arm * arm){
+	const struct arm_sync *sync = &arm->sequence->SYNC;
+	int i;
+
+	spin_lock(&barrierLock);
+	for(i = 0; i < sync->count; i++)
+		barriers[sync->points[i].barrier].members |= BIT(arm->id);
+	spin_unlock(&barrierLock);
+}
+
+// Takes the arm out of the barriers, releasing those the other arms were
+// only waiting at for it. Called with sequenceLock held.
+static void barrierLeave(struct arm * arm){
+	struct armBarrier * barrier;
+	int i;
+
+	spin_lock(&barrierLock);
+	for(i = 0; i < ARM_SYNC_BARRIERS; i++) {
+		barrier = &barriers[i];
+		if(!(barrier->members & BIT(arm->id)))
+			continue;
+		barrier->members &= ~BIT(arm->id);
+		barrier->arrived &= ~BIT(arm->id);
+		if(barrier->arrived && (barrier->arrived & barrier->members) == barrier->members)
+			barrierRelease(barrier, jiffies, arm->id);
+	}
+	spin_unlock(&barrierLock);
+
+	arm->sequence->BARRIER = -1;
+	arm->sequence->BARRIER_START = 0;
+}
+
+// Lets the arms waiting at a barrier go, from 'tick'. Their timers are
+// brought forward so they leave within a jiffy rather than at their next
+// check. Called with barrierLock held, by the arm 'self'.
+static void barrierRelease(struct armBarrier * barrier, unsigned long tick, int self){
+	unsigned long waiting = barrier->arrived & ~BIT(self);
+	int i;
+
+	barrier->arrived = 0;
+	barrier->releaseTick = tick;
+	WRITE_ONCE(barrier->generation, barrier->generation + 1);
+
+	for_each_set_bit(i, &waiting, ARM_MAX_ARMS)
+		timer_reduce(&(arms[i]->sequence->sequenceTimer), jiffies);
+}
+
+// Used for Safety
+void unsetMotors(struct arm * arm){
+	int i;
+
+	for(i=0 ; i<TOT_SEQUENCE; i++){
+		arm->sequence->SAFETY[i] = -1;
+	}
+
+}
+
+// Safety Check
+// Only the waypoints of keys 1-4 can be left undefined, uploads set them all
+int safetyCheck(struct arm * arm){
+	int i;
+
+	if(arm->sequence->TOTAL < 2) {
+		return -1;
+	}
+
+	for(i=0 ; i<min(arm->sequence->TOTAL, TOT_SEQUENCE); i++){
+		if(arm->sequence->SAFETY[i] < 0){
+			printk(KERN_ALERT "ERROR: Position %d is undefined\n", i + 1);
+			return -1;
+		}
+
+	}
+
+	return 0;
+	
+}
+
+void setTargetDutyTimes(struct arm * arm, unsigned int stage) {
+	if(stage >= arm->sequence->TOTAL) {
+		printk(KERN_ALERT "Error: Invalid stage %u!", stage);
+		return;
+	}
+	arm->wristServo->targetDutyTime = DUTY_FROM_US(arm->sequence->WAYPOINTS[stage].duty[WRIST]);
+	arm->elbowServo->targetDutyTime = DUTY_FROM_US(arm->sequence->WAYPOINTS[stage].duty[ELBOW]);
+	arm->gripServo->targetDutyTime  = DUTY_FROM_US(arm->sequence->WAYPOINTS[stage].duty[GRIP]);
+}
+
+int atTargetDutyTime(struct servo * servo_ptr) {
+	return (servo_ptr->dutyTime == servo_ptr->targetDutyTime);
+}
+
+// Records the current pose as the waypoint of one of the keys 1-4
+static void sequenceSave(struct arm * arm, int slot){
+	struct arm_waypoint *waypoint;
+	unsigned long flags;
+
+	spin_lock_irqsave(&arm->sequenceLock, flags);
+	arm->sequence->TOTAL = MAX(slot + 1, arm->sequence->TOTAL);
+	waypoint = &arm->sequence->WAYPOINTS[slot];
+	waypoint->duty[WRIST] = DUTY_TO_US(arm->wristServo->dutyTime);
+	waypoint->duty[ELBOW] = DUTY_TO_US(arm->elbowServo->dutyTime);
+	waypoint->duty[GRIP] = DUTY_TO_US(arm->gripServo->dutyTime);
+	waypoint->dwell_ms = SEQ_KEY_DWELL;
+	arm->sequence->SAFETY[slot] = 1;
+	arm->sequence->GENERATION++;
+	spin_unlock_irqrestore(&arm->sequenceLock, flags);
+}
+
+// Starts the stored sequence from its first waypoint
+int sequenceStart(struct arm * arm){
+	return sequenceStartAt(arm, jiffies + msecs_to_jiffies(TIME_STAGE));
+}
+
+// Starts the sequence with its first tick at 'tick'. The ticks after it
+// count from there, so sequences started at the same tick stay in step.
+static int sequenceStartAt(struct arm * arm, unsigned long tick){
+	unsigned long flags;
+	int err;
+
+	spin_lock_irqsave(&arm->sequenceLock, flags);
+	barrierLeave(arm);
+	err = safetyCheck(arm);
+	if(err == 0){
+		arm->sequence->ACTIVE = 1;
+		arm->sequence->STAGE = 0;
+		arm->sequence->DWELL = 0;
+		arm->sequence->RATE = arm->sequence->RATE_TARGET;
+		arm->sequence->CYCLE_START = 0;
+		arm->sequence->CYCLES = 0;
+		arm->sequence->SETTLE_START = 0;
+		arm->sequence->FB_TIMEOUTS = 0;
+		arm->sequence->WAIT = TIME_STAGE;
+		arm->sequence->BARRIER_MS = 0;
+		arm->sequence->BLEND_LEN = 0;
+		arm->sequence->TICK = tick;
+		setTargetDutyTimes(arm, 0);
+		barrierJoin(arm);
+		mod_timer(&(arm->sequence->sequenceTimer), tick);
+	}else{
+		arm->sequence->ACTIVE = 0;
+	}
+	spin_unlock_irqrestore(&arm->sequenceLock, flags);
+
+	if(err)
+		return -EINVAL;
+
+	trace_arm_seq_run(arm->id, 1, arm->sequence->TOTAL, arm->sequence->RATE);
+	cartesianStop(arm);
+	armWake(arm);
+	return 0;
+}
+
+// Stops the sequence where it is, keeping the waypoints
+void sequenceStop(struct arm * arm){
+	unsigned long flags;
+
+	spin_lock_irqsave(&arm->sequenceLock, flags);
+	arm->sequence->ACTIVE = 0;
+	barrierLeave(arm);
+	spin_unlock_irqrestore(&arm->sequenceLock, flags);
+	trace_arm_seq_run(arm->id, 0, arm->sequence->TOTAL, arm->sequence->RATE);
+	telemetryChanged(arm);
+}
+
+// Starts the sequences of a set of arms, bit N for arm N, on the same first
+// tick. If one cannot start, none of them run.
+int sequenceStartArms(u32 mask){
+	unsigned long tick = jiffies + msecs_to_jiffies(TIME_STAGE);
+	int i, err;
+
+	if(!mask || mask >> num_arms)
+		return -EINVAL;
+
+	for(i = 0; i < num_arms; i++) {
+		if(!(mask & BIT(i)))
+			continue;
+		err = sequenceStartAt(arms[i], tick);
+		if(err)
+			goto fail;
+	}
+	return 0;
+
+fail:
+	while(--i >= 0) {
+		if(mask & BIT(i))
+			sequenceStop(arms[i]);
+	}
+	return err;
+}
+
+// Arms whose sequence has sync points
+static u32 syncArms(void){
+	u32 mask = 0;
+	int i;
+
+	for(i = 0; i < num_arms; i++) {
+		if(READ_ONCE(arms[i]->sequence->SYNC.count))
+			mask |= BIT(i);
+	}
+	return mask;
+}
+
+// Sets the sync points of the sequence. Each waypoint has one at most.
+int sequenceSetSync(struct arm * arm, const struct arm_sync *sync){
+	unsigned long flags;
+	int i, j, err = 0;
+
+	if(sync->count > ARM_SYNC_POINTS)
+		return -EINVAL;
+	for(i = 0; i < sync->count; i++) {
+		if(sync->points[i].barrier >= ARM_SYNC_BARRIERS || sync->points[i].waypoint >= arm->sequence->CAPACITY)
+			return -EINVAL;
+		for(j = 0; j < i; j++) {
+			if(sync->points[j].waypoint == sync->points[i].waypoint)
+				return -EINVAL;
+		}
+	}
+
+	spin_lock_irqsave(&arm->sequenceLock, flags);
+	if(arm->sequence->ACTIVE == 1)
+		err = -EBUSY;
+	else
+		arm->sequence->SYNC = *sync;
+	spin_unlock_irqrestore(&arm->sequenceLock, flags);
+	return err;
+}
+
+// Sets the playback rate. A running sequence ramps to it from the next tick.
+int sequenceSetRate(struct arm * arm, u32 rate){
+	unsigned long flags;
+
+	if(rate < ARM_SEQ_RATE_MIN || rate > ARM_SEQ_RATE_MAX)
+		return -ERANGE;
+
+	spin_lock_irqsave(&arm->sequenceLock, flags);
+	arm->sequence->RATE_TARGET = rate;
+	if(arm->sequence->ACTIVE != 1)
+		arm->sequence->RATE = rate;
+	spin_unlock_irqrestore(&arm->sequenceLock, flags);
+	telemetryChanged(arm);
+	return 0;
+}
+
+// Sets the blend radius. A blend under way finishes on the old one.
+int sequenceSetBlend(struct arm * arm, u32 blend){
+	unsigned long flags;
+
+	if(blend > ARM_SEQ_MAX_BLEND_US)
+		return -ERANGE;
+
+	spin_lock_irqsave(&arm->sequenceLock, flags);
+	arm->sequence->BLEND = blend;
+	spin_unlock_irqrestore(&arm->sequenceLock, flags);
+	telemetryChanged(arm);
+	return 0;
+}
+
+// Changes dwell times in place. A dwell under way is lengthened or shortened
+// by the difference, so the change takes effect without a restart.
+int sequenceSetDwell(struct arm * arm, const struct arm_seq_dwell *dwell){
+	struct arm_waypoint *waypoints;
+	unsigned long flags;
+	unsigned int i, first, last, reached;
+	int err = 0;
+
+	if(dwell->dwell_ms > ARM_SEQ_MAX_DWELL_MS)
+		return -EINVAL;
+
+	// Uploads hold the mutex, so the store is not swapped under the loop
+	if(mutex_lock_interruptible(&arm->sequenceMutex))
+		return -ERESTARTSYS;
+
+	spin_lock_irqsave(&arm->sequenceLock, flags);
+	waypoints = arm->sequence->WAYPOINTS;
+	first = (dwell->index == ARM_SEQ_ALL) ? 0 : dwell->index;
+	last = (dwell->index == ARM_SEQ_ALL) ? arm->sequence->TOTAL : dwell->index + 1;
+	if(dwell->index != ARM_SEQ_ALL && dwell->index >= arm->sequence->TOTAL) {
+		spin_unlock_irqrestore(&arm->sequenceLock, flags);
+		err = -EINVAL;
+		goto out;
+	}
+	// Nothing stored, nothing to change
+	if(arm->sequence->TOTAL == 0) {
+		spin_unlock_irqrestore(&arm->sequenceLock, flags);
+		goto out;
+	}
+	reached = (arm->sequence->STAGE + arm->sequence->TOTAL - 1) % max_t(int, arm->sequence->TOTAL, 1);
+	if(arm->sequence->ACTIVE == 1 && arm->sequence->DWELL > 0 && reached >= first && reached < last)
+		arm->sequence->DWELL += ((int) dwell->dwell_ms - (int) waypoints[reached].dwell_ms) * 1000;
+	arm->sequence->GENERATION++;
+	spin_unlock_irqrestore(&arm->sequenceLock, flags);
+
+	// The timer reads one dwell at a time, so the rest is written without the spinlock
+	for(i = first; i < last; i++)
+		WRITE_ONCE(waypoints[i].dwell_ms, dwell->dwell_ms);
+	telemetryChanged(arm);
+
+out:
+	mutex_unlock(&arm->sequenceMutex);
+	return err;
+}
+
+// Replaces the sequence with a batch of waypoints from user space. The batch
+// is copied to the spare store and checked there, then the stores are
+// swapped, so the sequence timer never sees a half written sequence.
+int sequenceUpload(struct arm * arm, const struct arm_sequence_io *io){
+	const struct arm_waypoint __user *src = u64_to_user_ptr(io->waypoints);
+	int err;
+
+	if(io->offset != 0 || io->count > arm->sequence->CAPACITY)
+		return -EINVAL;
+
+	if(mutex_lock_interruptible(&arm->sequenceMutex))
+		return -ERESTARTSYS;
+
+	if(arm->sequence->ACTIVE == 1)
+		err = -EBUSY;
+	else if(copy_from_user(arm->sequence->SPARE, src, io->count * sizeof(struct arm_waypoint)))
+		err = -EFAULT;
+	else
+		err = sequenceCommit(arm, io->count, io->flags);
+
+	mutex_unlock(&arm->sequenceMutex);
+	return err;
+}
+
+// Checks the first 'count' waypoints of the spare store and swaps it in.
+// Called with sequenceMutex held.
+static int sequenceCommit(struct arm * arm, unsigned int count, u32 flags){
+	struct arm_waypoint *waypoint;
+	struct servo * servo_ptr;
+	unsigned long flags_irq;
+	unsigned int i;
+	int motor;
+
+	for(i = 0; i < count; i++) {
+		waypoint = &arm->sequence->SPARE[i];
+		if(waypoint->dwell_ms > ARM_SEQ_MAX_DWELL_MS)
+			return -EINVAL;
+		for(motor = 0; motor < TOT_MOTOR; motor++) {
+			servo_ptr = servoByIndex(arm, motor);
+			if(waypoint->duty[motor] < servo_ptr->minDutyTime || waypoint->duty[motor] > servo_ptr->maxDutyTime)
+				return -ERANGE;
+		}
+		if(envelopeCheckPose(arm, waypoint->duty))
+			return -EDOM;
+	}
+
+	spin_lock_irqsave(&arm->sequenceLock, flags_irq);
+	if(arm->sequence->ACTIVE == 1) {
+		// Started from the keyboard meanwhile
+		spin_unlock_irqrestore(&arm->sequenceLock, flags_irq);
+		return -EBUSY;
+	}
+	waypoint = arm->sequence->WAYPOINTS;
+	arm->sequence->WAYPOINTS = arm->sequence->SPARE;
+	arm->sequence->SPARE = waypoint;
+	arm->sequence->TOTAL = count;
+	arm->sequence->STAGE = 0;
+	arm->sequence->GENERATION++;
+	for(i = 0; i < TOT_SEQUENCE; i++)
+		arm->sequence->SAFETY[i] = (i < count) ? 1 : -1;
+	spin_unlock_irqrestore(&arm->sequenceLock, flags_irq);
+	telemetryChanged(arm);
+
+	trace_arm_seq_store(arm->id, count, arm->sequence->GENERATION);
+
+	if(flags & ARM_SEQ_START)
+		return sequenceStart(arm);
+	return 0;
+}
+
+// Copies part of the stored sequence to user space
+int sequenceDownload(struct arm * arm, struct arm_sequence_io *io){
+	struct arm_waypoint __user *dst = u64_to_user_ptr(io->waypoints);
+	unsigned int total;
+	int err = 0;
+
+	if(mutex_lock_interruptible(&arm->sequenceMutex))
+		return -ERESTARTSYS;
+
+	// Uploads hold the mutex, so the store is not swapped under the copy
+	total = READ_ONCE(arm->sequence->TOTAL);
+	if(io->offset > total) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	io->count = min(io->count, total - io->offset);
+	io->total = total;
+	if(copy_to_user(dst, arm->sequence->WAYPOINTS + io->offset, io->count * sizeof(struct arm_waypoint)))
+		err = -EFAULT;
+
+out:
+	mutex_unlock(&arm->sequenceMutex);
+	return err;
+}
+
+
+// Sequence programs
+// Reads one varint, returns the bytes it took or 0 if it runs past the end
+// or does not fit in 32 bits
+static size_t programVarint(const u8 *data, size_t size, u32 *value){
+	size_t i;
+
+	*value = 0;
+	for(i = 0; i < size && i < 5; i++) {
+		*value |= (u32) (data[i] & 0x7f) << (7 * i);
+		if(!(data[i] & 0x80))
+			return (i < 4 || data[i] < 0x10) ? i + 1 : 0;
+	}
+	return 0;
+}
+
+static size_t programPutVarint(u8 *data, u32 value){
+	size_t n = 0;
+
+	while(value >= 0x80) {
+		data[n++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	data[n++] = value;
+	return n;
+}
+
+// Decodes a program straight into a waypoint store. Returns the number of
+// waypoints, or a negative error if the program is damaged or too long. The
+// duty and dwell ranges are left to sequenceCommit(arm).
+static int programDecode(const u8 *data, size_t size, struct arm_waypoint *waypoints, unsigned int capacity){
+	const struct arm_seq_header *header = (const struct arm_seq_header *) data;
+	s32 last[TOT_MOTOR + 1] = { 0 };
+	unsigned int count, i;
+	size_t pos, end, n;
+	int field;
+	u32 value;
+
+	if(size < sizeof(*header) || le32_to_cpu(header->magic) != ARM_SEQ_MAGIC)
+		return -EINVAL;
+	if(le16_to_cpu(header->version) != ARM_SEQ_VERSION)
+		return -EPROTO;
+
+	pos = le16_to_cpu(header->header_size);
+	count = le32_to_cpu(header->count);
+	end = pos + le32_to_cpu(header->size);
+	if(pos < sizeof(*header) || end < pos || end > size)
+		return -EINVAL;
+	if(count > capacity)
+		return -ENOSPC;
+	if(~crc32_le(~0, data + pos, end - pos) != le32_to_cpu(header->checksum))
+		return -EBADMSG;
+
+	for(i = 0; i < count; i++) {
+		for(field = 0; field <= TOT_MOTOR; field++) {
+			n = programVarint(data + pos, end - pos, &value);
+			if(!n)
+				return -EBADMSG;
+			pos += n;
+			last[field] += (s32) (value >> 1) ^ -(s32) (value & 1);
+		}
+		memcpy(waypoints[i].duty, last, sizeof(waypoints[i].duty));
+		waypoints[i].dwell_ms = last[TOT_MOTOR];
+	}
+
+	return (pos == end) ? count : -EBADMSG;
+}
+
+// Encodes waypoints into a program, the buffer holds ARM_SEQ_PROGRAM_MAX(count)
+static size_t programEncode(u8 *data, const struct arm_waypoint *waypoints, unsigned int count){
+	struct arm_seq_header *header = (struct arm_seq_header *) data;
+	s32 last[TOT_MOTOR + 1] = { 0 };
+	s32 next, delta;
+	size_t pos = sizeof(*header);
+	unsigned int i;
+	int field;
+
+	for(i = 0; i < count; i++) {
+		for(field = 0; field <= TOT_MOTOR; field++) {
+			next = (field < TOT_MOTOR) ? waypoints[i].duty[field] : (s32) waypoints[i].dwell_ms;
+			delta = next - last[field];
+			pos += programPutVarint(data + pos, ((u32) delta << 1) ^ (u32) (delta >> 31));
+			last[field] = next;
+		}
+	}
+
+	header->magic = cpu_to_le32(ARM_SEQ_MAGIC);
+	header->version = cpu_to_le16(ARM_SEQ_VERSION);
+	header->header_size = cpu_to_le16(sizeof(*header));
+	header->count = cpu_to_le32(count);
+	header->size = cpu_to_le32(pos - sizeof(*header));
+	header->checksum = cpu_to_le32(~crc32_le(~0, data + sizeof(*header), pos - sizeof(*header)));
+	return pos;
+}
+
+// Replaces the sequence with a program from user space
+int programUpload(struct arm * arm, const struct arm_seq_program *program){
+	int count, err;
+
+	if(program->size > arm->sequence->PROGRAM_SIZE)
+		return -EFBIG;
+
+	if(mutex_lock_interruptible(&arm->sequenceMutex))
+		return -ERESTARTSYS;
+
+	if(arm->sequence->ACTIVE == 1) {
+		err = -EBUSY;
+		goto out;
+	}
+	if(copy_from_user(arm->sequence->PROGRAM, u64_to_user_ptr(program->data), program->size)) {
+		err = -EFAULT;
+		goto out;
+	}
+	count = programDecode(arm->sequence->PROGRAM, program->size, arm->sequence->SPARE, arm->sequence->CAPACITY);
+	err = (count < 0) ? count : sequenceCommit(arm, count, program->flags);
+
+out:
+	mutex_unlock(&arm->sequenceMutex);
+	return err;
+}
+
+// Copies the stored sequence to user space as a program
+int programDownload(struct arm * arm, struct arm_seq_program *program){
+	size_t size;
+	int err = 0;
+
+	if(mutex_lock_interruptible(&arm->sequenceMutex))
+		return -ERESTARTSYS;
+
+	// Uploads hold the mutex, so the store is not swapped under the encoder
+	size = programEncode(arm->sequence->PROGRAM, arm->sequence->WAYPOINTS, READ_ONCE(arm->sequence->TOTAL));
+	if(program->size < size)
+		err = -ENOSPC;
+	else if(copy_to_user(u64_to_user_ptr(program->data), arm->sequence->PROGRAM, size))
+		err = -EFAULT;
+	program->size = size;
+
+	mutex_unlock(&arm->sequenceMutex);
+	return err;
+}
+
+// Loads the sequence program saved with armseq, if there is one. It is
+// decoded from the firmware buffer straight into the store, ready to run.
+static void programLoadFile(struct arm * arm)
+{
+	const struct firmware *fw;
+	int count, err;
+
+	if(!seq_file || !seq_file[0])
+		return;
+
+	if(request_firmware(&fw, seq_file, NULL)) {
+		printk(KERN_ALERT "No sequence program %s\n", seq_file);
+		return;
+	}
+
+	mutex_lock(&arm->sequenceMutex);
+	count = programDecode(fw->data, fw->size, arm->sequence->SPARE, arm->sequence->CAPACITY);
+	err = (count < 0) ? count : sequenceCommit(arm, count, 0);
+	mutex_unlock(&arm->sequenceMutex);
+
+	if(err)
+		printk(KERN_ALERT "Invalid sequence program %s (%d)\n", seq_file, err);
+	else
+		printk(KERN_ALERT "Loaded sequence program of %d waypoints\n", count);
+
+	release_firmware(fw);
+}
+
+
+// Input recording
+// Adds an event to the recording, if one runs. A full ring counts it as lost
+// rather than overwrite what was not drained yet.
+static void inputRecord(u16 type, u16 action, u32 code, s32 value, s32 aux){
+	struct arm_input_event *event;
+	unsigned long flags;
+
+	if(!READ_ONCE(recActive))
+		return;
+
+	spin_lock_irqsave(&recLock, flags);
+	if(recActive) {
+		if(recTail - recHead >= rec_events) {
+			recLost++;
+		} else {
+			event = &recEvents[recTail % rec_events];
+			event->time_ns = ktime_get_ns();
+			event->type = type;
+			event->action = action;
+			event->code = code;
+			event->value = value;
+			event->aux = aux;
+			recTail++;
+		}
+	}
+	spin_unlock_irqrestore(&recLock, flags);
+}
+
+// Starts a new recording, with the state a replay or a simulation starts from
+int inputRecordStart(void){
+	struct arm_input_start start;
+	struct armEnvelope *env;
+	struct servo * servo_ptr;
+	unsigned long flags;
+	int i, j;
+
+	BUILD_BUG_ON(ARM_MAX_ARMS > ARM_INPUT_ARMS);
+	if(!recEvents)
+		return -ENODEV;
+
+	memset(&start, 0, sizeof(start));
+	start.arms = num_arms;
+	start.key_arm = READ_ONCE(keyArm);
+	start.key_step_ns = READ_ONCE(key_step_ns);
+	rcu_read_lock();
+	for(i = 0; i < num_arms; i++) {
+		env = rcu_dereference(arms[i]->envelope);
+		if(env->spec.keepout_count)
+			start.flags |= ARM_INPUT_INEXACT;
+		for(j = 0; j < TOT_MOTOR; j++) {
+			servo_ptr = servoByIndex(arms[i], j);
+			start.duty[i][j] = READ_ONCE(servo_ptr->dutyTime);
+			start.servo_min[i][j] = DUTY_FROM_US(servo_ptr->minDutyTime);
+			start.servo_max[i][j] = DUTY_FROM_US(servo_ptr->maxDutyTime);
+			start.env_min[i][j] = DUTY_FROM_US(env->spec.duty_min[j]);
+			start.env_max[i][j] = DUTY_FROM_US(env->spec.duty_max[j]);
+			if(env->spec.max_velocity[j])
+				start.flags |= ARM_INPUT_INEXACT;
+		}
+	}
+	rcu_read_unlock();
+
+	spin_lock_irqsave(&recLock, flags);
+	start.time_ns = ktime_get_ns();
+	recStart = start;
+	recHead = recTail = 0;
+	recLost = 0;
+	recActive = 1;
+	spin_unlock_irqrestore(&recLock, flags);
+	return 0;
+}
+
+// Stops the recording, what it holds can still be drained
+void inputRecordStop(void){
+	unsigned long flags;
+
+	spin_lock_irqsave(&recLock, flags);
+	recActive = 0;
+	spin_unlock_irqrestore(&recLock, flags);
+}
+
+// Copies the oldest events of the recording to user space, a chunk at a
+// time so the ring is not locked over copy_to_user
+int inputDrain(struct arm_input_io *io){
+	struct arm_input_event *chunk;
+	struct arm_input_event __user *dest = u64_to_user_ptr(io->events);
+	unsigned long flags;
+	unsigned int n, i, copied = 0;
+	int err = 0;
+
+	if(!recEvents)
+		return -ENODEV;
+
+	chunk = kmalloc_array(INPUT_DRAIN_CHUNK, sizeof(*chunk), GFP_KERNEL);
+	if(!chunk)
+		return -ENOMEM;
+
+	while(copied < io->count) {
+		spin_lock_irqsave(&recLock, flags);
+		n = min3(recTail - recHead, io->count - copied, (unsigned int) INPUT_DRAIN_CHUNK);
+		for(i = 0; i < n; i++)
+			chunk[i] = recEvents[(recHead + i) % rec_events];
+		recHead += n;
+		spin_unlock_irqrestore(&recLock, flags);
+
+		if(n == 0)
+			break;
+		if(copy_to_user(dest + copied, chunk, n * sizeof(*chunk))) {
+			err = -EFAULT;
+			break;
+		}
+		copied += n;
+	}
+	kfree(chunk);
+
+	io->count = copied;
+	io->lost = READ_ONCE(recLost);
+	return err;
+}
+
+
+// Safety envelope
+// Moves a servo towards its setpoint as far as the envelope allows. Runs on
+// every setpoint and every PWM period, so it only clamps and tests bits.
+static int envelopeMove(struct servo * servo_ptr){
+	struct arm * arm = servo_ptr->arm;
+	struct armEnvelope *env;
+	int motor = servo_ptr->index;
+	int dutyTime, maxStep, err = 0;
+	ktime_t now;
+	s64 elapsed;
+
+	rcu_read_lock();
+	env = rcu_dereference(arm->envelope);
+
+	// Joint limits
+	dutyTime = CLAMP(servo_ptr->setpoint, DUTY_FROM_US(env->spec.duty_min[motor]), DUTY_FROM_US(env->spec.duty_max[motor]));
+	if(dutyTime != servo_ptr->setpoint) {
+		servo_ptr->setpoint = dutyTime;
+		atomic_inc(&arm->envLimited);
+	}
+
+	// Velocity, over the time since the last move but at most one period
+	if(env->spec.max_velocity[motor]) {
+		now = ktime_get();
+		elapsed = min_t(s64, ktime_us_delta(now, servo_ptr->lastMove), PERIOD);
+		maxStep = (int) div_s64(elapsed * env->spec.max_velocity[motor], USEC_PER_SEC / DUTY_NS);
+		if(abs(dutyTime - servo_ptr->dutyTime) > maxStep) {
+			dutyTime = servo_ptr->dutyTime + CLAMP(dutyTime - servo_ptr->dutyTime, -maxStep, maxStep);
+			atomic_inc(&arm->envLimited);
+		}
+	}
+
+	// Keep-out zones. A pose already inside one, after the envelope changed,
+	// may still move so the arm can be driven out.
+	if(dutyTime != servo_ptr->dutyTime && envelopeKeepout(arm, env, motor, dutyTime) &&
+	   !envelopeKeepout(arm, env, motor, servo_ptr->dutyTime)) {
+		servo_ptr->setpoint = servo_ptr->dutyTime;
+		atomic_inc(&arm->envRefused);
+		dutyTime = servo_ptr->dutyTime;
+		err = -EDOM;
+	}
+	rcu_read_unlock();
+
+	trace_arm_setpoint(servo_ptr->channel, servo_ptr->setpoint, dutyTime, err);
+	if(dutyTime != servo_ptr->dutyTime) {
+		servo_ptr->dutyTime = dutyTime;
+		servo_ptr->lastMove = ktime_get();
+		telemetryChanged(arm);
+	}
+	return err;
+}
+
+// Whether a joint at dutyTime ns, the others where they are, is in a keep-out zone
+static int envelopeKeepout(struct arm * arm, const struct armEnvelope *env, int motor, int dutyTime){
+	struct servo * other;
+	int cell, otherCell, i;
+
+	if(!env->spec.keepout_count)
+		return 0;
+
+	cell = (dutyTime / DUTY_NS - servoByIndex(arm, motor)->minDutyTime) >> ENV_CELL_SHIFT;
+	for(i = 0; i < TOT_MOTOR; i++) {
+		if(i == motor)
+			continue;
+		other = servoByIndex(arm, i);
+		otherCell = (other->dutyTime / DUTY_NS - other->minDutyTime) >> ENV_CELL_SHIFT;
+		if(motor < i ? test_bit(cell * ENV_CELLS + otherCell, env->keepout[ENV_PAIR(motor, i)])
+			     : test_bit(otherCell * ENV_CELLS + cell, env->keepout[ENV_PAIR(i, motor)]))
+			return 1;
+	}
+	return 0;
+}
+
+// Whether a whole pose is inside the envelope, 0 or -EDOM. For checking
+// waypoints before they are run.
+int envelopeCheckPose(struct arm * arm, const s32 *duty){
+	const struct armEnvelope *env;
+	struct servo * a;
+	int motor, other, err = 0;
+	int cell[TOT_MOTOR];
+
+	rcu_read_lock();
+	env = rcu_dereference(arm->envelope);
+	for(motor = 0; motor < TOT_MOTOR; motor++) {
+		a = servoByIndex(arm, motor);
+		if(duty[motor] < env->spec.duty_min[motor] || duty[motor] > env->spec.duty_max[motor]) {
+			err = -EDOM;
+			goto out;
+		}
+		cell[motor] = (duty[motor] - a->minDutyTime) >> ENV_CELL_SHIFT;
+	}
+	for(motor = 0; motor < TOT_MOTOR; motor++) {
+		for(other = motor + 1; other < TOT_MOTOR; other++) {
+			if(test_bit(cell[motor] * ENV_CELLS + cell[other], env->keepout[ENV_PAIR(motor, other)])) {
+				err = -EDOM;
+				goto out;
+			}
+		}
+	}
+out:
+	rcu_read_unlock();
+	return err;
+}
+
+// Checks an envelope and expands its keep-out zones. A cell is marked if any
+// part of it is in a zone.
+static struct armEnvelope * envelopeBuild(struct arm * arm, const struct arm_envelope *spec){
+	const struct arm_keepout *zone;
+	struct armEnvelope *env;
+	struct servo * a, * b;
+	int motor, ca, cb, ca0, ca1, cb0, cb1;
+	unsigned int i;
+
+	BUILD_BUG_ON(((HS422_MAX_DUTYCYCLE - HS422_MIN_DUTYCYCLE) >> ENV_CELL_SHIFT) >= ENV_CELLS);
+	BUILD_BUG_ON(((SG90_MAX_DUTYCYCLE - SG90_MIN_DUTYCYCLE) >> ENV_CELL_SHIFT) >= ENV_CELLS);
+
+	for(motor = 0; motor < TOT_MOTOR; motor++) {
+		a = servoByIndex(arm, motor);
+		if(spec->duty_min[motor] < a->minDutyTime || spec->duty_max[motor] > a->maxDutyTime ||
+		   spec->duty_min[motor] > spec->duty_max[motor])
+			return ERR_PTR(-ERANGE);
+	}
+	if(spec->keepout_count > ARM_ENV_KEEPOUTS)
+		return ERR_PTR(-EINVAL);
+
+	env = kzalloc(sizeof(*env), GFP_KERNEL);
+	if(!env)
+		return ERR_PTR(-ENOMEM);
+	env->spec = *spec;
+
+	for(i = 0; i < spec->keepout_count; i++) {
+		zone = &spec->keepout[i];
+		if(zone->joint_a >= TOT_MOTOR || zone->joint_b >= TOT_MOTOR || zone->joint_a == zone->joint_b ||
+		   zone->a_min > zone->a_max || zone->b_min > zone->b_max) {
+			kfree(env);
+			return ERR_PTR(-EINVAL);
+		}
+
+		// Rows are the lower joint of the pair
+		a = servoByIndex(arm, min(zone->joint_a, zone->joint_b));
+		b = servoByIndex(arm, max(zone->joint_a, zone->joint_b));
+		ca0 = zone->joint_a < zone->joint_b ? zone->a_min : zone->b_min;
+		ca1 = zone->joint_a < zone->joint_b ? zone->a_max : zone->b_max;
+		cb0 = zone->joint_a < zone->joint_b ? zone->b_min : zone->a_min;
+		cb1 = zone->joint_a < zone->joint_b ? zone->b_max : zone->a_max;
+		ca0 = (CLAMP(ca0, a->minDutyTime, a->maxDutyTime) - a->minDutyTime) >> ENV_CELL_SHIFT;
+		ca1 = (CLAMP(ca1, a->minDutyTime, a->maxDutyTime) - a->minDutyTime) >> ENV_CELL_SHIFT;
+		cb0 = (CLAMP(cb0, b->minDutyTime, b->maxDutyTime) - b->minDutyTime) >> ENV_CELL_SHIFT;
+		cb1 = (CLAMP(cb1, b->minDutyTime, b->maxDutyTime) - b->minDutyTime) >> ENV_CELL_SHIFT;
+		for(ca = ca0; ca <= ca1; ca++)
+			for(cb = cb0; cb <= cb1; cb++)
+				__set_bit(ca * ENV_CELLS + cb, env->keepout[ENV_PAIR(a->index, b->index)]);
+	}
+
+	return env;
+}
+
+// Replaces the envelope. The counters are those of the arm and carry on.
+int envelopeApply(struct arm * arm, const struct arm_envelope *spec){
+	struct armEnvelope *env, *old;
+
+	env = envelopeBuild(arm, spec);
+	if(IS_ERR(env))
+		return PTR_ERR(env);
+
+	mutex_lock(&arm->envelopeMutex);
+	old = rcu_dereference_protected(arm->envelope, lockdep_is_held(&arm->envelopeMutex));
+	rcu_assign_pointer(arm->envelope, env);
+	mutex_unlock(&arm->envelopeMutex);
+
+	if(old)
+		kfree_rcu(old, rcu);
+	telemetryChanged(arm);
+	return 0;
+}
+
+// The whole duty range of every servo, no keep-out zones
+void envelopeDefault(struct arm * arm){
+	struct arm_envelope spec;
+	struct servo * servo_ptr;
+	int motor;
+
+	memset(&spec, 0, sizeof(spec));
+	for(motor = 0; motor < TOT_MOTOR; motor++) {
+		servo_ptr = servoByIndex(arm, motor);
+		spec.duty_min[motor] = servo_ptr->minDutyTime;
+		spec.duty_max[motor] = servo_ptr->maxDutyTime;
+		spec.max_velocity[motor] = max(env_max_velocity, 0);
+	}
+	envelopeApply(arm, &spec);
+}
+
+
+// Position Feedback
+
+// Reads the potentiometer of a servo, queued after each of its pulses. The
+// channel is looked up again every second while it is missing, so the IIO
+// provider can be loaded after the module, and released if it goes away.
+static void fbFunction(struct work_struct *work){
+	struct servo * servo_ptr = container_of(work, struct servo, fbWork);
+	struct arm * arm = servo_ptr->arm;
+	struct iio_channel *channel;
+	const int *s = servo_ptr->fbSamples;
+	char name[16];
+	int value, duty, err;
+
+	if(!fb_enable) {
+		fbRelease(servo_ptr);
+		return;
+	}
+
+	if(!servo_ptr->fb) {
+		if(time_before(jiffies, servo_ptr->fbRetry))
+			return;
+		servo_ptr->fbRetry = jiffies + HZ;
+		// wrist, elbow, grip for the first arm, wrist1 ... for the second
+		if(arm->id)
+			snprintf(name, sizeof(name), "%s%d", fbChannels[servo_ptr->index], arm->id);
+		else
+			strlcpy(name, fbChannels[servo_ptr->index], sizeof(name));
+		channel = iio_channel_get(NULL, name);
+		if(IS_ERR(channel))
+			return;
+		servo_ptr->fb = channel;
+		servo_ptr->fbCount = 0;
+		printk(KERN_INFO "arm: %s position feedback connected\n", servo_ptr->name);
+	}
+
+	err = iio_read_channel_processed(servo_ptr->fb, &value);
+	if(err < 0) {
+		printk(KERN_ALERT "arm: %s position feedback lost (%d)\n", servo_ptr->name, err);
+		fbRelease(servo_ptr);
+		return;
+	}
+
+	// Median of the last readings, a spike does not move the servo back and forth
+	servo_ptr->fbSamples[servo_ptr->fbCount % FB_SAMPLES] = fbToDuty(servo_ptr, value);
+	if(++servo_ptr->fbCount >= FB_SAMPLES) {
+		duty = max(min(s[0], s[1]), min(max(s[0], s[1]), s[2]));
+		if(duty != servo_ptr->fbDuty) {
+			WRITE_ONCE(servo_ptr->fbDuty, duty);
+			telemetryChanged(arm);
+		}
+	}
+	trace_arm_feedback(servo_ptr->channel, value, READ_ONCE(servo_ptr->fbDuty));
+}
+
+// Stops using the feedback of a servo, it is open loop again
+static void fbRelease(struct servo * servo_ptr){
+	if(servo_ptr->fbDuty >= 0)
+		telemetryChanged(servo_ptr->arm);
+	WRITE_ONCE(servo_ptr->fbDuty, -1);
+	servo_ptr->fbCount = 0;
+	if(servo_ptr->fb) {
+		iio_channel_release(servo_ptr->fb);
+		servo_ptr->fb = NULL;
+	}
+}
+
+// Maps a reading of the potentiometer to the duty time of the servo, or -1,
+// no feedback, when fb_min and fb_max are equal. fb_enable is writable, so
+// the check in arm_init does not cover it.
+static int fbToDuty(struct servo * servo_ptr, int value){
+	int motor = servo_ptr->index;
+	s64 span = (s64) (value - fb_min[motor]) * (servo_ptr->maxDutyTime - servo_ptr->minDutyTime);
+
+	if(fb_max[motor] == fb_min[motor])
+		return -1;
+	return servo_ptr->minDutyTime + (int) div_s64(span, fb_max[motor] - fb_min[motor]);
+}
+
+// Whether a servo is measured within fb_tolerance_us of its target
+static int fbArrived(struct servo * servo_ptr){
+	int duty = READ_ONCE(servo_ptr->fbDuty);
+
+	if(duty < 0)
+		return 1; // no feedback for this one
+	return abs(duty - DUTY_TO_US(servo_ptr->targetDutyTime)) <= fb_tolerance_us;
+}
+
+// Duty time of the pulses of a servo in ns, for the simulated feedback of armfb_sim.
+// Motors 3-5 are those of the second arm, and so on.
+int armPulseDuty(unsigned int motor){
+	if(motor >= pwmCount)
+		return -EINVAL;
+	return READ_ONCE(pwmServos[motor]->dutyTime);
 }
+EXPORT_SYMBOL_GPL(armPulseDuty);
@@ -0,0 +1,326 @@
+// Name: Justin Sadler, Abin George
+// Interface of the /dev/arm character device, shared by arm.c and the user space tools
+
+#ifndef ARM_IOCTL_H
+#define ARM_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define ARM_MAJOR	62
+#define ARM_IOC_MAGIC	'a'
+
+#define ARM_TOT_MOTOR	3	// wrist, elbow, grip, same order as enum SERVO
+
+// A Cartesian target. Positions are in micrometres, relative to the
+// base of the arm: x forward, y left, z up. The solved joints, like
+// waypoints, are whole us of duty time.
+struct arm_cartesian {
+	__s32 x;
+	__s32 y;
+	__s32 z;
+	__s32 grip;		// grip duty time in us, negative keeps the current one
+	__u32 duration_ms;	// 0 jumps straight to the target, at most 600000
+};
+
+// Joint space of the arm. Angles are in millidegrees, duty times in us.
+struct arm_joints {
+	__s32 angle[ARM_TOT_MOTOR];
+	__s32 duty[ARM_TOT_MOTOR];
+};
+
+// Inverse kinematics without moving the arm
+struct arm_ik_query {
+	struct arm_cartesian target;
+	struct arm_joints joints;	// solution
+	__s32 reach_error;		// distance from the target to the reachable shell, in um
+};
+
+// Where the arm is now, from forward kinematics of the current duty times
+struct arm_pose {
+	struct arm_cartesian position;
+	struct arm_joints joints;
+};
+
+// Piecewise linear calibration of one servo, duty time to joint angle.
+// Duty times must be strictly increasing and angles strictly monotonic.
+#define ARM_CAL_POINTS	16
+
+struct arm_cal_point {
+	__s32 duty;	// us
+	__s32 angle;	// millidegrees
+};
+
+struct arm_calibration {
+	__u32 motor;	// index in wrist, elbow, grip order; in the file, 3-5 are those of the second arm
+	__u32 count;
+	struct arm_cal_point points[ARM_CAL_POINTS];
+};
+
+// Calibration file, loaded with request_firmware when the module is inserted:
+// a header followed by 'count' struct arm_calibration records, little endian.
+#define ARM_CAL_FIRMWARE	"arm_calib.bin"
+#define ARM_CAL_MAGIC		0x4c414341	// "ACAL"
+#define ARM_CAL_VERSION		1
+
+struct arm_cal_header {
+	__u32 magic;
+	__u16 version;
+	__u16 count;
+};
+
+// Telemetry snapshot returned by read() on /dev/arm. poll() reports the
+// device readable when a newer snapshot than the last one read exists.
+#define ARM_TELEM_WAYPOINTS	8
+
+struct arm_jitter {
+	__u32 last_us;		// |measured period - nominal period| of the last pulse
+	__u32 avg_us;		// running average
+	__u32 max_us;		// since the module was loaded
+	__u32 pulses;
+};
+
+struct arm_telemetry {
+	__u32 generation;	// changes whenever the snapshot does
+	__u32 period_us;	// nominal PWM period
+	__u64 timestamp_ns;	// CLOCK_MONOTONIC
+	struct arm_joints joints;
+	__s32 target[ARM_TOT_MOTOR];
+	__s32 duty_min[ARM_TOT_MOTOR];
+	__s32 duty_max[ARM_TOT_MOTOR];
+	__u32 seq_active;
+	__u32 seq_stage;
+	__u32 seq_total;
+	__s32 waypoints[ARM_TELEM_WAYPOINTS][ARM_TOT_MOTOR];	// duty times, first seq_total valid
+	struct arm_jitter jitter[ARM_TOT_MOTOR];
+	__u32 seq_generation;	// changes whenever the stored sequence does
+	__u32 seq_rate;		// playback rate now, per mille of ARM_SEQ_STEP_US per tick
+	__u32 seq_rate_target;	// rate the playback is ramping to
+	__u32 seq_cycles;	// loops completed since the sequence was started
+	__u32 seq_cycle_us;	// time of the last loop
+	__u32 seq_cycle_avg_us;
+	__u32 seq_cycle_min_us;
+	__u32 seq_cycle_max_us;
+	__u32 env_limited;	// setpoints clamped by the safety envelope
+	__u32 env_refused;	// setpoints refused for entering a keep-out zone
+	__u32 idle_mask;	// servos idle, bit 0 wrist
+	__s32 fb_duty[ARM_TOT_MOTOR];	// duty time measured by the position feedback, -1 without
+	__u32 seq_settle_ms;	// time from commanding the last waypoint to measuring the servos there
+	__u32 seq_fb_timeouts;	// waypoints the servos were not measured at within fb_timeout_ms
+	__s32 seq_barrier;	// barrier the sequence waits at for the other arms, -1 if none
+	__u32 seq_barrier_ms;	// time it waited at the last barrier
+	__u32 seq_blend_us;	// blend radius of the via points, 0 if the sequence stops at each
+	__s32 duty_ns[ARM_TOT_MOTOR];	// joints.duty to the ns, the servos move in steps under a us
+};
+
+// Sequence of waypoints. The sequence steps every joint ARM_SEQ_STEP_US
+// towards the next waypoint every ARM_SEQ_TICK_MS, then waits dwell_ms.
+#define ARM_SEQ_STEP_US		50
+#define ARM_SEQ_TICK_MS		100
+#define ARM_SEQ_MAX_DWELL_MS	60000
+
+// Playback rate, in per mille. Steps and dwells are scaled by it, and a new
+// rate is ramped to while the sequence runs.
+#define ARM_SEQ_RATE_MIN	100
+#define ARM_SEQ_RATE_MAX	4000
+#define ARM_SEQ_RATE_NOMINAL	1000
+
+// Blending. With a blend radius set, a waypoint with no dwell and no sync
+// point is a via point: the sequence does not stop there but turns onto the
+// next segment once every joint is within the radius of it, on a curve
+// that passes at most the radius away. ARM_IOC_SET_BLEND sets the radius,
+// in us of duty time, 0 stops at every waypoint.
+#define ARM_SEQ_MAX_BLEND_US	500
+
+// The duty times of waypoints are whole us. The module keeps them in ns, but
+// only the jog keys, the joystick and ARM_IOC_SET_DUTY_NS set the part under
+// a us; a sequence moves to and holds whole us.
+struct arm_waypoint {
+	__s32 duty[ARM_TOT_MOTOR];	// us
+	__u32 dwell_ms;
+};
+
+// Batched sequence transfer. ARM_IOC_SET_SEQUENCE replaces the whole
+// sequence with 'count' waypoints in one go; ARM_IOC_GET_SEQUENCE copies
+// up to 'count' waypoints from 'offset' and sets count and total.
+#define ARM_SEQ_START		0x1	// start the sequence once it is stored
+
+struct arm_sequence_io {
+	__u32 offset;
+	__u32 count;
+	__u32 total;		// waypoints in the stored sequence
+	__u32 flags;
+	__u64 waypoints;	// user pointer to struct arm_waypoint[count]
+};
+
+// Sequence program: a whole sequence in a compact form, to keep on disk.
+// arm.ko loads ARM_SEQ_FIRMWARE from /lib/firmware at init if present.
+// The header is followed by 'size' bytes of waypoints. Each one holds four
+// varints (7 bits per byte, low bits first): the zigzag coded differences
+// of the three duty times and of dwell_ms from the previous waypoint, the
+// first one counting from zero. Little endian, checksum is the CRC32 (as
+// in zlib) of the waypoint bytes.
+#define ARM_SEQ_FIRMWARE	"arm_seq.bin"
+#define ARM_SEQ_MAGIC		0x51455341	// "ASEQ"
+#define ARM_SEQ_VERSION		1
+#define ARM_SEQ_WAYPOINT_MAX	9		// encoded bytes of a waypoint in the duty and dwell ranges
+
+struct arm_seq_header {
+	__u32 magic;
+	__u16 version;
+	__u16 header_size;	// the waypoints start here, later versions may add fields
+	__u32 count;		// waypoints
+	__u32 size;		// bytes of waypoints
+	__u32 checksum;
+};
+
+#define ARM_SEQ_PROGRAM_MAX(count)	(sizeof(struct arm_seq_header) + ARM_SEQ_WAYPOINT_MAX * (count))
+
+// ARM_IOC_SET_PROGRAM replaces the sequence with a program, ARM_IOC_GET_PROGRAM
+// writes the stored one to 'data'. If 'size' is too small it fails with
+// ENOSPC and sets 'size' to what is needed.
+struct arm_seq_program {
+	__u32 size;		// bytes at data
+	__u32 flags;		// ARM_SEQ_START
+	__u64 data;		// user pointer to the program
+};
+
+// Changes the dwell of one waypoint of the stored sequence, or of all of them
+// with ARM_SEQ_ALL, without stopping it
+#define ARM_SEQ_ALL		0xffffffff
+
+struct arm_seq_dwell {
+	__u32 index;
+	__u32 dwell_ms;
+};
+
+// Sync points between the sequences of several arms. After the dwell of a
+// waypoint with a sync point, the sequence waits until every other running
+// sequence with the same barrier has reached it, then they all head for
+// their next waypoints on the same tick: arm A lets go as arm B grips.
+// ARM_IOC_START_ARMS starts the sequences of a set of arms on one time base;
+// bit N of the mask is /dev/armN.
+#define ARM_SYNC_POINTS		16
+#define ARM_SYNC_BARRIERS	32
+
+struct arm_sync_point {
+	__u32 waypoint;		// index in the sequence
+	__u32 barrier;		// 0 to ARM_SYNC_BARRIERS - 1
+};
+
+struct arm_sync {
+	__u32 count;
+	struct arm_sync_point points[ARM_SYNC_POINTS];
+};
+
+// Input recording. While it runs, arm.ko logs every event reaching its
+// keyboard notifier, and the setpoint each jog key gave, with CLOCK_MONOTONIC
+// timestamps. ARM_IOC_GET_RECORDING drains up to 'count' events to 'events'
+// and sets count to the number copied; events that found the ring full are
+// counted in 'lost'. ARM_IOC_INPUT_KEY feeds a key event back in as if it
+// came from the keyboard, so a recording can be replayed.
+#define ARM_INPUT_ARMS		3		// ARM_MAX_ARMS of arm.c
+#define ARM_INPUT_KEY		1		// code: keysym or keycode, value: 1 down, aux: shift state
+#define ARM_INPUT_SETPOINT	2		// code: PWM channel, value: duty time in ns, aux: 0 or -EDOM
+#define ARM_INPUT_INEXACT	0x1		// keep-out zones or velocity limits were set
+
+struct arm_input_event {
+	__u64 time_ns;
+	__u16 type;
+	__u16 action;		// keys: the keyboard notifier action, KBD_KEYSYM ...
+	__u32 code;
+	__s32 value;
+	__s32 aux;
+};
+
+// State of the module when the recording started, all a simulation of the
+// jog keys needs: where the joints were and the limits they are clamped to.
+// Duty times are in ns, as the module keeps them.
+struct arm_input_start {
+	__u64 time_ns;
+	__u32 arms;
+	__u32 key_arm;		// arm the keyboard drove
+	__u32 flags;		// ARM_INPUT_INEXACT
+	__s32 key_step_ns;	// duty time a jog key moves a servo by
+	__u32 reserved;
+	__s32 duty[ARM_INPUT_ARMS][ARM_TOT_MOTOR];
+	__s32 servo_min[ARM_INPUT_ARMS][ARM_TOT_MOTOR];	// duty range of the servo
+	__s32 servo_max[ARM_INPUT_ARMS][ARM_TOT_MOTOR];
+	__s32 env_min[ARM_INPUT_ARMS][ARM_TOT_MOTOR];	// joint limits of the envelope
+	__s32 env_max[ARM_INPUT_ARMS][ARM_TOT_MOTOR];
+};
+
+struct arm_input_io {
+	__u32 count;
+	__u32 lost;
+	__u64 events;		// user pointer to struct arm_input_event[count]
+};
+
+// Input log, written by armrec: the header, then 'size' bytes of events.
+// Each one holds six varints: the time since the previous event in ns, the
+// type, action and code, and the zigzag coded value and aux. Little endian,
+// checksum is the CRC32 of the event bytes as for sequence programs.
+#define ARM_INPUT_MAGIC		0x4e495341	// "ASIN"
+#define ARM_INPUT_VERSION	2
+
+struct arm_input_header {
+	__u32 magic;
+	__u16 version;
+	__u16 header_size;	// the events start here
+	__u32 count;		// events
+	__u32 size;		// bytes of events
+	__u32 checksum;
+	__u32 lost;		// events the module could not record
+	struct arm_input_start start;
+};
+
+// Safety envelope, checked on every setpoint. Setpoints are clamped to the
+// joint limits, moved towards at max_velocity at most, and refused if they
+// would take a pair of joints into one of its keep-out zones.
+#define ARM_ENV_KEEPOUTS	16
+
+struct arm_keepout {
+	__u32 joint_a;		// two different joints, wrist, elbow, grip order
+	__u32 joint_b;
+	__s32 a_min;		// duty times in us, inclusive
+	__s32 a_max;
+	__s32 b_min;
+	__s32 b_max;
+};
+
+struct arm_envelope {
+	__s32 duty_min[ARM_TOT_MOTOR];
+	__s32 duty_max[ARM_TOT_MOTOR];
+	__u32 max_velocity[ARM_TOT_MOTOR];	// us of duty time per second, 0 for no limit
+	__u32 keepout_count;
+	struct arm_keepout keepout[ARM_ENV_KEEPOUTS];
+};
+
+// The ioctls that move the arm or change a setting fail with EBADF on a
+// file not open for writing
+#define ARM_IOC_MOVE_CARTESIAN	_IOW(ARM_IOC_MAGIC, 1, struct arm_cartesian)
+#define ARM_IOC_SOLVE_CARTESIAN	_IOWR(ARM_IOC_MAGIC, 2, struct arm_ik_query)
+#define ARM_IOC_GET_POSE	_IOR(ARM_IOC_MAGIC, 3, struct arm_pose)
+#define ARM_IOC_SET_CAL		_IOW(ARM_IOC_MAGIC, 4, struct arm_calibration)
+#define ARM_IOC_GET_CAL		_IOWR(ARM_IOC_MAGIC, 5, struct arm_calibration)
+#define ARM_IOC_SET_DUTY	_IOW(ARM_IOC_MAGIC, 6, struct arm_joints)	// negative duty keeps a servo where it is
+#define ARM_IOC_SET_SEQUENCE	_IOW(ARM_IOC_MAGIC, 7, struct arm_sequence_io)
+#define ARM_IOC_GET_SEQUENCE	_IOWR(ARM_IOC_MAGIC, 8, struct arm_sequence_io)
+#define ARM_IOC_RUN_SEQUENCE	_IOW(ARM_IOC_MAGIC, 9, __u32)	// nonzero starts, zero stops
+#define ARM_IOC_SET_PROGRAM	_IOW(ARM_IOC_MAGIC, 10, struct arm_seq_program)
+#define ARM_IOC_GET_PROGRAM	_IOWR(ARM_IOC_MAGIC, 11, struct arm_seq_program)
+#define ARM_IOC_SET_RATE	_IOW(ARM_IOC_MAGIC, 12, __u32)	// per mille
+#define ARM_IOC_SET_DWELL	_IOW(ARM_IOC_MAGIC, 13, struct arm_seq_dwell)
+#define ARM_IOC_SET_ENVELOPE	_IOW(ARM_IOC_MAGIC, 14, struct arm_envelope)
+#define ARM_IOC_GET_ENVELOPE	_IOR(ARM_IOC_MAGIC, 15, struct arm_envelope)
+#define ARM_IOC_SET_SYNC	_IOW(ARM_IOC_MAGIC, 16, struct arm_sync)	// not while the sequence runs
+#define ARM_IOC_GET_SYNC	_IOR(ARM_IOC_MAGIC, 17, struct arm_sync)
+#define ARM_IOC_START_ARMS	_IOW(ARM_IOC_MAGIC, 18, __u32)	// mask of arms
+#define ARM_IOC_SET_BLEND	_IOW(ARM_IOC_MAGIC, 19, __u32)	// us
+#define ARM_IOC_RECORD		_IOW(ARM_IOC_MAGIC, 20, __u32)	// nonzero starts a new recording, zero stops it
+#define ARM_IOC_GET_RECORDING	_IOWR(ARM_IOC_MAGIC, 21, struct arm_input_io)
+#define ARM_IOC_GET_INPUT_START	_IOR(ARM_IOC_MAGIC, 22, struct arm_input_start)
+#define ARM_IOC_INPUT_KEY	_IOW(ARM_IOC_MAGIC, 23, struct arm_input_event)
+#define ARM_IOC_SET_DUTY_NS	_IOW(ARM_IOC_MAGIC, 24, struct arm_joints)	// as ARM_IOC_SET_DUTY, duty times in ns
+
+#endif // ARM_IOCTL_H
@@ -0,0 +1,270 @@
+// Name: Justin Sadler, Abin George
+// Tracepoints of arm.c. Enable them with
+//   echo 1 > /sys/kernel/debug/tracing/events/arm/enable
+// or record them with perf record -e 'arm:*'. Disabled, each one costs a
+// patched out branch.
+// The motor of a servo event is its PWM channel: 0-2 are the wrist, elbow
+// and grip of the first arm, 3-5 those of the second, and so on. The
+// sequence and Cartesian events carry the number of their arm.
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM arm
+
+#if !defined(_ARM_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _ARM_TRACE_H
+
+#include <linux/tracepoint.h>
+
+// A key the module acts on, as the keyboard notifier delivers it
+TRACE_EVENT(arm_key,
+	TP_PROTO(unsigned int value),
+	TP_ARGS(value),
+	TP_STRUCT__entry(
+		__field(unsigned int, value)
+	),
+	TP_fast_assign(
+		__entry->value = value;
+	),
+	TP_printk("keysym 0x%04x", __entry->value)
+);
+
+// A joystick axis changed the velocity request of a joint
+TRACE_EVENT(arm_joy,
+	TP_PROTO(int motor, int velocity),
+	TP_ARGS(motor, velocity),
+	TP_STRUCT__entry(
+		__field(int, motor)
+		__field(int, velocity)
+	),
+	TP_fast_assign(
+		__entry->motor = motor;
+		__entry->velocity = velocity;
+	),
+	TP_printk("motor %d velocity %d us/s", __entry->motor, __entry->velocity)
+);
+
+// Output of the safety envelope for a setpoint: where the joint was asked
+// to go, where it went, and -EDOM if it was refused
+TRACE_EVENT(arm_setpoint,
+	TP_PROTO(int motor, int setpoint, int duty, int err),
+	TP_ARGS(motor, setpoint, duty, err),
+	TP_STRUCT__entry(
+		__field(int, motor)
+		__field(int, setpoint)
+		__field(int, duty)
+		__field(int, err)
+	),
+	TP_fast_assign(
+		__entry->motor = motor;
+		__entry->setpoint = setpoint;
+		__entry->duty = duty;
+		__entry->err = err;
+	),
+	TP_printk("motor %d setpoint %d ns duty %d ns err %d",
+		__entry->motor, __entry->setpoint, __entry->duty, __entry->err)
+);
+
+// Edges of the PWM pulses, bit banged by the PWM scheduler with output=gpio
+DECLARE_EVENT_CLASS(arm_pwm_edge,
+	TP_PROTO(int motor, int duty),
+	TP_ARGS(motor, duty),
+	TP_STRUCT__entry(
+		__field(int, motor)
+		__field(int, duty)
+	),
+	TP_fast_assign(
+		__entry->motor = motor;
+		__entry->duty = duty;
+	),
+	TP_printk("motor %d duty %d ns", __entry->motor, __entry->duty)
+);
+
+DEFINE_EVENT(arm_pwm_edge, arm_pwm_rise,
+	TP_PROTO(int motor, int duty),
+	TP_ARGS(motor, duty)
+);
+
+DEFINE_EVENT(arm_pwm_edge, arm_pwm_fall,
+	TP_PROTO(int motor, int duty),
+	TP_ARGS(motor, duty)
+);
+
+// The duty time and period handed to a hardware output backend, period 0
+// stops the pulses
+TRACE_EVENT(arm_output,
+	TP_PROTO(int motor, int duty, int period, int err),
+	TP_ARGS(motor, duty, period, err),
+	TP_STRUCT__entry(
+		__field(int, motor)
+		__field(int, duty)
+		__field(int, period)
+		__field(int, err)
+	),
+	TP_fast_assign(
+		__entry->motor = motor;
+		__entry->duty = duty;
+		__entry->period = period;
+		__entry->err = err;
+	),
+	TP_printk("motor %d duty %d ns period %d ns err %d",
+		__entry->motor, __entry->duty, __entry->period, __entry->err)
+);
+
+// A servo went idle or was woken up
+TRACE_EVENT(arm_idle,
+	TP_PROTO(int motor, int idle),
+	TP_ARGS(motor, idle),
+	TP_STRUCT__entry(
+		__field(int, motor)
+		__field(int, idle)
+	),
+	TP_fast_assign(
+		__entry->motor = motor;
+		__entry->idle = idle;
+	),
+	TP_printk("motor %d %s", __entry->motor, __entry->idle ? "idle" : "awake")
+);
+
+// A potentiometer reading: the value of the IIO channel and the duty time
+// it maps to, after the median filter
+TRACE_EVENT(arm_feedback,
+	TP_PROTO(int motor, int value, int duty),
+	TP_ARGS(motor, value, duty),
+	TP_STRUCT__entry(
+		__field(int, motor)
+		__field(int, value)
+		__field(int, duty)
+	),
+	TP_fast_assign(
+		__entry->motor = motor;
+		__entry->value = value;
+		__entry->duty = duty;
+	),
+	TP_printk("motor %d value %d duty %d us", __entry->motor, __entry->value, __entry->duty)
+);
+
+// The servos were measured at a waypoint, settle_ms after it was commanded,
+// or the wait for them timed out
+TRACE_EVENT(arm_seq_settle,
+	TP_PROTO(int arm, int stage, unsigned int settle_ms, int timeout),
+	TP_ARGS(arm, stage, settle_ms, timeout),
+	TP_STRUCT__entry(
+		__field(int, arm)
+		__field(int, stage)
+		__field(unsigned int, settle_ms)
+		__field(int, timeout)
+	),
+	TP_fast_assign(
+		__entry->arm = arm;
+		__entry->stage = stage;
+		__entry->settle_ms = settle_ms;
+		__entry->timeout = timeout;
+	),
+	TP_printk("arm %d stage %d settled in %u ms%s", __entry->arm, __entry->stage, __entry->settle_ms,
+		__entry->timeout ? ", timed out" : "")
+);
+
+// The sequence left a barrier once every arm was there, after waiting wait_ms
+TRACE_EVENT(arm_seq_barrier,
+	TP_PROTO(int arm, int barrier, unsigned int wait_ms),
+	TP_ARGS(arm, barrier, wait_ms),
+	TP_STRUCT__entry(
+		__field(int, arm)
+		__field(int, barrier)
+		__field(unsigned int, wait_ms)
+	),
+	TP_fast_assign(
+		__entry->arm = arm;
+		__entry->barrier = barrier;
+		__entry->wait_ms = wait_ms;
+	),
+	TP_printk("arm %d barrier %d after %u ms", __entry->arm, __entry->barrier, __entry->wait_ms)
+);
+
+// The sequence started or stopped
+TRACE_EVENT(arm_seq_run,
+	TP_PROTO(int arm, int active, int total, int rate),
+	TP_ARGS(arm, active, total, rate),
+	TP_STRUCT__entry(
+		__field(int, arm)
+		__field(int, active)
+		__field(int, total)
+		__field(int, rate)
+	),
+	TP_fast_assign(
+		__entry->arm = arm;
+		__entry->active = active;
+		__entry->total = total;
+		__entry->rate = rate;
+	),
+	TP_printk("arm %d %s %d waypoints rate %d", __entry->arm, __entry->active ? "start" : "stop", __entry->total, __entry->rate)
+);
+
+// The sequence reached a waypoint and heads for the next one
+TRACE_EVENT(arm_seq_stage,
+	TP_PROTO(int arm, int reached, int next, unsigned int dwell_ms, int rate),
+	TP_ARGS(arm, reached, next, dwell_ms, rate),
+	TP_STRUCT__entry(
+		__field(int, arm)
+		__field(int, reached)
+		__field(int, next)
+		__field(unsigned int, dwell_ms)
+		__field(int, rate)
+	),
+	TP_fast_assign(
+		__entry->arm = arm;
+		__entry->reached = reached;
+		__entry->next = next;
+		__entry->dwell_ms = dwell_ms;
+		__entry->rate = rate;
+	),
+	TP_printk("arm %d reached %d next %d dwell %u ms rate %d", __entry->arm,
+		__entry->reached, __entry->next, __entry->dwell_ms, __entry->rate)
+);
+
+// A new sequence was stored
+TRACE_EVENT(arm_seq_store,
+	TP_PROTO(int arm, unsigned int count, unsigned int generation),
+	TP_ARGS(arm, count, generation),
+	TP_STRUCT__entry(
+		__field(int, arm)
+		__field(unsigned int, count)
+		__field(unsigned int, generation)
+	),
+	TP_fast_assign(
+		__entry->arm = arm;
+		__entry->count = count;
+		__entry->generation = generation;
+	),
+	TP_printk("arm %d %u waypoints generation %u", __entry->arm, __entry->count, __entry->generation)
+);
+
+// A Cartesian move started, positions in um
+TRACE_EVENT(arm_cartesian,
+	TP_PROTO(int arm, const struct arm_cartesian *target),
+	TP_ARGS(arm, target),
+	TP_STRUCT__entry(
+		__field(int, arm)
+		__field(s32, x)
+		__field(s32, y)
+		__field(s32, z)
+		__field(u32, duration_ms)
+	),
+	TP_fast_assign(
+		__entry->arm = arm;
+		__entry->x = target->x;
+		__entry->y = target->y;
+		__entry->z = target->z;
+		__entry->duration_ms = target->duration_ms;
+	),
+	TP_printk("arm %d to %d %d %d um in %u ms", __entry->arm, __entry->x, __entry->y, __entry->z, __entry->duration_ms)
+);
+
+#endif // _ARM_TRACE_H
+
+// The header is read again from this directory to generate the events
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE arm_trace
+#include <trace/define_trace.h>
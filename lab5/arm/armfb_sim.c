@@ -0,0 +1,196 @@
+// Name: Justin Sadler, Abin George
+// Simulated position feedback for arm.ko: an IIO device with one ADC channel
+// per servo, as the potentiometers would read on the AM335x ADC. Each servo
+// follows the duty time of its pulses at sim_speed, so the feedback lags the
+// command like the real ones do. The channels are mapped to the consumer
+// channel names arm.c looks up, load it after arm.ko and set fb_enable.
+// With sim_arms, it also simulates the servos of the other arms.
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/errno.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/random.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/machine.h>
+
+MODULE_AUTHOR("Abin George, Justin Sadler");
+MODULE_DESCRIPTION("Simulated servo position feedback for arm");
+MODULE_LICENSE("GPL");
+
+#define SIM_ARMS	3	// ARM_MAX_ARMS of arm.c
+#define SIM_MOTORS	(SIM_ARMS * 3)
+#define SIM_DUTY_MIN	200	// duty range of the servos in arm.c
+#define SIM_DUTY_MAX	900
+#define SIM_ADC_BITS	12
+#define SIM_ADC_MV	1800	// full scale of the AM335x ADC
+#define SIM_ADC_MAX	((1 << SIM_ADC_BITS) - 1)
+
+static int sim_speed = 1500;
+static int sim_noise = 4;
+static int sim_arms = 1;
+module_param(sim_speed, int, S_IRUGO | S_IWUSR);
+module_param(sim_noise, int, S_IRUGO | S_IWUSR);
+module_param(sim_arms, int, S_IRUGO);
+MODULE_PARM_DESC(sim_speed, "Speed of the simulated servos (us of duty time per second)");
+MODULE_PARM_DESC(sim_noise, "Noise on the readings (+- ADC counts)");
+MODULE_PARM_DESC(sim_arms, "Number of arms to simulate (1-3)");
+
+// Exported by arm.c
+extern int armPulseDuty(unsigned int motor);
+
+// A simulated servo, in ns of duty time
+struct simServo {
+	s64 position;
+	ktime_t last;
+};
+
+struct armfbSim {
+	struct mutex lock;
+	struct simServo servos[SIM_MOTORS];
+};
+
+#define SIM_CHANNEL(N, NAME) {					\
+	.type = IIO_VOLTAGE,					\
+	.indexed = 1,						\
+	.channel = (N),						\
+	.datasheet_name = NAME,					\
+	.info_mask_separate = BIT(IIO_CHAN_INFO_RAW),		\
+	.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),	\
+}
+
+#define SIM_MAP(NAME, LABEL) \
+	{ .consumer_dev_name = "arm", .consumer_channel = NAME, .adc_channel_label = LABEL }
+
+// Same order as the PWM channels of arm.c
+static const struct iio_chan_spec simChannels[] = {
+	SIM_CHANNEL(0, "AIN0"),
+	SIM_CHANNEL(1, "AIN1"),
+	SIM_CHANNEL(2, "AIN2"),
+	SIM_CHANNEL(3, "AIN3"),
+	SIM_CHANNEL(4, "AIN4"),
+	SIM_CHANNEL(5, "AIN5"),
+	SIM_CHANNEL(6, "AIN6"),
+	SIM_CHANNEL(7, "AIN7"),
+	SIM_CHANNEL(8, "AIN8"),
+};
+
+// The first sim_arms * 3 are registered, the entry after them is cleared
+static struct iio_map simMaps[SIM_MOTORS + 1] = {
+	SIM_MAP("wrist", "AIN0"),
+	SIM_MAP("elbow", "AIN1"),
+	SIM_MAP("grip", "AIN2"),
+	SIM_MAP("wrist1", "AIN3"),
+	SIM_MAP("elbow1", "AIN4"),
+	SIM_MAP("grip1", "AIN5"),
+	SIM_MAP("wrist2", "AIN6"),
+	SIM_MAP("elbow2", "AIN7"),
+	SIM_MAP("grip2", "AIN8"),
+	{ }
+};
+
+static struct iio_dev *simDev = NULL;
+
+// Moves a servo towards the duty time of its pulses, in ns, for the time
+// since it was last read, and returns the ADC count of its potentiometer
+static int simRead(struct simServo *servo, int duty){
+	ktime_t now = ktime_get();
+	s64 target = duty;
+	s64 step;
+	int raw;
+
+	if(!servo->last) {
+		servo->position = target; // starts where it is told to be
+	} else {
+		step = div_s64((s64) sim_speed * ktime_us_delta(now, servo->last), 1000);
+		servo->position += clamp(target - servo->position, -step, step);
+	}
+	servo->last = now;
+
+	raw = (int) div_s64((servo->position - SIM_DUTY_MIN * 1000) * SIM_ADC_MAX, (SIM_DUTY_MAX - SIM_DUTY_MIN) * 1000);
+	if(sim_noise > 0)
+		raw += (int) (prandom_u32() % (2 * sim_noise + 1)) - sim_noise;
+	return clamp(raw, 0, SIM_ADC_MAX);
+}
+
+static int simReadRaw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan, int *val, int *val2, long mask){
+	struct armfbSim *sim = iio_priv(indio_dev);
+	int duty;
+
+	switch(mask) {
+		case IIO_CHAN_INFO_RAW:
+			duty = armPulseDuty(chan->channel);
+			if(duty < 0)
+				return duty;
+			mutex_lock(&sim->lock);
+			*val = simRead(&sim->servos[chan->channel], duty);
+			mutex_unlock(&sim->lock);
+			return IIO_VAL_INT;
+		case IIO_CHAN_INFO_SCALE:
+			*val = SIM_ADC_MV;
+			*val2 = SIM_ADC_BITS;
+			return IIO_VAL_FRACTIONAL_LOG2;
+	}
+	return -EINVAL;
+}
+
+static const struct iio_info simInfo = {
+	.read_raw = simReadRaw,
+};
+
+static int __init armfb_sim_init(void){
+	struct armfbSim *sim;
+	int err;
+
+	if(sim_arms < 1 || sim_arms > SIM_ARMS) {
+		printk(KERN_ALERT "armfb_sim: sim_arms must be 1 to %d\n", SIM_ARMS);
+		return -EINVAL;
+	}
+	memset(&simMaps[sim_arms * 3], 0, sizeof(simMaps[0]));
+
+	simDev = iio_device_alloc(sizeof(struct armfbSim));
+	if(!simDev)
+		return -ENOMEM;
+	sim = iio_priv(simDev);
+	mutex_init(&sim->lock);
+
+	simDev->name = "armfb_sim";
+	simDev->info = &simInfo;
+	simDev->modes = INDIO_DIRECT_MODE;
+	simDev->channels = simChannels;
+	simDev->num_channels = sim_arms * 3;
+
+	err = iio_map_array_register(simDev, simMaps);
+	if(err) {
+		printk(KERN_ALERT "armfb_sim: could not register channel maps\n");
+		goto fail;
+	}
+
+	err = iio_device_register(simDev);
+	if(err) {
+		printk(KERN_ALERT "armfb_sim: could not register IIO device\n");
+		iio_map_array_unregister(simDev);
+		goto fail;
+	}
+
+	printk(KERN_INFO "armfb_sim: simulating %d servos at %d us/s\n", sim_arms * 3, sim_speed);
+	return 0;
+
+fail:
+	iio_device_free(simDev);
+	simDev = NULL;
+	return err;
+}
+
+// arm.ko sees its reads fail and goes back to open loop
+static void __exit armfb_sim_exit(void){
+	iio_device_unregister(simDev);
+	iio_map_array_unregister(simDev);
+	iio_device_free(simDev);
+}
+
+module_init(armfb_sim_init);
+module_exit(armfb_sim_exit);
@@ -0,0 +1,278 @@
+// Name: Justin Sadler, Abin George
+// Servo calibration for the arm module. Sweeps each servo over its duty
+// range, measures the joint angle, picks the breakpoints of a piecewise
+// linear table and writes the calibration file loaded by arm.ko at init.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "arm_ioctl.h"
+
+#define ARM_DEV		"/dev/arm"
+
+// ARM_DEV in the environment picks another arm, e.g. /dev/arm1
+static const char *arm_device(void){
+	const char *dev = getenv("ARM_DEV");
+
+	return dev ? dev : ARM_DEV;
+}
+
+// Duty range of the servos, same as arm.c
+#define DUTY_MIN	200
+#define DUTY_MAX	900
+#define SWEEP_STEP	10	// us between measurements
+#define SETTLE_US	300000	// time for a real servo to reach a new duty time
+
+#define MAX_SAMPLES	((DUTY_MAX - DUTY_MIN) / SWEEP_STEP + 1)
+
+static const char *motors[ARM_TOT_MOTOR] = { "wrist", "elbow", "grip" };
+
+// Nominal angle range of each servo, the defaults of arm.ko
+static const int nominal_min[ARM_TOT_MOTOR] = { 0, -90000, 0 };
+static const int nominal_max[ARM_TOT_MOTOR] = { 90000, 90000, 90000 };
+
+// Simulated servo: gain and offset errors plus a bowed response
+struct sim_servo {
+	double offset;	// mdeg
+	double gain;	// relative to nominal
+	double bow;	// mdeg at mid range
+};
+
+static const struct sim_servo sim[ARM_TOT_MOTOR] = {
+	{  2500, 0.94,  4000 },
+	{ -1800, 1.07, -6000 },
+	{   900, 0.90,  2500 },
+};
+
+static int measure_sim(int motor, int duty){
+	double t = (double) (duty - DUTY_MIN) / (DUTY_MAX - DUTY_MIN);
+	double span = nominal_max[motor] - nominal_min[motor];
+	double noise = ((rand() % 201) - 100);	// +-0.1 deg
+
+	return (int) (nominal_min[motor] + sim[motor].offset + sim[motor].gain * span * t +
+		sim[motor].bow * sin(M_PI * t) + noise);
+}
+
+// On the real arm the operator reads the angle off a protractor
+static int measure_manual(int fd, int motor, int duty){
+	struct arm_joints joints;
+	double angle;
+	int i;
+
+	for(i = 0; i < ARM_TOT_MOTOR; i++)
+		joints.duty[i] = -1;
+	joints.duty[motor] = duty;
+	if(ioctl(fd, ARM_IOC_SET_DUTY, &joints) < 0) {
+		perror("ARM_IOC_SET_DUTY");
+		exit(1);
+	}
+	usleep(SETTLE_US);
+
+	printf("%s at %d us, angle in degrees: ", motors[motor], duty);
+	fflush(stdout);
+	if(scanf("%lf", &angle) != 1)
+		exit(1);
+	return (int) (angle * 1000.0);
+}
+
+// Linear interpolation over the chosen breakpoints
+static int interp(const struct arm_calibration *cal, int duty){
+	int i = 1;
+	const struct arm_cal_point *p = cal->points;
+
+	while(i < (int) cal->count - 1 && duty > p[i].duty)
+		i++;
+	return p[i - 1].angle + (int) ((long long) (p[i].angle - p[i - 1].angle) * (duty - p[i - 1].duty) /
+		(p[i].duty - p[i - 1].duty));
+}
+
+static int max_error(const struct arm_calibration *cal, const int *duty, const int *angle, int n, int *worst){
+	int i, err, max = -1;
+
+	for(i = 0; i < n; i++) {
+		err = abs(interp(cal, duty[i]) - angle[i]);
+		if(err > max) {
+			max = err;
+			*worst = i;
+		}
+	}
+	return max;
+}
+
+// Greedy fit: start from the end points and keep adding the sample the table is furthest from
+static void fit(struct arm_calibration *cal, const int *duty, const int *angle, int n){
+	int worst = 0, i, j;
+
+	cal->count = 2;
+	cal->points[0].duty = duty[0];
+	cal->points[0].angle = angle[0];
+	cal->points[1].duty = duty[n - 1];
+	cal->points[1].angle = angle[n - 1];
+
+	while(cal->count < ARM_CAL_POINTS && max_error(cal, duty, angle, n, &worst) > 0) {
+		for(i = 0; i < (int) cal->count && cal->points[i].duty < duty[worst]; i++)
+			;
+		if(cal->points[i].duty == duty[worst])
+			break;
+		for(j = cal->count; j > i; j--)
+			cal->points[j] = cal->points[j - 1];
+		cal->points[i].duty = duty[worst];
+		cal->points[i].angle = angle[worst];
+		cal->count++;
+	}
+}
+
+// Measures one servo and fits its table
+static void calibrate(int fd, int motor, struct arm_calibration *cal){
+	int duty[MAX_SAMPLES], angle[MAX_SAMPLES];
+	struct arm_calibration linear;
+	int n, worst, err_linear, err_table;
+
+	for(n = 0; n < MAX_SAMPLES; n++) {
+		duty[n] = DUTY_MIN + n * SWEEP_STEP;
+		angle[n] = (fd < 0) ? measure_sim(motor, duty[n]) : measure_manual(fd, motor, duty[n]);
+	}
+
+	memset(cal, 0, sizeof(*cal));
+	cal->motor = motor;
+	fit(cal, duty, angle, n);
+
+	// Compare with the two point calibration arm.ko assumes without a file
+	memset(&linear, 0, sizeof(linear));
+	linear.count = 2;
+	linear.points[0].duty = DUTY_MIN;
+	linear.points[0].angle = nominal_min[motor];
+	linear.points[1].duty = DUTY_MAX;
+	linear.points[1].angle = nominal_max[motor];
+	err_linear = max_error(&linear, duty, angle, n, &worst);
+	err_table = max_error(cal, duty, angle, n, &worst);
+
+	printf("%-6s %2u points, max error %7.3f deg (linear %7.3f deg)\n", motors[motor], cal->count,
+		err_table / 1000.0, err_linear / 1000.0);
+}
+
+static int write_file(const char *path, const struct arm_calibration *cal, int count){
+	struct arm_cal_header header;
+	FILE *f;
+
+	f = fopen(path, "wb");
+	if(!f) {
+		perror(path);
+		return -1;
+	}
+
+	header.magic = ARM_CAL_MAGIC;
+	header.version = ARM_CAL_VERSION;
+	header.count = count;
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(cal, sizeof(*cal), count, f);
+	fclose(f);
+
+	printf("Wrote %s, copy it to /lib/firmware\n", path);
+	return 0;
+}
+
+static int read_file(const char *path, struct arm_calibration *cal){
+	struct arm_cal_header header;
+	FILE *f;
+	int count;
+
+	f = fopen(path, "rb");
+	if(!f) {
+		perror(path);
+		return -1;
+	}
+
+	if(fread(&header, sizeof(header), 1, f) != 1 || header.magic != ARM_CAL_MAGIC ||
+	   header.version != ARM_CAL_VERSION || header.count > ARM_TOT_MOTOR) {
+		printf("%s is not a calibration file\n", path);
+		fclose(f);
+		return -1;
+	}
+
+	count = fread(cal, sizeof(*cal), header.count, f);
+	fclose(f);
+	return count;
+}
+
+static int upload(int fd, const struct arm_calibration *cal, int count){
+	int i;
+
+	for(i = 0; i < count; i++) {
+		if(ioctl(fd, ARM_IOC_SET_CAL, &cal[i]) < 0) {
+			perror("ARM_IOC_SET_CAL");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void show(int fd){
+	struct arm_calibration cal;
+	unsigned int i, motor;
+
+	for(motor = 0; motor < ARM_TOT_MOTOR; motor++) {
+		memset(&cal, 0, sizeof(cal));
+		cal.motor = motor;
+		if(ioctl(fd, ARM_IOC_GET_CAL, &cal) < 0) {
+			perror("ARM_IOC_GET_CAL");
+			return;
+		}
+		printf("%s:", motors[motor]);
+		for(i = 0; i < cal.count; i++)
+			printf(" %d:%.1f", cal.points[i].duty, cal.points[i].angle / 1000.0);
+		printf("\n");
+	}
+}
+
+static void usage(const char *name){
+	printf("Usage:\n");
+	printf("  %s sim [FILE]      calibrate against the servo simulator\n", name);
+	printf("  %s manual [FILE]   calibrate the arm, reading angles off a protractor\n", name);
+	printf("  %s upload FILE     load a calibration file without reinserting arm.ko\n", name);
+	printf("  %s show            print the calibration in use\n", name);
+}
+
+int main(int argc, char **argv) {
+	struct arm_calibration cal[ARM_TOT_MOTOR];
+	const char *path = (argc >= 3) ? argv[2] : ARM_CAL_FIRMWARE;
+	int fd = -1, motor, count, err = 0;
+
+	if(argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if(strcmp(argv[1], "sim") != 0) {
+		fd = open(arm_device(), O_RDWR);
+		if(fd < 0) {
+			perror(arm_device());
+			return 1;
+		}
+	}
+
+	if(strcmp(argv[1], "sim") == 0 || strcmp(argv[1], "manual") == 0) {
+		srand(535);
+		for(motor = 0; motor < ARM_TOT_MOTOR; motor++)
+			calibrate(fd, motor, &cal[motor]);
+		err = write_file(path, cal, ARM_TOT_MOTOR);
+		if(!err && fd >= 0)
+			err = upload(fd, cal, ARM_TOT_MOTOR);
+	} else if(strcmp(argv[1], "upload") == 0 && argc == 3) {
+		count = read_file(path, cal);
+		err = (count < 0) ? -1 : upload(fd, cal, count);
+	} else if(strcmp(argv[1], "show") == 0) {
+		show(fd);
+	} else {
+		usage(argv[0]);
+		err = -1;
+	}
+
+	if(fd >= 0)
+		close(fd);
+	return err ? 1 : 0;
+}
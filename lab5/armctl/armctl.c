@@ -0,0 +1,303 @@
+// Name: Justin Sadler, Abin George
+// Command line front end for the /dev/arm character device
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "arm_ioctl.h"
+
+#define ARM_DEV	"/dev/arm"
+
+// ARM_DEV in the environment picks another arm, e.g. /dev/arm1
+static const char *arm_device(void){
+	const char *dev = getenv("ARM_DEV");
+
+	return dev ? dev : ARM_DEV;
+}
+
+static const char *motors[ARM_TOT_MOTOR] = { "wrist", "elbow", "grip" };
+
+// Positions are typed in millimetres and sent in micrometres
+static __s32 mm_to_um(const char *arg){
+	return (__s32) (atof(arg) * 1000.0);
+}
+
+static void print_joints(const struct arm_joints *joints){
+	int i;
+
+	for(i = 0; i < ARM_TOT_MOTOR; i++)
+		printf("%-6s %8.3f deg %5d us\n", motors[i], joints->angle[i] / 1000.0, joints->duty[i]);
+}
+
+static void print_position(const struct arm_cartesian *pos){
+	printf("x %.3f mm  y %.3f mm  z %.3f mm  grip %d us\n",
+		pos->x / 1000.0, pos->y / 1000.0, pos->z / 1000.0, pos->grip);
+}
+
+static void usage(const char *name){
+	printf("Usage:\n");
+	printf("  %s move X Y Z [GRIP_US [MS]]   straight line move, positions in mm\n", name);
+	printf("  %s solve X Y Z                 inverse kinematics only\n", name);
+	printf("  %s pose                        current position of the arm\n", name);
+	printf("  %s rate X                      sequence playback rate, 0.1 to 4 times\n", name);
+	printf("  %s dwell N|all MS              dwell at waypoint N (from 1), or at all\n", name);
+	printf("  %s blend US                    pass waypoints without a dwell within US, 0 stops at all\n", name);
+	printf("  %s cycle                       playback rate, loop times and position feedback\n", name);
+	printf("  %s sync [N:BARRIER ...|clear]  sync points with the other arms, waypoints from 1\n", name);
+	printf("  %s start ARM[,ARM...]          start the sequences of several arms together\n", name);
+	printf("  %s envelope                    the safety envelope\n", name);
+	printf("  %s limit JOINT MIN MAX         duty time range of a joint, in us\n", name);
+	printf("  %s speed US_PER_S              max velocity of every joint, 0 for none\n", name);
+	printf("  %s keepout J1 MIN MAX J2 MIN MAX   forbid a region of two joints\n", name);
+	printf("  %s keepout clear               remove all keep-out zones\n", name);
+}
+
+static void print_cycle(const struct arm_telemetry *t){
+	int i;
+
+	printf("rate %.2fx", t->seq_rate / 1000.0);
+	if(t->seq_rate_target != t->seq_rate)
+		printf(" (ramping to %.2fx)", t->seq_rate_target / 1000.0);
+	printf(", %s, %u waypoints", t->seq_active ? "running" : "stopped", t->seq_total);
+	if(t->seq_blend_us)
+		printf(", blending within %u us", t->seq_blend_us);
+	printf("\n");
+	if(t->fb_duty[0] >= 0 || t->fb_duty[1] >= 0 || t->fb_duty[2] >= 0) {
+		printf("measured");
+		for(i = 0; i < ARM_TOT_MOTOR; i++) {
+			if(t->fb_duty[i] >= 0)
+				printf(" %s %d us", motors[i], t->fb_duty[i]);
+			else
+				printf(" %s -", motors[i]);
+		}
+		printf(", last settle %u ms, %u timeouts\n", t->seq_settle_ms, t->seq_fb_timeouts);
+	}
+	if(t->seq_barrier >= 0)
+		printf("waiting at barrier %d for the other arms\n", t->seq_barrier);
+	else if(t->seq_barrier_ms)
+		printf("last barrier wait %u ms\n", t->seq_barrier_ms);
+	if(t->seq_cycles == 0) {
+		printf("no loop completed\n");
+		return;
+	}
+	printf("%u loops, last %.3f s, avg %.3f s, min %.3f s, max %.3f s\n", t->seq_cycles,
+		t->seq_cycle_us / 1e6, t->seq_cycle_avg_us / 1e6, t->seq_cycle_min_us / 1e6, t->seq_cycle_max_us / 1e6);
+}
+
+static void print_sync(const struct arm_sync *sync){
+	unsigned int i;
+
+	if(sync->count == 0)
+		printf("no sync points\n");
+	for(i = 0; i < sync->count; i++)
+		printf("waypoint %u barrier %u\n", sync->points[i].waypoint + 1, sync->points[i].barrier);
+}
+
+// Sync points typed as WAYPOINT:BARRIER, waypoints counting from 1
+static int parse_sync(struct arm_sync *sync, int argc, char **argv){
+	unsigned int waypoint, barrier;
+	int i;
+
+	memset(sync, 0, sizeof(*sync));
+	if(argc == 1 && strcmp(argv[0], "clear") == 0)
+		return 0;
+	if(argc > ARM_SYNC_POINTS) {
+		printf("At most %d sync points\n", ARM_SYNC_POINTS);
+		return -1;
+	}
+	for(i = 0; i < argc; i++) {
+		if(sscanf(argv[i], "%u:%u", &waypoint, &barrier) != 2 || waypoint == 0) {
+			printf("Bad sync point %s, WAYPOINT:BARRIER\n", argv[i]);
+			return -1;
+		}
+		sync->points[i].waypoint = waypoint - 1;
+		sync->points[i].barrier = barrier;
+	}
+	sync->count = argc;
+	return 0;
+}
+
+// Arms typed as 0,1,2
+static __u32 parse_arms(const char *arg){
+	unsigned long arm;
+	__u32 mask = 0;
+	char *end;
+
+	do {
+		arm = strtoul(arg, &end, 10);
+		if(end == arg || arm >= 32)
+			return 0;
+		mask |= 1u << arm;
+		arg = end + 1;
+	} while(*end == ',');
+	return *end ? 0 : mask;
+}
+
+static int joint_index(const char *arg){
+	int i;
+
+	for(i = 0; i < ARM_TOT_MOTOR; i++)
+		if(strcmp(arg, motors[i]) == 0)
+			return i;
+	printf("Unknown joint %s, one of wrist, elbow, grip\n", arg);
+	return -1;
+}
+
+static void print_envelope(const struct arm_envelope *env){
+	const struct arm_keepout *zone;
+	unsigned int i;
+
+	for(i = 0; i < ARM_TOT_MOTOR; i++) {
+		printf("%-6s %4d..%-4d us", motors[i], env->duty_min[i], env->duty_max[i]);
+		if(env->max_velocity[i])
+			printf("  max %u us/s", env->max_velocity[i]);
+		printf("\n");
+	}
+	for(i = 0; i < env->keepout_count; i++) {
+		zone = &env->keepout[i];
+		printf("keep out %s %d..%d with %s %d..%d\n", motors[zone->joint_a], zone->a_min, zone->a_max,
+			motors[zone->joint_b], zone->b_min, zone->b_max);
+	}
+}
+
+// Changes part of the envelope, the rest is read back from the module
+static int edit_envelope(int fd, int argc, char **argv){
+	struct arm_envelope env;
+	struct arm_keepout *zone;
+	int i, a, b;
+
+	if(ioctl(fd, ARM_IOC_GET_ENVELOPE, &env) < 0)
+		return -1;
+
+	if(strcmp(argv[1], "limit") == 0 && argc == 5) {
+		a = joint_index(argv[2]);
+		if(a < 0)
+			return -1;
+		env.duty_min[a] = atoi(argv[3]);
+		env.duty_max[a] = atoi(argv[4]);
+	} else if(strcmp(argv[1], "speed") == 0 && argc == 3) {
+		for(i = 0; i < ARM_TOT_MOTOR; i++)
+			env.max_velocity[i] = atoi(argv[2]);
+	} else if(strcmp(argv[1], "keepout") == 0 && argc == 3 && strcmp(argv[2], "clear") == 0) {
+		env.keepout_count = 0;
+	} else if(strcmp(argv[1], "keepout") == 0 && argc == 8) {
+		a = joint_index(argv[2]);
+		b = joint_index(argv[5]);
+		if(a < 0 || b < 0)
+			return -1;
+		if(env.keepout_count >= ARM_ENV_KEEPOUTS) {
+			printf("At most %d keep-out zones\n", ARM_ENV_KEEPOUTS);
+			return -1;
+		}
+		zone = &env.keepout[env.keepout_count++];
+		zone->joint_a = a;
+		zone->a_min = atoi(argv[3]);
+		zone->a_max = atoi(argv[4]);
+		zone->joint_b = b;
+		zone->b_min = atoi(argv[6]);
+		zone->b_max = atoi(argv[7]);
+	} else {
+		usage(argv[0]);
+		return -1;
+	}
+
+	return ioctl(fd, ARM_IOC_SET_ENVELOPE, &env);
+}
+
+int main(int argc, char **argv) {
+	struct arm_cartesian target;
+	struct arm_ik_query query;
+	struct arm_pose pose;
+	struct arm_seq_dwell dwell;
+	struct arm_telemetry telem;
+	struct arm_envelope env;
+	struct arm_sync sync;
+	__u32 rate, mask, blend;
+	int fd, err;
+
+	if(argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	fd = open(arm_device(), O_RDWR);
+	if(fd < 0) {
+		perror(arm_device());
+		return 1;
+	}
+
+	memset(&target, 0, sizeof(target));
+	target.grip = -1;
+
+	if(strcmp(argv[1], "move") == 0 && argc >= 5) {
+		target.x = mm_to_um(argv[2]);
+		target.y = mm_to_um(argv[3]);
+		target.z = mm_to_um(argv[4]);
+		if(argc >= 6)
+			target.grip = atoi(argv[5]);
+		if(argc >= 7)
+			target.duration_ms = atoi(argv[6]);
+		err = ioctl(fd, ARM_IOC_MOVE_CARTESIAN, &target);
+	} else if(strcmp(argv[1], "solve") == 0 && argc == 5) {
+		memset(&query, 0, sizeof(query));
+		query.target = target;
+		query.target.x = mm_to_um(argv[2]);
+		query.target.y = mm_to_um(argv[3]);
+		query.target.z = mm_to_um(argv[4]);
+		err = ioctl(fd, ARM_IOC_SOLVE_CARTESIAN, &query);
+		if(err == 0) {
+			print_joints(&query.joints);
+			printf("reach error %.3f mm\n", query.reach_error / 1000.0);
+		}
+	} else if(strcmp(argv[1], "pose") == 0) {
+		err = ioctl(fd, ARM_IOC_GET_POSE, &pose);
+		if(err == 0) {
+			print_position(&pose.position);
+			print_joints(&pose.joints);
+		}
+	} else if(strcmp(argv[1], "rate") == 0 && argc == 3) {
+		rate = (__u32) (atof(argv[2]) * 1000.0 + 0.5);
+		err = ioctl(fd, ARM_IOC_SET_RATE, &rate);
+	} else if(strcmp(argv[1], "dwell") == 0 && argc == 4) {
+		dwell.index = (strcmp(argv[2], "all") == 0) ? ARM_SEQ_ALL : (__u32) (atoi(argv[2]) - 1);
+		dwell.dwell_ms = atoi(argv[3]);
+		err = ioctl(fd, ARM_IOC_SET_DWELL, &dwell);
+	} else if(strcmp(argv[1], "blend") == 0 && argc == 3) {
+		blend = atoi(argv[2]);
+		err = ioctl(fd, ARM_IOC_SET_BLEND, &blend);
+	} else if(strcmp(argv[1], "cycle") == 0) {
+		err = (read(fd, &telem, sizeof(telem)) == sizeof(telem)) ? 0 : -1;
+		if(err == 0)
+			print_cycle(&telem);
+	} else if(strcmp(argv[1], "sync") == 0 && argc == 2) {
+		err = ioctl(fd, ARM_IOC_GET_SYNC, &sync);
+		if(err == 0)
+			print_sync(&sync);
+	} else if(strcmp(argv[1], "sync") == 0) {
+		err = parse_sync(&sync, argc - 2, argv + 2);
+		if(err == 0)
+			err = ioctl(fd, ARM_IOC_SET_SYNC, &sync);
+	} else if(strcmp(argv[1], "start") == 0 && argc == 3) {
+		mask = parse_arms(argv[2]);
+		err = ioctl(fd, ARM_IOC_START_ARMS, &mask);
+	} else if(strcmp(argv[1], "envelope") == 0) {
+		err = ioctl(fd, ARM_IOC_GET_ENVELOPE, &env);
+		if(err == 0)
+			print_envelope(&env);
+	} else if(strcmp(argv[1], "limit") == 0 || strcmp(argv[1], "speed") == 0 || strcmp(argv[1], "keepout") == 0) {
+		err = edit_envelope(fd, argc, argv);
+	} else {
+		usage(argv[0]);
+		close(fd);
+		return 1;
+	}
+
+	if(err)
+		perror(argv[1]);
+
+	close(fd);
+	return err ? 1 : 0;
+}
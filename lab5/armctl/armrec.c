@@ -0,0 +1,643 @@
+// Name: Justin Sadler, Abin George
+// Records the keyboard input of the arm module to an input log, and replays
+// it, into the module or into a simulation of the jog keys, to compare the
+// setpoints they give with the recorded ones.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "arm_ioctl.h"
+
+#define ARM_DEV		"/dev/arm"
+
+// ARM_DEV in the environment picks another arm, e.g. /dev/arm1
+static const char *arm_device(void){
+	const char *dev = getenv("ARM_DEV");
+
+	return dev ? dev : ARM_DEV;
+}
+
+#define DRAIN_EVENTS	1024
+#define DRAIN_MS	100
+#define EVENT_MAX	60	// encoded bytes of an event, six varints
+
+// Keys as keys_pressed in arm.c sees them
+#define KBD_KEYSYM	0x0004
+#define KEY_UP		0xF603
+#define KEY_DOWN	0xF600
+#define KEY_RIGHT	0xF602
+#define KEY_LEFT	0xF601
+#define KEY_ENTER	0xF201
+#define KEY_GRIP	0xFB67
+#define KEY_UNGRIP	0xFB68
+#define KEY_F1		0xF100
+
+enum { WRIST, ELBOW, GRIP };
+
+// A whole log in memory
+struct input_log {
+	struct arm_input_header header;
+	struct arm_input_event *events;
+	uint32_t count;
+	uint32_t room;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig){
+	(void) sig;
+	stop = 1;
+}
+
+// CRC32 as in zlib, the checksum of the event bytes
+static uint32_t crc32(const unsigned char *data, size_t size){
+	uint32_t crc = 0xffffffff;
+	size_t i;
+	int bit;
+
+	for(i = 0; i < size; i++) {
+		crc ^= data[i];
+		for(bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static unsigned char *put_varint(unsigned char *p, uint64_t value){
+	do {
+		*p = value & 0x7f;
+		value >>= 7;
+		if(value)
+			*p |= 0x80;
+		p++;
+	} while(value);
+	return p;
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end, uint64_t *value){
+	int shift = 0;
+
+	*value = 0;
+	do {
+		if(*p >= end || shift > 63)
+			return -1;
+		*value |= (uint64_t) (**p & 0x7f) << shift;
+		shift += 7;
+	} while(*(*p)++ & 0x80);
+	return 0;
+}
+
+static uint32_t zigzag(int32_t value){
+	return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static int32_t unzigzag(uint64_t value){
+	return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static int log_add(struct input_log *log, const struct arm_input_event *event){
+	struct arm_input_event *events;
+
+	if(log->count == log->room) {
+		log->room = log->room ? 2 * log->room : 4096;
+		events = realloc(log->events, log->room * sizeof(*events));
+		if(!events)
+			return -1;
+		log->events = events;
+	}
+	log->events[log->count++] = *event;
+	return 0;
+}
+
+static int log_write(const struct input_log *log, const char *path){
+	struct arm_input_header header = log->header;
+	unsigned char *data, *p;
+	uint64_t last = header.start.time_ns;
+	const struct arm_input_event *event;
+	uint32_t i;
+	FILE *f;
+	int err = -1;
+
+	data = malloc((size_t) log->count * EVENT_MAX + 1);
+	if(!data)
+		return -1;
+	p = data;
+	for(i = 0; i < log->count; i++) {
+		event = &log->events[i];
+		p = put_varint(p, event->time_ns - last);
+		p = put_varint(p, event->type);
+		p = put_varint(p, event->action);
+		p = put_varint(p, event->code);
+		p = put_varint(p, zigzag(event->value));
+		p = put_varint(p, zigzag(event->aux));
+		last = event->time_ns;
+	}
+
+	header.magic = ARM_INPUT_MAGIC;
+	header.version = ARM_INPUT_VERSION;
+	header.header_size = sizeof(header);
+	header.count = log->count;
+	header.size = p - data;
+	header.checksum = crc32(data, header.size);
+
+	f = fopen(path, "wb");
+	if(!f) {
+		perror(path);
+		goto out;
+	}
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(data, 1, header.size, f);
+	fclose(f);
+	printf("Wrote %s, %u events in %u bytes (%zu as arm_input_event)\n", path, header.count,
+		(unsigned int) (sizeof(header) + header.size), log->count * sizeof(struct arm_input_event));
+	err = 0;
+
+out:
+	free(data);
+	return err;
+}
+
+static int log_read(struct input_log *log, const char *path){
+	unsigned char *data = NULL;
+	const unsigned char *p, *end;
+	struct arm_input_event event;
+	uint64_t time_ns, value[6];
+	long size;
+	uint32_t i;
+	FILE *f;
+	int field, err = -1;
+
+	memset(log, 0, sizeof(*log));
+	f = fopen(path, "rb");
+	if(!f) {
+		perror(path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(size > 0 ? size : 1);
+	if(!data || fread(data, 1, size, f) != (size_t) size) {
+		fclose(f);
+		goto out;
+	}
+	fclose(f);
+
+	if(size < (long) sizeof(log->header)) {
+		printf("%s is not an input log\n", path);
+		goto out;
+	}
+	memcpy(&log->header, data, sizeof(log->header));
+	if(log->header.magic != ARM_INPUT_MAGIC ||
+	   log->header.version != ARM_INPUT_VERSION || log->header.header_size < sizeof(log->header) ||
+	   (uint64_t) log->header.header_size + log->header.size > (uint64_t) size) {
+		printf("%s is not an input log\n", path);
+		goto out;
+	}
+	p = data + log->header.header_size;
+	end = p + log->header.size;
+	if(crc32(p, log->header.size) != log->header.checksum) {
+		printf("%s is damaged\n", path);
+		goto out;
+	}
+
+	time_ns = log->header.start.time_ns;
+	for(i = 0; i < log->header.count; i++) {
+		for(field = 0; field < 6; field++) {
+			if(get_varint(&p, end, &value[field])) {
+				printf("%s is damaged\n", path);
+				goto out;
+			}
+		}
+		time_ns += value[0];
+		event.time_ns = time_ns;
+		event.type = value[1];
+		event.action = value[2];
+		event.code = value[3];
+		event.value = unzigzag(value[4]);
+		event.aux = unzigzag(value[5]);
+		if(log_add(log, &event))
+			goto out;
+	}
+	err = 0;
+
+out:
+	free(data);
+	return err;
+}
+
+// Drains what the module recorded so far into the log
+static int drain(int fd, struct input_log *log){
+	struct arm_input_event events[DRAIN_EVENTS];
+	struct arm_input_io io;
+	uint32_t i;
+
+	do {
+		memset(&io, 0, sizeof(io));
+		io.count = DRAIN_EVENTS;
+		io.events = (uintptr_t) events;
+		if(ioctl(fd, ARM_IOC_GET_RECORDING, &io) < 0) {
+			perror("ARM_IOC_GET_RECORDING");
+			return -1;
+		}
+		for(i = 0; i < io.count; i++) {
+			if(log_add(log, &events[i]))
+				return -1;
+		}
+		log->header.lost = io.lost;
+	} while(io.count == DRAIN_EVENTS);
+	return 0;
+}
+
+// Records until ^C, or for 'seconds'
+static int record(int fd, const char *path, double seconds){
+	struct input_log log;
+	struct timespec now, end;
+	__u32 on = 1;
+	int err = -1;
+
+	memset(&log, 0, sizeof(log));
+	if(ioctl(fd, ARM_IOC_RECORD, &on) < 0 || ioctl(fd, ARM_IOC_GET_INPUT_START, &log.header.start) < 0) {
+		perror("ARM_IOC_RECORD");
+		return -1;
+	}
+	printf("Recording, ^C to stop\n");
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += (time_t) seconds;
+	signal(SIGINT, on_signal);
+	while(!stop) {
+		usleep(DRAIN_MS * 1000);
+		if(drain(fd, &log))
+			goto out;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if(seconds > 0 && (now.tv_sec > end.tv_sec || (now.tv_sec == end.tv_sec && now.tv_nsec >= end.tv_nsec)))
+			break;
+	}
+
+	on = 0;
+	ioctl(fd, ARM_IOC_RECORD, &on);
+	if(drain(fd, &log))
+		goto out;
+	if(log.header.lost)
+		printf("%u events were lost, drain more often or raise rec_events\n", log.header.lost);
+	err = log_write(&log, path);
+
+out:
+	free(log.events);
+	return err;
+}
+
+static void print_event(const struct arm_input_event *event, uint64_t start){
+	printf("%12.6f ms ", (event->time_ns - start) / 1e6);
+	if(event->type == ARM_INPUT_KEY)
+		printf("key    action %u keysym 0x%04x %s shift 0x%x\n", event->action, event->code,
+			event->value ? "down" : "up", event->aux);
+	else if(event->type == ARM_INPUT_SETPOINT)
+		printf("setpoint channel %u duty %.3f us%s\n", event->code, event->value / 1e3, event->aux ? " refused" : "");
+	else
+		printf("type %u\n", event->type);
+}
+
+static int show(const char *path){
+	struct input_log log;
+	const struct arm_input_start *start = &log.header.start;
+	uint32_t i;
+	int arm;
+
+	if(log_read(&log, path))
+		return -1;
+
+	printf("%u events, %u lost, %u arms, keyboard on arm %u, keys step %.3f us%s\n", log.count, log.header.lost,
+		start->arms, start->key_arm, start->key_step_ns / 1e3,
+		(start->flags & ARM_INPUT_INEXACT) ? ", envelope not simulated" : "");
+	for(arm = 0; arm < (int) start->arms && arm < ARM_INPUT_ARMS; arm++)
+		printf("arm %d at %.3f %.3f %.3f us\n", arm, start->duty[arm][WRIST] / 1e3, start->duty[arm][ELBOW] / 1e3,
+			start->duty[arm][GRIP] / 1e3);
+	for(i = 0; i < log.count; i++)
+		print_event(&log.events[i], start->time_ns);
+
+	free(log.events);
+	return 0;
+}
+
+// Compares the setpoints of two logs in order, skipping those of the arms
+// in 'skip' of the first one. Prints the first difference.
+static int compare(const struct input_log *a, const struct input_log *b, const uint32_t *skip){
+	uint32_t i = 0, j = 0, n = 0;
+	const struct arm_input_event *x, *y;
+
+	for(;;) {
+		while(i < a->count && (a->events[i].type != ARM_INPUT_SETPOINT || (skip && skip[i])))
+			i++;
+		while(j < b->count && b->events[j].type != ARM_INPUT_SETPOINT)
+			j++;
+		if(i == a->count || j == b->count)
+			break;
+		x = &a->events[i++];
+		y = &b->events[j++];
+		if(x->code != y->code || x->value != y->value || x->aux != y->aux) {
+			printf("Setpoint %u differs: channel %u duty %d ns%s, then channel %u duty %d ns%s\n", n,
+				x->code, x->value, x->aux ? " refused" : "", y->code, y->value, y->aux ? " refused" : "");
+			return 1;
+		}
+		n++;
+	}
+	while(j < b->count && b->events[j].type != ARM_INPUT_SETPOINT)
+		j++;
+	if(i != a->count || j != b->count) {
+		printf("Setpoints differ in number, the same for the first %u\n", n);
+		return 1;
+	}
+	printf("%u setpoints identical\n", n);
+	return 0;
+}
+
+// The jog keys as keyEvent in arm.c handles them, in ns: the servo range,
+// then the joint limits of the envelope. A sequence started with Enter owns
+// the servos of its arm, which are not simulated from there on; keep-out
+// zones, velocity limits and the joystick are not simulated at all.
+static int simulate(const struct input_log *log, struct input_log *out, uint32_t *skip){
+	const struct arm_input_start *start = &log->header.start;
+	const struct arm_input_event *event;
+	struct arm_input_event setpoint;
+	int32_t duty[ARM_INPUT_ARMS][ARM_TOT_MOTOR];
+	int running[ARM_INPUT_ARMS] = { 0 };
+	int key_arm = start->key_arm, arms = start->arms;
+	int key_step = start->key_step_ns;
+	int joint, step, value;
+	uint32_t i;
+
+	if(arms < 1 || arms > ARM_INPUT_ARMS || key_arm >= arms) {
+		printf("Bad start state\n");
+		return -1;
+	}
+	memcpy(duty, start->duty, sizeof(duty));
+	out->header = log->header;
+
+	for(i = 0; i < log->count; i++) {
+		event = &log->events[i];
+		if(event->type == ARM_INPUT_SETPOINT) {
+			// The CRC does not catch a log that was edited
+			if(event->code >= (uint32_t) arms * ARM_TOT_MOTOR) {
+				printf("Setpoint %u of channel %u, the log has %d arms\n", i, event->code, arms);
+				return -1;
+			}
+			skip[i] = running[event->code / ARM_TOT_MOTOR];
+			continue;
+		}
+		skip[i] = 0;
+		if(log_add(out, event))
+			return -1;
+		if(event->type != ARM_INPUT_KEY || event->action != KBD_KEYSYM || !event->value || event->aux)
+			continue;
+
+		if(event->code >= KEY_F1 && event->code < KEY_F1 + (unsigned int) arms) {
+			key_arm = event->code - KEY_F1;
+			continue;
+		}
+		switch(event->code) {
+			case KEY_UP:	 joint = WRIST; step = key_step; break;
+			case KEY_DOWN:	 joint = WRIST; step = -key_step; break;
+			case KEY_LEFT:	 joint = ELBOW; step = -key_step; break;
+			case KEY_RIGHT:	 joint = ELBOW; step = key_step; break;
+			case KEY_GRIP:	 joint = GRIP; step = -key_step; break;
+			case KEY_UNGRIP: joint = GRIP; step = key_step; break;
+			case KEY_ENTER:
+				running[key_arm] = 1;
+				continue;
+			default:
+				continue;
+		}
+		if(running[key_arm])
+			continue;
+
+		value = duty[key_arm][joint] + step;
+		if(value < start->servo_min[key_arm][joint])
+			value = start->servo_min[key_arm][joint];
+		if(value > start->servo_max[key_arm][joint])
+			value = start->servo_max[key_arm][joint];
+		if(value < start->env_min[key_arm][joint])
+			value = start->env_min[key_arm][joint];
+		if(value > start->env_max[key_arm][joint])
+			value = start->env_max[key_arm][joint];
+		duty[key_arm][joint] = value;
+
+		memset(&setpoint, 0, sizeof(setpoint));
+		setpoint.time_ns = event->time_ns;
+		setpoint.type = ARM_INPUT_SETPOINT;
+		setpoint.code = key_arm * ARM_TOT_MOTOR + joint;
+		setpoint.value = value;
+		if(log_add(out, &setpoint))
+			return -1;
+	}
+	return 0;
+}
+
+static int sim(const char *path, const char *out_path){
+	struct input_log log, out;
+	uint32_t *skip = NULL;
+	int err = -1;
+
+	memset(&out, 0, sizeof(out));
+	if(log_read(&log, path))
+		return -1;
+	if(log.header.start.flags & ARM_INPUT_INEXACT)
+		printf("The envelope had keep-out zones or velocity limits, the simulation may differ\n");
+
+	skip = calloc(log.count + 1, sizeof(*skip));
+	if(!skip || simulate(&log, &out, skip))
+		goto out;
+	if(out_path && log_write(&out, out_path))
+		goto out;
+	err = compare(&log, &out, skip);
+
+out:
+	free(skip);
+	free(log.events);
+	free(out.events);
+	return err;
+}
+
+// Puts the arms where they were when the log was recorded and hands the
+// keyboard to the same arm. The sequences are stopped, they would move them.
+static int restore(int fd, const struct arm_input_start *start){
+	struct arm_input_event key;
+	struct arm_joints joints;
+	char base[PATH_MAX], dev[PATH_MAX + 16];
+	__u32 run = 0;
+	size_t length;
+	int arm, joint, armfd, err;
+
+	// The minors of the arms are named after that of ARM_DEV: /dev/arm, /dev/arm1 ...
+	snprintf(base, sizeof(base), "%s", arm_device());
+	length = strlen(base);
+	while(length > 0 && isdigit((unsigned char) base[length - 1]))
+		base[--length] = '\0';
+
+	for(arm = 0; arm < (int) start->arms && arm < ARM_INPUT_ARMS; arm++) {
+		if(arm == 0)
+			snprintf(dev, sizeof(dev), "%s", base);
+		else
+			snprintf(dev, sizeof(dev), "%s%d", base, arm);
+		armfd = open(dev, O_RDWR);
+		if(armfd < 0) {
+			perror(dev);
+			return -1;
+		}
+		memset(&joints, 0, sizeof(joints));
+		for(joint = 0; joint < ARM_TOT_MOTOR; joint++)
+			joints.duty[joint] = start->duty[arm][joint];
+		err = ioctl(armfd, ARM_IOC_RUN_SEQUENCE, &run);
+		if(err == 0)
+			err = ioctl(armfd, ARM_IOC_SET_DUTY_NS, &joints);
+		close(armfd);
+		if(err) {
+			perror(dev);
+			return -1;
+		}
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.type = ARM_INPUT_KEY;
+	key.action = KBD_KEYSYM;
+	key.code = KEY_F1 + start->key_arm;
+	key.value = 1;
+	return ioctl(fd, ARM_IOC_INPUT_KEY, &key);
+}
+
+// Feeds the keys of a log back into the module, at the times they were
+// recorded or as fast as it takes them, recording what they give
+static int replay(int fd, const char *path, int fast, const char *out_path){
+	struct input_log log, out;
+	const struct arm_input_event *event;
+	struct timespec begin, due;
+	uint64_t offset;
+	__u32 on = 1;
+	uint32_t i;
+	int err = -1;
+
+	memset(&out, 0, sizeof(out));
+	if(log_read(&log, path))
+		return -1;
+	if(log.header.start.flags & ARM_INPUT_INEXACT)
+		printf("The envelope had keep-out zones or velocity limits, the replay may differ\n");
+
+	if(restore(fd, &log.header.start)) {
+		perror("restore");
+		goto out;
+	}
+	if(ioctl(fd, ARM_IOC_RECORD, &on) < 0 || ioctl(fd, ARM_IOC_GET_INPUT_START, &out.header.start) < 0) {
+		perror("ARM_IOC_RECORD");
+		goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for(i = 0; i < log.count; i++) {
+		event = &log.events[i];
+		if(event->type != ARM_INPUT_KEY)
+			continue;
+		if(!fast) {
+			offset = event->time_ns - log.header.start.time_ns;
+			due.tv_sec = begin.tv_sec + (begin.tv_nsec + offset) / 1000000000;
+			due.tv_nsec = (begin.tv_nsec + offset) % 1000000000;
+			while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)
+				;
+		}
+		if(ioctl(fd, ARM_IOC_INPUT_KEY, event) < 0) {
+			perror("ARM_IOC_INPUT_KEY");
+			goto out;
+		}
+		// Keep the ring from filling up on a long log
+		if(fast && i % (DRAIN_EVENTS / 4) == 0 && drain(fd, &out))
+			goto out;
+	}
+
+	on = 0;
+	ioctl(fd, ARM_IOC_RECORD, &on);
+	if(drain(fd, &out))
+		goto out;
+	if(out.header.lost)
+		printf("%u events were lost, raise rec_events\n", out.header.lost);
+	if(out_path && log_write(&out, out_path))
+		goto out;
+	err = compare(&log, &out, NULL);
+
+out:
+	free(log.events);
+	free(out.events);
+	return err;
+}
+
+static int diff(const char *a_path, const char *b_path){
+	struct input_log a, b;
+	int err = -1;
+
+	memset(&b, 0, sizeof(b));
+	if(log_read(&a, a_path))
+		return -1;
+	if(log_read(&b, b_path) == 0)
+		err = compare(&a, &b, NULL);
+	free(a.events);
+	free(b.events);
+	return err;
+}
+
+static void usage(const char *name){
+	printf("Usage:\n");
+	printf("  %s record FILE [SECONDS]        record the keyboard input until ^C\n", name);
+	printf("  %s show FILE                    print the events of a log\n", name);
+	printf("  %s replay FILE [fast] [OUT]     feed the keys back to the module and compare the setpoints\n", name);
+	printf("  %s sim FILE [OUT]               simulate the jog keys and compare the setpoints\n", name);
+	printf("  %s diff FILE FILE               compare the setpoints of two logs\n", name);
+}
+
+int main(int argc, char **argv) {
+	const char *out_path = NULL;
+	int fd, fast = 0, err;
+
+	if(argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if(strcmp(argv[1], "show") == 0)
+		return show(argv[2]) ? 1 : 0;
+	if(strcmp(argv[1], "sim") == 0)
+		return sim(argv[2], argc >= 4 ? argv[3] : NULL) ? 1 : 0;
+	if(strcmp(argv[1], "diff") == 0 && argc == 4)
+		return diff(argv[2], argv[3]) ? 1 : 0;
+
+	fd = open(arm_device(), O_RDWR);
+	if(fd < 0) {
+		perror(arm_device());
+		return 1;
+	}
+
+	if(strcmp(argv[1], "record") == 0) {
+		err = record(fd, argv[2], argc >= 4 ? atof(argv[3]) : 0);
+	} else if(strcmp(argv[1], "replay") == 0) {
+		if(argc >= 4 && strcmp(argv[3], "fast") == 0) {
+			fast = 1;
+			out_path = (argc >= 5) ? argv[4] : NULL;
+		} else {
+			out_path = (argc >= 4) ? argv[3] : NULL;
+		}
+		err = replay(fd, argv[2], fast, out_path);
+	} else {
+		usage(argv[0]);
+		err = -1;
+	}
+
+	close(fd);
+	return err ? 1 : 0;
+}
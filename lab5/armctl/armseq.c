@@ -0,0 +1,204 @@
+// Name: Justin Sadler, Abin George
+// Saves and restores the sequence of the arm module as a sequence program,
+// the compact file arm.ko loads from /lib/firmware at init.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include "arm_ioctl.h"
+
+#define ARM_DEV		"/dev/arm"
+
+// ARM_DEV in the environment picks another arm, e.g. /dev/arm1
+static const char *arm_device(void){
+	const char *dev = getenv("ARM_DEV");
+
+	return dev ? dev : ARM_DEV;
+}
+#define PROGRAM_MAX	ARM_SEQ_PROGRAM_MAX(1 << 20)	// SEQ_MAX_CAPACITY of arm.c
+
+// CRC32 as in zlib, the checksum of the waypoint bytes
+static uint32_t crc32(const unsigned char *data, size_t size){
+	uint32_t crc = 0xffffffff;
+	size_t i;
+	int bit;
+
+	for(i = 0; i < size; i++) {
+		crc ^= data[i];
+		for(bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static unsigned char *read_file(const char *path, size_t *size){
+	unsigned char *data;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if(!f) {
+		perror(path);
+		return NULL;
+	}
+	data = malloc(PROGRAM_MAX);
+	if(!data) {
+		fclose(f);
+		return NULL;
+	}
+	*size = fread(data, 1, PROGRAM_MAX, f);
+	fclose(f);
+	return data;
+}
+
+// Prints the waypoints of a program, checking it the way arm.ko does
+static int show(const char *path){
+	const struct arm_seq_header *header;
+	unsigned char *data;
+	size_t size, pos, end;
+	int32_t last[ARM_TOT_MOTOR + 1] = { 0 };
+	uint32_t i, value;
+	int field, shift, err = -1;
+
+	data = read_file(path, &size);
+	if(!data)
+		return -1;
+
+	header = (const struct arm_seq_header *) data;
+	if(size < sizeof(*header) || header->magic != ARM_SEQ_MAGIC || header->version != ARM_SEQ_VERSION) {
+		printf("%s is not a sequence program\n", path);
+		goto out;
+	}
+	pos = header->header_size;
+	end = pos + header->size;
+	if(pos < sizeof(*header) || end > size || crc32(data + pos, end - pos) != header->checksum) {
+		printf("%s is damaged\n", path);
+		goto out;
+	}
+
+	printf("%u waypoints in %zu bytes (%zu as arm_waypoint)\n", header->count, end,
+		header->count * sizeof(struct arm_waypoint));
+	printf("%6s %6s %6s %6s %8s\n", "", "wrist", "elbow", "grip", "dwell ms");
+	for(i = 0; i < header->count; i++) {
+		for(field = 0; field <= ARM_TOT_MOTOR; field++) {
+			value = 0;
+			shift = 0;
+			do {
+				if(pos >= end || shift > 28) {
+					printf("%s is damaged\n", path);
+					goto out;
+				}
+				value |= (uint32_t) (data[pos] & 0x7f) << shift;
+				shift += 7;
+			} while(data[pos++] & 0x80);
+			last[field] += (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+		}
+		printf("%6u %6d %6d %6d %8d\n", i + 1, last[0], last[1], last[2], last[ARM_TOT_MOTOR]);
+	}
+	err = 0;
+
+out:
+	free(data);
+	return err;
+}
+
+static int save(int fd, const char *path){
+	struct arm_seq_program program;
+	unsigned char *data;
+	FILE *f;
+	int err = -1;
+
+	// Asked with no room first for the size
+	memset(&program, 0, sizeof(program));
+	if(ioctl(fd, ARM_IOC_GET_PROGRAM, &program) < 0 && errno != ENOSPC) {
+		perror("ARM_IOC_GET_PROGRAM");
+		return -1;
+	}
+	data = malloc(program.size);
+	if(!data)
+		return -1;
+	program.data = (uintptr_t) data;
+	if(ioctl(fd, ARM_IOC_GET_PROGRAM, &program) < 0) {
+		perror("ARM_IOC_GET_PROGRAM");
+		goto out;
+	}
+
+	f = fopen(path, "wb");
+	if(!f) {
+		perror(path);
+		goto out;
+	}
+	fwrite(data, 1, program.size, f);
+	fclose(f);
+	printf("Wrote %s, %u waypoints in %u bytes, copy it to /lib/firmware\n", path,
+		((const struct arm_seq_header *) data)->count, program.size);
+	err = 0;
+
+out:
+	free(data);
+	return err;
+}
+
+static int load(int fd, const char *path, int run){
+	struct arm_seq_program program;
+	unsigned char *data;
+	size_t size;
+	int err = 0;
+
+	data = read_file(path, &size);
+	if(!data)
+		return -1;
+
+	memset(&program, 0, sizeof(program));
+	program.size = size;
+	program.flags = run ? ARM_SEQ_START : 0;
+	program.data = (uintptr_t) data;
+	if(ioctl(fd, ARM_IOC_SET_PROGRAM, &program) < 0) {
+		perror("ARM_IOC_SET_PROGRAM");
+		err = -1;
+	}
+	free(data);
+	return err;
+}
+
+static void usage(const char *name){
+	printf("Usage:\n");
+	printf("  %s save [FILE]       write the stored sequence to a program\n", name);
+	printf("  %s load FILE [run]   replace the sequence with a program, and start it\n", name);
+	printf("  %s show [FILE]       print the waypoints of a program\n", name);
+}
+
+int main(int argc, char **argv) {
+	const char *path = (argc >= 3) ? argv[2] : ARM_SEQ_FIRMWARE;
+	int fd, err;
+
+	if(argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if(strcmp(argv[1], "show") == 0)
+		return show(path) ? 1 : 0;
+
+	fd = open(arm_device(), O_RDWR);
+	if(fd < 0) {
+		perror(arm_device());
+		return 1;
+	}
+
+	if(strcmp(argv[1], "save") == 0) {
+		err = save(fd, path);
+	} else if(strcmp(argv[1], "load") == 0 && argc >= 3) {
+		err = load(fd, path, argc >= 4 && strcmp(argv[3], "run") == 0);
+	} else {
+		usage(argv[0]);
+		err = -1;
+	}
+
+	close(fd);
+	return err ? 1 : 0;
+}
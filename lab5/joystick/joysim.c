@@ -0,0 +1,138 @@
+// Name: Justin Sadler, Abin George
+// Virtual joystick used to test the joystick velocity mode of arm.ko
+/* Sources: https://www.kernel.org/doc/html/v4.19/input/uinput.html */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <linux/uinput.h>
+
+#define AXIS_MIN	-32767
+#define AXIS_MAX	32767
+#define UPDATE_MS	10	// how often the axis value is resent while holding
+
+static const int axes[] = { ABS_X, ABS_Y, ABS_RY };
+
+static void emit(int fd, int type, int code, int value){
+	struct input_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = type;
+	ev.code = code;
+	ev.value = value;
+	if(write(fd, &ev, sizeof(ev)) != sizeof(ev))
+		perror("write");
+}
+
+static void sleep_ms(int ms){
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+}
+
+// Holds an axis at a value for a while, then centres it again
+static void hold(int fd, int code, int value, int ms){
+	int elapsed;
+
+	printf("axis %d = %d for %d ms\n", code, value, ms);
+	for(elapsed = 0; elapsed < ms; elapsed += UPDATE_MS) {
+		emit(fd, EV_ABS, code, value);
+		emit(fd, EV_SYN, SYN_REPORT, 0);
+		sleep_ms(UPDATE_MS);
+	}
+	emit(fd, EV_ABS, code, 0);
+	emit(fd, EV_SYN, SYN_REPORT, 0);
+}
+
+static int parse_axis(const char *name){
+	if(strcmp(name, "x") == 0)
+		return ABS_X;
+	if(strcmp(name, "y") == 0)
+		return ABS_Y;
+	if(strcmp(name, "ry") == 0)
+		return ABS_RY;
+	return -1;
+}
+
+static int setup(void){
+	struct uinput_setup usetup;
+	struct uinput_abs_setup abs;
+	int fd, i;
+
+	fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	if(fd < 0) {
+		perror("open /dev/uinput");
+		return -1;
+	}
+
+	// A button makes the device look like a gamepad to user space too
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	ioctl(fd, UI_SET_KEYBIT, BTN_SOUTH);
+	ioctl(fd, UI_SET_EVBIT, EV_ABS);
+
+	for(i = 0; i < (int)(sizeof(axes) / sizeof(axes[0])); i++) {
+		memset(&abs, 0, sizeof(abs));
+		abs.code = axes[i];
+		abs.absinfo.minimum = AXIS_MIN;
+		abs.absinfo.maximum = AXIS_MAX;
+		ioctl(fd, UI_SET_ABSBIT, axes[i]);
+		ioctl(fd, UI_ABS_SETUP, &abs);
+	}
+
+	memset(&usetup, 0, sizeof(usetup));
+	usetup.id.bustype = BUS_VIRTUAL;
+	usetup.id.vendor = 0xec53;
+	usetup.id.product = 0x0535;
+	strcpy(usetup.name, "EC535 virtual joystick");
+	ioctl(fd, UI_DEV_SETUP, &usetup);
+
+	if(ioctl(fd, UI_DEV_CREATE) < 0) {
+		perror("UI_DEV_CREATE");
+		close(fd);
+		return -1;
+	}
+
+	// Give the kernel time to bind the handlers
+	sleep_ms(500);
+	return fd;
+}
+
+int main(int argc, char **argv) {
+	int fd, code;
+
+	if(argc != 1 && argc != 4) {
+		printf("Usage: %s [x|y|ry value ms]\n", argv[0]);
+		return 1;
+	}
+
+	fd = setup();
+	if(fd < 0)
+		return 1;
+
+	if(argc == 4) {
+		code = parse_axis(argv[1]);
+		if(code < 0) {
+			printf("Unknown axis %s\n", argv[1]);
+			return 1;
+		}
+		hold(fd, code, atoi(argv[2]), atoi(argv[3]));
+	} else {
+		// Sweep: inside the deadzone, half and full deflection both ways on every axis
+		for(code = 0; code < (int)(sizeof(axes) / sizeof(axes[0])); code++) {
+			hold(fd, axes[code], AXIS_MAX / 20, 500);
+			hold(fd, axes[code], AXIS_MAX / 2, 1000);
+			hold(fd, axes[code], AXIS_MAX, 1000);
+			hold(fd, axes[code], AXIS_MIN, 1000);
+		}
+	}
+
+	sleep_ms(500);
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include "armdevice.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+ArmDevice::ArmDevice(const QString &path, QObject *parent)
+    : QObject(parent)
+    , m_fd(-1)
+    , m_notifier(0)
+{
+    memset(&m_telemetry, 0, sizeof(m_telemetry));
+
+    m_fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (m_fd < 0) {
+        m_error = QStringLiteral("%1: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+        return;
+    }
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, QOverload<QSocketDescriptor, QSocketNotifier::Type>::of(&QSocketNotifier::activated),
+            this, &ArmDevice::readTelemetry);
+
+    // The first snapshot is available straight away
+    readTelemetry();
+}
+
+ArmDevice::~ArmDevice()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+void ArmDevice::readTelemetry()
+{
+    arm_telemetry telemetry;
+    bool changed = false;
+
+    // Drain everything queued, only the newest snapshot matters
+    for (;;) {
+        const ssize_t n = ::read(m_fd, &telemetry, sizeof(telemetry));
+        if (n == sizeof(telemetry)) {
+            m_telemetry = telemetry;
+            changed = true;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno != EAGAIN) {
+            m_error = QString::fromLocal8Bit(strerror(errno));
+            m_notifier->setEnabled(false);
+        }
+        break;
+    }
+
+    if (changed)
+        emit telemetryChanged();
+}
+
+bool ArmDevice::ioctlFailed(const char *request)
+{
+    m_error = QStringLiteral("%1: %2").arg(QLatin1String(request), QString::fromLocal8Bit(strerror(errno)));
+    return false;
+}
+
+bool ArmDevice::downloadSequence(QVector<arm_waypoint> *waypoints)
+{
+    if (m_fd < 0)
+        return false;
+
+    // The length first, then the whole sequence in one go
+    arm_sequence_io io;
+    memset(&io, 0, sizeof(io));
+    if (::ioctl(m_fd, ARM_IOC_GET_SEQUENCE, &io) < 0)
+        return ioctlFailed("ARM_IOC_GET_SEQUENCE");
+
+    waypoints->resize(int(io.total));
+    io.count = io.total;
+    io.waypoints = quintptr(waypoints->data());
+    if (::ioctl(m_fd, ARM_IOC_GET_SEQUENCE, &io) < 0)
+        return ioctlFailed("ARM_IOC_GET_SEQUENCE");
+
+    // Shorter if the sequence was cleared in between
+    waypoints->resize(int(io.count));
+    return true;
+}
+
+bool ArmDevice::uploadSequence(const QVector<arm_waypoint> &waypoints, bool start)
+{
+    if (m_fd < 0)
+        return false;
+
+    arm_sequence_io io;
+    memset(&io, 0, sizeof(io));
+    io.count = waypoints.size();
+    io.flags = start ? ARM_SEQ_START : 0;
+    io.waypoints = quintptr(waypoints.constData());
+    if (::ioctl(m_fd, ARM_IOC_SET_SEQUENCE, &io) < 0)
+        return ioctlFailed("ARM_IOC_SET_SEQUENCE");
+    return true;
+}
+
+bool ArmDevice::runSequence(bool run)
+{
+    if (m_fd < 0)
+        return false;
+
+    __u32 value = run;
+    if (::ioctl(m_fd, ARM_IOC_RUN_SEQUENCE, &value) < 0)
+        return ioctlFailed("ARM_IOC_RUN_SEQUENCE");
+    return true;
+}
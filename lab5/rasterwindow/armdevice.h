@@ -0,0 +1,42 @@
+#ifndef ARMDEVICE_H
+#define ARMDEVICE_H
+
+#include <QtCore>
+
+#include "arm_ioctl.h"
+
+// Reads telemetry from the arm module. The descriptor is non-blocking and
+// watched by a QSocketNotifier, so nothing runs until the module has news.
+class ArmDevice : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ArmDevice(const QString &path = QStringLiteral("/dev/arm"), QObject *parent = 0);
+    ~ArmDevice();
+
+    bool isOpen() const { return m_fd >= 0; }
+    QString errorString() const { return m_error; }
+    const arm_telemetry &telemetry() const { return m_telemetry; }
+
+    // Sequence transfers. An upload is a single ioctl with every waypoint,
+    // they return false and set errorString() on failure.
+    bool downloadSequence(QVector<arm_waypoint> *waypoints);
+    bool uploadSequence(const QVector<arm_waypoint> &waypoints, bool start = false);
+    bool runSequence(bool run);
+
+signals:
+    void telemetryChanged();
+
+private slots:
+    void readTelemetry();
+
+private:
+    bool ioctlFailed(const char *request);
+
+    int m_fd;
+    QSocketNotifier *m_notifier;
+    arm_telemetry m_telemetry;
+    QString m_error;
+};
+
+#endif // ARMDEVICE_H
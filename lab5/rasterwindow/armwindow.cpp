@@ -0,0 +1,251 @@
+#include "armwindow.h"
+
+#include <string.h>
+
+static const char *const motorNames[ARM_TOT_MOTOR] = { "Wrist", "Elbow", "Grip" };
+static const int margin = 6;
+
+ArmWindow::ArmWindow(const QString &device, QWindow *parent)
+    : RasterWindow(parent)
+    , m_device(new ArmDevice(device, this))
+    , m_textCache(true)
+{
+    memset(&m_shown, 0, sizeof(m_shown));
+    m_shown = m_device->telemetry();
+
+    for (int i = 0; i < ARM_TOT_MOTOR; ++i)
+        updateJointText(i);
+    updateSequenceText();
+    updateJitterText();
+
+    connect(m_device, &ArmDevice::telemetryChanged, this, &ArmWindow::telemetryChanged);
+
+    // The 4.3" LCD cape of the BeagleBone
+    resize(480, 272);
+}
+
+void ArmWindow::resizeEvent(QResizeEvent *event)
+{
+    RasterWindow::resizeEvent(event);
+    layoutPanels();
+}
+
+// T switches the text cache off and on to compare frame times, F hides the frame time
+void ArmWindow::keyPressEvent(QKeyEvent *event)
+{
+    if (event->key() == Qt::Key_T) {
+        m_textCache = !m_textCache;
+        renderLater();
+    } else if (event->key() == Qt::Key_F) {
+        setFrameTimeVisible(!isFrameTimeVisible());
+    } else {
+        RasterWindow::keyPressEvent(event);
+    }
+}
+
+void ArmWindow::updateJointText(int motor)
+{
+    QString text = QStringLiteral("%1°  %2 µs")
+            .arg(m_shown.joints.angle[motor] / 1000.0, 0, 'f', 1)
+            .arg(m_shown.duty_ns[motor] / 1000.0, 0, 'f', 1);
+    if (m_shown.fb_duty[motor] >= 0)
+        text += QStringLiteral(", at %1").arg(m_shown.fb_duty[motor]);
+    setStaticText(m_jointText[motor], text);
+}
+
+void ArmWindow::updateSequenceText()
+{
+    QString status = m_shown.seq_active
+            ? QStringLiteral("Running %1/%2").arg(m_shown.seq_stage + 1).arg(m_shown.seq_total)
+            : QStringLiteral("Stopped, %1 waypoints").arg(m_shown.seq_total);
+    if (m_shown.seq_rate != ARM_SEQ_RATE_NOMINAL || m_shown.seq_rate_target != ARM_SEQ_RATE_NOMINAL)
+        status += QStringLiteral("  %1×").arg(m_shown.seq_rate / 1000.0, 0, 'f', 2);
+    if (m_shown.seq_cycles)
+        status += QStringLiteral("  %1 s loop").arg(m_shown.seq_cycle_us / 1e6, 0, 'f', 2);
+    setStaticText(m_statusText, status);
+
+    for (int i = 0; i < ARM_TELEM_WAYPOINTS; ++i) {
+        setStaticText(m_waypointText[i], QStringLiteral("%1  %2  %3  %4").arg(i + 1)
+                          .arg(m_shown.waypoints[i][0]).arg(m_shown.waypoints[i][1]).arg(m_shown.waypoints[i][2]));
+    }
+}
+
+void ArmWindow::updateJitterText()
+{
+    QString text = QStringLiteral("PWM jitter avg/max µs ");
+    for (int i = 0; i < ARM_TOT_MOTOR; ++i)
+        text += QStringLiteral(" %1 %2/%3").arg(QLatin1Char(motorNames[i][0]))
+                    .arg(m_shown.jitter[i].avg_us).arg(m_shown.jitter[i].max_us);
+    setStaticText(m_jitterText, text);
+}
+
+// Left aligned and vertically centred, from the cached layout unless the cache is off
+void ArmWindow::renderText(QPainter *painter, const QRect &rect, const QStaticText &text)
+{
+    if (!m_textCache) {
+        painter->drawText(rect, Qt::AlignLeft | Qt::AlignVCenter, text.text());
+        return;
+    }
+
+    const qreal y = rect.top() + (rect.height() - painter->fontMetrics().height()) / 2.0;
+    painter->drawStaticText(QPointF(rect.left(), y), text);
+}
+
+void ArmWindow::layoutPanels()
+{
+    const int w = width() - 2 * margin;
+    const int lineHeight = QFontMetrics(QGuiApplication::font()).height();
+
+    m_title = QRect(margin, margin, w, lineHeight + margin);
+    m_help = QRect(margin, height() - margin - 2 * lineHeight, w, 2 * lineHeight);
+    m_jitter = QRect(margin, m_help.top() - margin - lineHeight, w, lineHeight);
+
+    const int top = m_title.bottom() + margin;
+    const int bottom = m_jitter.top() - margin;
+    const int jointWidth = w * 3 / 5;
+    const int rowHeight = (bottom - top) / ARM_TOT_MOTOR;
+
+    for (int i = 0; i < ARM_TOT_MOTOR; ++i)
+        m_joints[i] = QRect(margin, top + i * rowHeight, jointWidth - margin, rowHeight - margin);
+
+    m_sequence = QRect(margin + jointWidth, top, w - jointWidth, bottom - top);
+}
+
+// A joint row: the name on the left, a bar on top and the values under it
+static QRect jointBar(const QRect &row)
+{
+    const int labelWidth = row.width() / 5;
+    return QRect(row.left() + labelWidth, row.top(), row.width() - labelWidth, row.height() / 2);
+}
+
+static QRect jointValue(const QRect &row)
+{
+    const QRect bar = jointBar(row);
+    return QRect(bar.left(), bar.bottom() + 1, bar.width(), row.bottom() - bar.bottom());
+}
+
+void ArmWindow::renderBackground(QPainter *painter)
+{
+    painter->fillRect(0, 0, width(), height(), QGradient::NightFade);
+
+    QFont titleFont = painter->font();
+    titleFont.setBold(true);
+    painter->setFont(titleFont);
+    painter->drawText(m_title, Qt::AlignLeft | Qt::AlignVCenter, QStringLiteral("Arm of the Future"));
+    painter->drawText(m_sequence, Qt::AlignLeft | Qt::AlignTop, QStringLiteral("Sequence"));
+    titleFont.setBold(false);
+    painter->setFont(titleFont);
+
+    painter->setPen(QColor(40, 40, 60));
+    for (int i = 0; i < ARM_TOT_MOTOR; ++i) {
+        painter->drawText(m_joints[i], Qt::AlignLeft | Qt::AlignVCenter, QString::fromLatin1(motorNames[i]));
+        painter->drawRect(jointBar(m_joints[i]).adjusted(0, 0, -1, -1));
+    }
+
+    painter->drawText(m_help, Qt::AlignCenter,
+                      QStringLiteral("Arrows: move  G/H: grip/ungrip  1-4: save waypoint\n"
+                                     "Enter: start sequence  ESC: stop sequence"));
+}
+
+void ArmWindow::renderJoint(QPainter *painter, int motor)
+{
+    const QRect bar = jointBar(m_joints[motor]).adjusted(1, 1, -2, -2);
+    const int span = m_shown.duty_max[motor] - m_shown.duty_min[motor];
+    if (span <= 0)
+        return;
+
+    const int duty = m_shown.joints.duty[motor];
+    const int fill = bar.width() * (duty - m_shown.duty_min[motor]) / span;
+    painter->fillRect(bar.left(), bar.top(), fill, bar.height(), QColor(60, 110, 190));
+
+    // Where the sequence is taking the joint
+    if (m_shown.seq_active) {
+        const int x = bar.left() + bar.width() * (m_shown.target[motor] - m_shown.duty_min[motor]) / span;
+        painter->setPen(QPen(QColor(220, 80, 40), 2));
+        painter->drawLine(x, bar.top(), x, bar.bottom());
+    }
+
+    painter->setPen(Qt::black);
+    renderText(painter, jointValue(m_joints[motor]), m_jointText[motor]);
+}
+
+void ArmWindow::renderSequence(QPainter *painter)
+{
+    const int lineHeight = painter->fontMetrics().height();
+    QRect line(m_sequence.left(), m_sequence.top() + lineHeight, m_sequence.width(), lineHeight);
+
+    painter->setPen(Qt::black);
+    if (!m_device->isOpen()) {
+        painter->drawText(line.united(m_sequence), Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap,
+                          m_device->errorString());
+        return;
+    }
+
+    renderText(painter, line, m_statusText);
+
+    const int rows = qMin<int>(m_shown.seq_total, ARM_TELEM_WAYPOINTS);
+    for (int i = 0; i < rows; ++i) {
+        line.translate(0, lineHeight);
+        if (line.bottom() > m_sequence.bottom())
+            break;
+        if (m_shown.seq_active && uint(i) == m_shown.seq_stage)
+            painter->fillRect(line, QColor(255, 255, 255, 120));
+        renderText(painter, line, m_waypointText[i]);
+    }
+}
+
+void ArmWindow::renderJitter(QPainter *painter)
+{
+    painter->setPen(Qt::black);
+    renderText(painter, m_jitter, m_jitterText);
+}
+
+void ArmWindow::render(QPainter *painter)
+{
+    // Skip the panels outside the region being repainted
+    const QRegion clip = painter->clipRegion();
+
+    for (int i = 0; i < ARM_TOT_MOTOR; ++i) {
+        if (clip.intersects(m_joints[i]))
+            renderJoint(painter, i);
+    }
+    if (clip.intersects(m_sequence))
+        renderSequence(painter);
+    if (clip.intersects(m_jitter))
+        renderJitter(painter);
+}
+
+void ArmWindow::telemetryChanged()
+{
+    const arm_telemetry &t = m_device->telemetry();
+    bool joints[ARM_TOT_MOTOR];
+
+    for (int i = 0; i < ARM_TOT_MOTOR; ++i) {
+        joints[i] = t.duty_ns[i] != m_shown.duty_ns[i] || t.joints.angle[i] != m_shown.joints.angle[i]
+                || t.target[i] != m_shown.target[i] || t.seq_active != m_shown.seq_active
+                || t.duty_min[i] != m_shown.duty_min[i] || t.duty_max[i] != m_shown.duty_max[i]
+                || t.fb_duty[i] != m_shown.fb_duty[i];
+    }
+    const bool sequence = t.seq_active != m_shown.seq_active || t.seq_stage != m_shown.seq_stage
+            || t.seq_total != m_shown.seq_total || t.seq_rate != m_shown.seq_rate
+            || t.seq_rate_target != m_shown.seq_rate_target || t.seq_cycles != m_shown.seq_cycles
+            || memcmp(t.waypoints, m_shown.waypoints, sizeof(t.waypoints)) != 0;
+    const bool jitter = memcmp(t.jitter, m_shown.jitter, sizeof(t.jitter)) != 0;
+
+    m_shown = t;
+
+    for (int i = 0; i < ARM_TOT_MOTOR; ++i) {
+        if (joints[i]) {
+            updateJointText(i);
+            renderLater(m_joints[i]);
+        }
+    }
+    if (sequence) {
+        updateSequenceText();
+        renderLater(m_sequence);
+    }
+    if (jitter) {
+        updateJitterText();
+        renderLater(m_jitter);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef ARMWINDOW_H
+#define ARMWINDOW_H
+
+#include "rasterwindow.h"
+#include "armdevice.h"
+
+// Live dashboard of the arm: joint positions, the sequence and PWM timing.
+// Labels and frames live in the cached background; telemetry updates only
+// repaint the panels whose values changed.
+class ArmWindow : public RasterWindow
+{
+    Q_OBJECT
+public:
+    explicit ArmWindow(const QString &device = QStringLiteral("/dev/arm"), QWindow *parent = 0);
+
+    void render(QPainter *painter) override;
+
+protected:
+    void renderBackground(QPainter *painter) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+
+private slots:
+    void telemetryChanged();
+
+private:
+    void layoutPanels();
+    void renderJoint(QPainter *painter, int motor);
+    void renderSequence(QPainter *painter);
+    void renderJitter(QPainter *painter);
+    void renderText(QPainter *painter, const QRect &rect, const QStaticText &text);
+
+    void updateJointText(int motor);
+    void updateSequenceText();
+    void updateJitterText();
+
+    ArmDevice *m_device;
+    arm_telemetry m_shown;
+
+    // Text is laid out once when its content changes, not every frame
+    bool m_textCache;
+    QStaticText m_jointText[ARM_TOT_MOTOR];
+    QStaticText m_statusText;
+    QStaticText m_waypointText[ARM_TELEM_WAYPOINTS];
+    QStaticText m_jitterText;
+
+    QRect m_title;
+    QRect m_joints[ARM_TOT_MOTOR];
+    QRect m_sequence;
+    QRect m_jitter;
+    QRect m_help;
+};
+
+#endif // ARMWINDOW_H
@@ -0,0 +1,178 @@
+#include "armwindow.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+// Renders the arm dashboard without a display or an arm. Telemetry is fed
+// through a pipe the window opens as its device, so the whole path from
+// the socket notifier to the flush is measured.
+
+struct BenchResult {
+    int frames;
+    qint64 wallNs;
+    QVector<qint64> frameNs;
+    qint64 bytes;
+};
+
+static void writeTelemetry(int fd, int frame)
+{
+    arm_telemetry t;
+    memset(&t, 0, sizeof(t));
+
+    t.generation = frame + 1;
+    t.period_us = 20000;
+    t.seq_total = ARM_TELEM_WAYPOINTS;
+    t.seq_active = (frame / 100) % 2;
+    t.seq_stage = (frame / 25) % ARM_TELEM_WAYPOINTS;
+    for (int i = 0; i < ARM_TOT_MOTOR; ++i) {
+        t.duty_min[i] = 200;
+        t.duty_max[i] = 900;
+        t.joints.duty[i] = 550 + int(350 * sin(frame * 0.02 * (i + 1)));
+        t.joints.angle[i] = (t.joints.duty[i] - 200) * 90000 / 700;
+        t.target[i] = 200 + (frame * 7 + i * 100) % 700;
+        t.jitter[i].avg_us = 3 + (frame / 50) % 5;
+        t.jitter[i].max_us = 40;
+        t.jitter[i].pulses = frame;
+    }
+    for (int w = 0; w < ARM_TELEM_WAYPOINTS; ++w)
+        for (int i = 0; i < ARM_TOT_MOTOR; ++i)
+            t.waypoints[w][i] = 200 + (w * 97 + i * 211) % 700;
+
+    if (::write(fd, &t, sizeof(t)) != sizeof(t))
+        qFatal("Cannot write telemetry");
+}
+
+static bool waitFor(QWindow *window, const QSize &size)
+{
+    QElapsedTimer timeout;
+    timeout.start();
+    while (!window->isExposed() || window->size() != size) {
+        if (timeout.hasExpired(5000))
+            return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    QCoreApplication::processEvents();
+    return true;
+}
+
+static BenchResult run(ArmWindow *window, int pipeFd, int frames, bool full)
+{
+    BenchResult result;
+    result.frames = 0;
+    result.bytes = 0;
+    result.frameNs.reserve(frames);
+
+    const int bytesPerPixel = qMax(window->screen()->depth() / 8, 1);
+    QElapsedTimer wall;
+    wall.start();
+
+    for (int frame = 0; frame < frames; ++frame) {
+        const quint64 before = window->frameCount();
+
+        // The notifier delivers the snapshot and the window marks the changed panels dirty
+        writeTelemetry(pipeFd, frame);
+        QCoreApplication::processEvents();
+        if (full)
+            window->renderLater();
+        window->renderNow();
+
+        // Usually one frame, more if an update request was delivered in between
+        const int rendered = int(window->frameCount() - before);
+        const QVector<RasterWindow::FrameTiming> timings = rendered == 1
+                ? QVector<RasterWindow::FrameTiming>(1, window->lastFrameTiming())
+                : window->frameTimings().mid(qMax(0, window->frameTimings().size() - rendered));
+        for (const RasterWindow::FrameTiming &t : timings) {
+            result.frameNs.append(qint64(t.prepare) + t.beginPaint + t.paint + t.endPaint + t.flush);
+            result.bytes += qint64(t.pixels) * bytesPerPixel;
+            result.frames++;
+        }
+    }
+
+    result.wallNs = wall.nsecsElapsed();
+    return result;
+}
+
+static void report(const QSize &size, const char *mode, BenchResult &result)
+{
+    if (result.frameNs.isEmpty()) {
+        printf("%5dx%-5d %-5s  no frames rendered\n", size.width(), size.height(), mode);
+        return;
+    }
+
+    std::sort(result.frameNs.begin(), result.frameNs.end());
+    qint64 total = 0;
+    for (qint64 ns : result.frameNs)
+        total += ns;
+    const int n = result.frameNs.size();
+    const qint64 p99 = result.frameNs.at(qMin(n - 1, (n * 99 + 99) / 100 - 1));
+
+    printf("%5dx%-5d %-5s %7d %9.1f %8.3f %8.3f %8.3f %10.2f %9.1f\n",
+           size.width(), size.height(), mode, n,
+           n * 1e9 / result.wallNs,
+           total / 1e6 / n, result.frameNs.at(n / 2) / 1e6, p99 / 1e6,
+           result.bytes / (1024.0 * 1024.0), result.bytes / 1024.0 / n);
+}
+
+int main(int argc, char **argv)
+{
+    // No display needed, unless asked for one with -platform
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Render loop benchmark of the arm dashboard."));
+    parser.addHelpOption();
+    const QCommandLineOption framesOption(QStringLiteral("frames"),
+            QStringLiteral("Frames rendered per resolution and mode."), QStringLiteral("n"), QStringLiteral("500"));
+    const QCommandLineOption sizesOption(QStringLiteral("sizes"),
+            QStringLiteral("Comma separated resolutions."), QStringLiteral("WxH,..."),
+            QStringLiteral("320x240,480x272,800x480,1280x720,1920x1080"));
+    parser.addOption(framesOption);
+    parser.addOption(sizesOption);
+    parser.process(app);
+
+    const int frames = qMax(parser.value(framesOption).toInt(), 1);
+
+    int fds[2];
+    if (::pipe(fds) < 0)
+        qFatal("pipe: %s", strerror(errno));
+
+    ArmWindow window(QStringLiteral("/proc/self/fd/%1").arg(fds[0]));
+    window.setFrameTimeVisible(false);
+    window.show();
+
+    printf("platform %s, %d frames per run\n", qPrintable(QGuiApplication::platformName()), frames);
+    printf("%-11s %-5s %7s %9s %8s %8s %8s %10s %9s\n",
+           "resolution", "mode", "frames", "frames/s", "mean ms", "p50 ms", "p99 ms", "MB flushed", "KB/frame");
+
+    const QStringList sizes = parser.value(sizesOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+    for (const QString &spec : sizes) {
+        const QStringList wh = spec.split(QLatin1Char('x'));
+        const QSize size(wh.value(0).toInt(), wh.value(1).toInt());
+        if (size.isEmpty()) {
+            qWarning("Bad resolution %s", qPrintable(spec));
+            continue;
+        }
+
+        window.resize(size);
+        if (!waitFor(&window, size)) {
+            qWarning("Window not exposed at %s", qPrintable(spec));
+            continue;
+        }
+
+        // Dirty panels only, as on the arm, then the whole window every frame
+        BenchResult dirty = run(&window, fds[1], frames, false);
+        report(size, "dirty", dirty);
+        BenchResult full = run(&window, fds[1], frames, true);
+        report(size, "full", full);
+    }
+
+    ::close(fds[1]);
+    ::close(fds[0]);
+    return 0;
+}
@@ -0,0 +1,15 @@
+include(../rasterwindow.pri)
+
+INCLUDEPATH += $$PWD/.. $$PWD/../../arm
+
+SOURCES += \
+    rasterbench.cpp \
+    ../armdevice.cpp \
+    ../armwindow.cpp
+
+HEADERS += \
+    ../armdevice.h \
+    ../armwindow.h
+
+CONFIG += console
+CONFIG -= app_bundle
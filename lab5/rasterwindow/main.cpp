@@ -1,14 +1,48 @@
-#include "rasterwindow.h"
+#include "armwindow.h"
+#include "timelinewindow.h"
 
 
 //! [1]
 int main(int argc, char **argv)
 {
     QGuiApplication app(argc, argv);
-    RasterWindow window;
 
-    window.show();
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("device"), QStringLiteral("Arm device, /dev/arm by default."));
+    const QCommandLineOption intervalOption(QStringLiteral("interval"),
+            QStringLiteral("Minimum time between frames, 0 follows vsync."), QStringLiteral("ms"), QStringLiteral("0"));
+    const QCommandLineOption csvOption(QStringLiteral("csv"),
+            QStringLiteral("Write the timings of the last frames to a CSV file on exit."), QStringLiteral("file"));
+    const QCommandLineOption secondsOption(QStringLiteral("seconds"),
+            QStringLiteral("Quit after this many seconds, for runs with -platform offscreen."), QStringLiteral("s"));
+    const QCommandLineOption timelineOption(QStringLiteral("timeline"),
+            QStringLiteral("Edit the sequence instead of showing the dashboard."));
+    parser.addOption(timelineOption);
+    parser.addOption(intervalOption);
+    parser.addOption(csvOption);
+    parser.addOption(secondsOption);
+    parser.process(app);
 
-    return app.exec();
+    const QStringList args = parser.positionalArguments();
+    const QString device = args.isEmpty() ? QStringLiteral("/dev/arm") : args.first();
+    QScopedPointer<RasterWindow> window;
+    if (parser.isSet(timelineOption))
+        window.reset(new TimelineWindow(device));
+    else
+        window.reset(new ArmWindow(device));
+    window->setFrameInterval(parser.value(intervalOption).toInt());
+
+    if (parser.isSet(secondsOption))
+        QTimer::singleShot(parser.value(secondsOption).toInt() * 1000, &app, &QGuiApplication::quit);
+
+    window->show();
+
+    const int ret = app.exec();
+
+    if (parser.isSet(csvOption) && !window->writeFrameTimings(parser.value(csvOption)))
+        qWarning("Cannot write %s", qPrintable(parser.value(csvOption)));
+
+    return ret;
 }
 //! [1]
@@ -4,8 +4,19 @@
 RasterWindow::RasterWindow(QWindow *parent)
     : QWindow(parent)
     , m_backingStore(new QBackingStore(this))
+    , m_backgroundValid(false)
+    , m_frameInterval(0)
+    , m_framePending(false)
+    , m_dirtySince(-1)
+    , m_lastFrame(-1)
+    , m_frameCount(0)
+    , m_lateFrames(0)
+    , m_frameTimeVisible(true)
+    , m_frameTimeAvg(0)
 {
     setGeometry(100, 100, 300, 200);
+    m_frameTimeText.setTextFormat(Qt::PlainText);
+    m_clock.start();
 }
 //! [1]
 
@@ -14,16 +25,54 @@ RasterWindow::RasterWindow(QWindow *parent)
 bool RasterWindow::event(QEvent *event)
 {
     if (event->type() == QEvent::UpdateRequest) {
+        m_framePending = false;
         renderNow();
         return true;
     }
     return QWindow::event(event);
 }
+
+void RasterWindow::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_frameTimer.timerId()) {
+        m_frameTimer.stop();
+        requestUpdate();
+        return;
+    }
+    QWindow::timerEvent(event);
+}
 //! [7]
 
 //! [6]
 void RasterWindow::renderLater()
 {
+    renderLater(QRect(QPoint(0, 0), size()));
+}
+
+void RasterWindow::renderLater(const QRect &rect)
+{
+    // Dirty rectangles accumulate until the next UpdateRequest
+    if (m_dirty.isEmpty())
+        m_dirtySince = m_clock.nsecsElapsed();
+    m_dirty += rect;
+    scheduleFrame();
+}
+
+// At most one frame is pending. With a frame interval the update request is
+// held back until the interval since the last frame has passed.
+void RasterWindow::scheduleFrame()
+{
+    if (m_framePending)
+        return;
+    m_framePending = true;
+
+    if (m_frameInterval > 0 && m_lastFrame >= 0) {
+        const qint64 wait = m_frameInterval - (m_clock.nsecsElapsed() - m_lastFrame) / 1000000;
+        if (wait > 0) {
+            m_frameTimer.start(int(wait), Qt::PreciseTimer, this);
+            return;
+        }
+    }
     requestUpdate();
 }
 //! [6]
@@ -33,14 +82,22 @@ void RasterWindow::renderLater()
 void RasterWindow::resizeEvent(QResizeEvent *resizeEvent)
 {
     m_backingStore->resize(resizeEvent->size());
+
+    const QFontMetrics metrics(QGuiApplication::font());
+    const QSize counter(metrics.horizontalAdvance(QStringLiteral("000.00 ms  00000 late")) + 4, metrics.height() + 2);
+    m_frameTimeRect = QRect(QPoint(resizeEvent->size().width() - counter.width(), 0), counter);
+
+    invalidateBackground();
 }
 //! [5]
 
 //! [2]
-void RasterWindow::exposeEvent(QExposeEvent *)
+void RasterWindow::exposeEvent(QExposeEvent *exposeEvent)
 {
-    if (isExposed())
+    if (isExposed()) {
+        m_dirty += exposeEvent->region();
         renderNow();
+    }
 }
 //! [2]
 
@@ -51,24 +108,183 @@ void RasterWindow::renderNow()
     if (!isExposed())
         return;
 
-    QRect rect(0, 0, width(), height());
-    m_backingStore->beginPaint(rect);
+    FrameTiming timing;
+    qint64 mark = m_clock.nsecsElapsed();
+    qint64 now;
+    timing.timestamp = mark;
+
+    if (!m_backgroundValid)
+        updateBackground();
+
+    // Only the dirty region is repainted and flushed
+    QRegion region = m_dirty & QRect(QPoint(0, 0), size());
+    const qint64 dirtySince = m_dirtySince >= 0 ? m_dirtySince : mark;
+    m_dirty = QRegion();
+    m_dirtySince = -1;
+    if (region.isEmpty())
+        return;
+    if (m_frameTimeVisible)
+        region += m_frameTimeRect;
+
+    timing.pixels = 0;
+    for (const QRect &rect : region)
+        timing.pixels += rect.width() * rect.height();
+
+    now = m_clock.nsecsElapsed();
+    timing.prepare = qint32(now - mark);
+    mark = now;
+
+    m_backingStore->beginPaint(region);
+
+    now = m_clock.nsecsElapsed();
+    timing.beginPaint = qint32(now - mark);
+    mark = now;
 
     QPaintDevice *device = m_backingStore->paintDevice();
     QPainter painter(device);
+    painter.setClipRegion(region);
+
+    const qreal dpr = m_background.devicePixelRatio();
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    for (const QRect &rect : region)
+        painter.drawImage(rect, m_background, QRectF(rect.topLeft() * dpr, rect.size() * dpr));
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
 
-    painter.fillRect(0, 0, width(), height(), QGradient::NightFade);
     render(&painter);
+
+    if (m_frameTimeVisible) {
+        painter.fillRect(m_frameTimeRect, QColor(0, 0, 0, 160));
+        painter.setPen(Qt::white);
+        painter.drawStaticText(m_frameTimeRect.topLeft() + QPoint(2, 1), m_frameTimeText);
+    }
     painter.end();
 
+    now = m_clock.nsecsElapsed();
+    timing.paint = qint32(now - mark);
+    mark = now;
+
     m_backingStore->endPaint();
-    m_backingStore->flush(rect);
+
+    now = m_clock.nsecsElapsed();
+    timing.endPaint = qint32(now - mark);
+    mark = now;
+
+    m_backingStore->flush(region);
+
+    now = m_clock.nsecsElapsed();
+    timing.flush = qint32(now - mark);
+    timing.latency = now - dirtySince;
+    m_lastFrame = timing.timestamp;
+
+    recordFrame(timing);
 }
 //! [3]
 
+//! [9]
+void RasterWindow::setFrameTimeVisible(bool visible)
+{
+    m_frameTimeVisible = visible;
+    renderLater();
+}
+
+// A frame is late when its update waited longer than two frame periods,
+// i.e. it missed the slot after the one it was requested in.
+void RasterWindow::recordFrame(const FrameTiming &timing)
+{
+    m_frames[m_frameCount % FrameHistory] = timing;
+    m_frameCount++;
+
+    qint64 period = qint64(m_frameInterval) * 1000000;
+    if (period <= 0) {
+        const qreal rate = screen() ? screen()->refreshRate() : 60.0;
+        period = qint64(1e9 / (rate > 0 ? rate : 60.0));
+    }
+    if (timing.latency > 2 * period)
+        m_lateFrames++;
+
+    // The counter shows a running average, drawn with the next frame.
+    // The text is only laid out again when the displayed value changes.
+    const qint64 nsecs = qint64(timing.prepare) + timing.beginPaint + timing.paint + timing.endPaint + timing.flush;
+    m_frameTimeAvg = m_frameTimeAvg ? (m_frameTimeAvg * 7 + nsecs) / 8 : nsecs;
+
+    const QString text = QStringLiteral("%1 ms  %2 late")
+            .arg(m_frameTimeAvg / 1000000.0, 0, 'f', 2).arg(m_lateFrames);
+    if (text != m_frameTimeText.text())
+        m_frameTimeText.setText(text);
+}
+
+QVector<RasterWindow::FrameTiming> RasterWindow::frameTimings() const
+{
+    const quint64 count = qMin<quint64>(m_frameCount, FrameHistory);
+    QVector<FrameTiming> timings;
+    timings.reserve(int(count));
+    for (quint64 i = m_frameCount - count; i < m_frameCount; ++i)
+        timings.append(m_frames[i % FrameHistory]);
+    return timings;
+}
+
+bool RasterWindow::writeFrameTimings(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream out(&file);
+    out << "frame,timestamp_ns,latency_ns,prepare_ns,begin_paint_ns,paint_ns,end_paint_ns,flush_ns,pixels\n";
+
+    const QVector<FrameTiming> timings = frameTimings();
+    quint64 frame = m_frameCount - timings.size();
+    for (const FrameTiming &t : timings) {
+        out << frame++ << ',' << t.timestamp << ',' << t.latency << ',' << t.prepare << ','
+            << t.beginPaint << ',' << t.paint << ',' << t.endPaint << ',' << t.flush << ','
+            << t.pixels << '\n';
+    }
+    out.flush();
+    return out.status() == QTextStream::Ok && file.error() == QFile::NoError;
+}
+//! [9]
+
+// Text laid out once and drawn with drawStaticText until it changes
+void RasterWindow::setStaticText(QStaticText &staticText, const QString &text)
+{
+    if (text == staticText.text())
+        return;
+    staticText.setTextFormat(Qt::PlainText);
+    staticText.setPerformanceHint(QStaticText::AggressiveCaching);
+    staticText.setText(text);
+}
+
+//! [8]
+void RasterWindow::invalidateBackground()
+{
+    m_backgroundValid = false;
+    renderLater();
+}
+
+void RasterWindow::updateBackground()
+{
+    const qreal dpr = devicePixelRatio();
+    m_background = QImage(size() * dpr, QImage::Format_ARGB32_Premultiplied);
+    m_background.setDevicePixelRatio(dpr);
+    m_background.fill(Qt::transparent);
+
+    QPainter painter(&m_background);
+    renderBackground(&painter);
+    painter.end();
+
+    m_backgroundValid = true;
+    m_dirty = QRect(QPoint(0, 0), size());
+}
+//! [8]
+
 //! [4]
-void RasterWindow::render(QPainter *painter)
+void RasterWindow::renderBackground(QPainter *painter)
 {
+    painter->fillRect(0, 0, width(), height(), QGradient::NightFade);
     painter->drawText(QRectF(0, 0, width(), height()), Qt::AlignCenter, QStringLiteral("Arm of the Future\n\nUp/Down: Increase/Decrease Base Angle\n Right/Left: Rotate arm right or left\n G/H: Grip/Ungrip\n\"Enter\":Start sequence\n\"ESC\": Leave sequence"));
 }
+
+void RasterWindow::render(QPainter *)
+{
+}
 //! [4]
@@ -62,18 +62,79 @@ public:
 
     virtual void render(QPainter *painter);
 
+    // Shows how long the last frames took to render in the top right corner
+    void setFrameTimeVisible(bool visible);
+    bool isFrameTimeVisible() const { return m_frameTimeVisible; }
+
+    // Minimum time between two frames. 0 paces frames with the platform
+    // update requests, once per vsync on the LCD.
+    void setFrameInterval(int msecs) { m_frameInterval = msecs; }
+    int frameInterval() const { return m_frameInterval; }
+
+    // Where the time of one frame went, in nanoseconds
+    struct FrameTiming {
+        qint64 timestamp;   // start of the frame, since the window was created
+        qint64 latency;     // from the first renderLater() of the frame to the end of the flush
+        qint32 prepare;     // background cache and dirty region
+        qint32 beginPaint;
+        qint32 paint;
+        qint32 endPaint;
+        qint32 flush;
+        qint32 pixels;      // area of the flushed region
+    };
+    enum { FrameHistory = 512 };
+
+    // The last FrameHistory frames, oldest first
+    QVector<FrameTiming> frameTimings() const;
+    const FrameTiming &lastFrameTiming() const { return m_frames[(m_frameCount + FrameHistory - 1) % FrameHistory]; }
+    quint64 frameCount() const { return m_frameCount; }
+    quint64 lateFrames() const { return m_lateFrames; }
+    bool writeFrameTimings(const QString &fileName) const;
+
 public slots:
     void renderLater();
+    void renderLater(const QRect &rect);
     void renderNow();
 
 protected:
     bool event(QEvent *event) override;
+    void timerEvent(QTimerEvent *event) override;
 
     void resizeEvent(QResizeEvent *event) override;
     void exposeEvent(QExposeEvent *event) override;
 
+    // Static content, painted once per resize into a cached image
+    virtual void renderBackground(QPainter *painter);
+    void invalidateBackground();
+
+    static void setStaticText(QStaticText &staticText, const QString &text);
+
 private:
+    void updateBackground();
+    void scheduleFrame();
+    void recordFrame(const FrameTiming &timing);
+
     QBackingStore *m_backingStore;
+    QImage m_background;
+    bool m_backgroundValid;
+    QRegion m_dirty;
+
+    // Frame pacing: renderLater() calls between two frames share one repaint
+    int m_frameInterval;
+    bool m_framePending;
+    QBasicTimer m_frameTimer;
+    QElapsedTimer m_clock;
+    qint64 m_dirtySince;
+    qint64 m_lastFrame;
+
+    FrameTiming m_frames[FrameHistory];
+    quint64 m_frameCount;
+    quint64 m_lateFrames;
+
+    bool m_frameTimeVisible;
+    qint64 m_frameTimeAvg;
+    QStaticText m_frameTimeText;
+    QRect m_frameTimeRect;
 };
 //! [1]
 #endif // RASTERWINDOW_H
@@ -1,7 +1,17 @@
 include(rasterwindow.pri)
 
+INCLUDEPATH += $$PWD/../arm
+
 SOURCES += \
-    main.cpp
+    main.cpp \
+    armdevice.cpp \
+    armwindow.cpp \
+    timelinewindow.cpp
+
+HEADERS += \
+    armdevice.h \
+    armwindow.h \
+    timelinewindow.h
 
 target.path = $$[QT_INSTALL_EXAMPLES]/gui/rasterwindow
 INSTALLS += target
@@ -0,0 +1,645 @@
+#include "timelinewindow.h"
+
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
+
+static const char *const motorNames[ARM_TOT_MOTOR] = { "Wrist", "Elbow", "Grip" };
+static const QColor motorColors[ARM_TOT_MOTOR] = { QColor(60, 110, 190), QColor(220, 80, 40), QColor(40, 150, 70) };
+static const int margin = 6;
+static const int defaultDwellMs = 10 * ARM_SEQ_TICK_MS;  // as recorded with keys 1-4
+static const qint64 minViewSpan = 1000;
+
+TimelineWindow::TimelineWindow(const QString &device, QWindow *parent)
+    : RasterWindow(parent)
+    , m_device(new ArmDevice(device, this))
+    , m_cycleMs(0)
+    , m_modified(false)
+    , m_kernelGeneration(0)
+    , m_selected(0)
+    , m_firstRow(0)
+    , m_rows(0)
+    , m_viewStart(0)
+    , m_viewSpan(minViewSpan)
+    , m_viewAll(true)
+    , m_plotValid(false)
+{
+    memset(&m_shown, 0, sizeof(m_shown));
+    m_shown = m_device->telemetry();
+
+    connect(m_device, &ArmDevice::telemetryChanged, this, &TimelineWindow::telemetryChanged);
+
+    if (m_device->isOpen())
+        download();
+    else
+        setStatus(m_device->errorString());
+
+    resize(480, 272);
+}
+
+void TimelineWindow::resizeEvent(QResizeEvent *event)
+{
+    RasterWindow::resizeEvent(event);
+    layoutPanels();
+}
+
+void TimelineWindow::layoutPanels()
+{
+    const int w = width() - 2 * margin;
+    const int lineHeight = QFontMetrics(QGuiApplication::font()).height();
+
+    m_header = QRect(margin, margin, w, lineHeight + margin);
+    m_help = QRect(margin, height() - margin - 2 * lineHeight, w, 2 * lineHeight);
+
+    const int top = m_header.bottom() + margin;
+    const int bottom = m_help.top() - margin;
+    const int listWidth = w * 2 / 5;
+    m_list = QRect(margin, top, listWidth - margin, bottom - top);
+    m_plot = QRect(margin + listWidth, top, w - listWidth, bottom - top);
+
+    // The first line of the list holds the column names
+    m_rows = qMax(m_list.height() / lineHeight - 1, 1);
+    m_rowText.resize(m_rows);
+    select(m_selected);
+    for (int row = 0; row < m_rows; ++row)
+        updateRowText(row);
+
+    m_plotValid = false;
+}
+
+// The area of the plot holding the trajectories, the time axis is under it
+static QRect plotArea(const QRect &plot)
+{
+    const int lineHeight = QFontMetrics(QGuiApplication::font()).height();
+    return plot.adjusted(1, 1, -1, -1 - lineHeight);
+}
+
+static QRect listRow(const QRect &list, int row)
+{
+    const int lineHeight = QFontMetrics(QGuiApplication::font()).height();
+    return QRect(list.left(), list.top() + (row + 1) * lineHeight, list.width(), lineHeight);
+}
+
+void TimelineWindow::renderBackground(QPainter *painter)
+{
+    painter->fillRect(0, 0, width(), height(), QGradient::NightFade);
+
+    painter->setPen(QColor(40, 40, 60));
+    painter->drawRect(m_list.adjusted(0, 0, -1, -1));
+    painter->drawRect(m_plot.adjusted(0, 0, -1, -1));
+    painter->drawText(listRow(m_list, -1).adjusted(margin, 0, 0, 0), Qt::AlignLeft | Qt::AlignVCenter,
+                      QStringLiteral("#      wrist elbow  grip  dwell"));
+
+    // Grid at quarters of the duty range, and which colour is which joint
+    const QRect area = plotArea(m_plot);
+    painter->setPen(QColor(255, 255, 255, 90));
+    for (int i = 1; i < 4; ++i)
+        painter->drawLine(area.left(), area.top() + area.height() * i / 4, area.right(), area.top() + area.height() * i / 4);
+
+    int x = area.right() - margin;
+    for (int i = ARM_TOT_MOTOR - 1; i >= 0; --i) {
+        const QString name = QString::fromLatin1(motorNames[i]);
+        x -= painter->fontMetrics().horizontalAdvance(name);
+        painter->setPen(motorColors[i]);
+        painter->drawText(x, area.top() + painter->fontMetrics().ascent(), name);
+        x -= margin;
+    }
+
+    painter->setPen(QColor(40, 40, 60));
+    painter->drawText(m_help, Qt::AlignCenter,
+                      QStringLiteral("j/k: select  J/K: move  [ ]: dwell  c: add pose  x: delete  z/Z: zoom\n"
+                                     "u: upload  p: upload and play  s: stop  r: reload"));
+}
+
+void TimelineWindow::render(QPainter *painter)
+{
+    // Skip the panels outside the region being repainted
+    const QRegion clip = painter->clipRegion();
+
+    if (clip.intersects(m_header))
+        renderHeader(painter);
+    if (clip.intersects(m_list))
+        renderList(painter);
+    if (clip.intersects(m_plot))
+        renderPlot(painter);
+}
+
+void TimelineWindow::renderHeader(QPainter *painter)
+{
+    const qreal y = m_header.top() + (m_header.height() - painter->fontMetrics().height()) / 2.0;
+
+    QFont font = painter->font();
+    font.setBold(true);
+    painter->setFont(font);
+    painter->setPen(Qt::black);
+    painter->drawStaticText(QPointF(m_header.left(), y), m_headerText);
+    font.setBold(false);
+    painter->setFont(font);
+
+    painter->drawStaticText(QPointF(m_header.left() + m_headerText.size().width() + 3 * margin, y), m_statusText);
+}
+
+void TimelineWindow::renderList(QPainter *painter)
+{
+    const int running = m_shown.seq_active ? int(m_shown.seq_stage) : -1;
+
+    for (int row = 0; row < m_rows; ++row) {
+        const QRect line = listRow(m_list, row);
+        const int index = m_firstRow + row;
+        if (index >= m_waypoints.size())
+            break;
+        if (!painter->clipRegion().intersects(line))
+            continue;
+
+        if (index == m_selected)
+            painter->fillRect(line.adjusted(1, 0, -1, 0), QColor(255, 255, 255, 140));
+        if (index == running)
+            painter->fillRect(line.left() + 1, line.top(), 3, line.height(), QColor(220, 80, 40));
+
+        painter->setPen(Qt::black);
+        painter->drawStaticText(QPointF(line.left() + margin, line.top()), m_rowText.at(row));
+    }
+}
+
+void TimelineWindow::renderPlot(QPainter *painter)
+{
+    if (!m_plotValid)
+        updatePlotCache();
+    painter->drawImage(m_plot.topLeft(), m_plotCache);
+
+    if (m_waypoints.isEmpty())
+        return;
+
+    const QRect area = plotArea(m_plot);
+
+    // The selected waypoint, from reaching it to reaching the next one
+    const qint64 end = m_selected + 1 < m_arrive.size() ? m_arrive.at(m_selected + 1) : m_cycleMs;
+    const int x0 = timeToX(m_arrive.at(m_selected));
+    const int x1 = timeToX(end);
+    painter->fillRect(QRect(QPoint(x0, area.top()), QPoint(qMax(x0, x1), area.bottom())) & area,
+                      QColor(255, 255, 255, 70));
+
+    // Where the running sequence is heading
+    if (m_shown.seq_active && int(m_shown.seq_stage) < m_arrive.size()) {
+        const QRect head = playheadRect(m_shown.seq_stage);
+        if (area.intersects(head))
+            painter->fillRect(head & area, QColor(220, 80, 40));
+    }
+}
+
+// The trajectories over the visible time span, reduced to the range each
+// joint covers within every pixel column. The work is proportional to the
+// waypoints in view plus the width of the plot, however long the sequence.
+void TimelineWindow::updatePlotCache()
+{
+    const qreal dpr = devicePixelRatio();
+    m_plotCache = QImage(m_plot.size() * dpr, QImage::Format_ARGB32_Premultiplied);
+    m_plotCache.setDevicePixelRatio(dpr);
+    m_plotCache.fill(Qt::transparent);
+    m_plotValid = true;
+
+    QPainter painter(&m_plotCache);
+    const QRect area = plotArea(m_plot).translated(-m_plot.topLeft());
+    const int columns = area.width();
+    const qint64 viewEnd = m_viewStart + m_viewSpan;
+
+    painter.setPen(QColor(40, 40, 60));
+    painter.drawText(QRect(area.left() + margin, area.bottom() + 1, area.width() - 2 * margin, m_plot.height() - area.height()),
+                     Qt::AlignLeft | Qt::AlignVCenter, QStringLiteral("%1 s").arg(m_viewStart / 1000.0, 0, 'f', 1));
+    painter.drawText(QRect(area.left() + margin, area.bottom() + 1, area.width() - 2 * margin, m_plot.height() - area.height()),
+                     Qt::AlignRight | Qt::AlignVCenter, QStringLiteral("%1 s").arg(viewEnd / 1000.0, 0, 'f', 1));
+
+    if (m_waypoints.isEmpty() || columns <= 0)
+        return;
+
+    int dutyMin = 200;
+    int dutyMax = 900;
+    if (m_shown.duty_max[0] > m_shown.duty_min[0]) {
+        dutyMin = qMin(qMin(m_shown.duty_min[0], m_shown.duty_min[1]), m_shown.duty_min[2]);
+        dutyMax = qMax(qMax(m_shown.duty_max[0], m_shown.duty_max[1]), m_shown.duty_max[2]);
+    }
+
+    struct Column {
+        int lo;
+        int hi;
+    };
+    QVector<Column> spans(columns);
+
+    auto column = [&](qint64 ms) {
+        return int(qBound<qint64>(0, (ms - m_viewStart) * columns / m_viewSpan, columns - 1));
+    };
+
+    // Linear from (ta, va) to (tb, vb), clipped to the view
+    auto addSegment = [&](qint64 ta, int va, qint64 tb, int vb) {
+        if (tb < m_viewStart || ta > viewEnd)
+            return;
+        const int c0 = column(qMax(ta, m_viewStart));
+        const int c1 = column(qMin(tb, viewEnd));
+        for (int c = c0; c <= c1; ++c) {
+            const qint64 from = qMax(ta, m_viewStart + c * m_viewSpan / columns);
+            const qint64 to = qMin(tb, m_viewStart + (c + 1) * m_viewSpan / columns);
+            int v0 = va, v1 = vb;
+            if (tb > ta) {
+                v0 = va + int((vb - va) * (from - ta) / (tb - ta));
+                v1 = va + int((vb - va) * (qMax(from, to) - ta) / (tb - ta));
+            }
+            spans[c].lo = qMin(spans[c].lo, qMin(v0, v1));
+            spans[c].hi = qMax(spans[c].hi, qMax(v0, v1));
+        }
+    };
+
+    const int n = m_waypoints.size();
+    const int first = qMax(waypointAt(m_viewStart) - 1, 0);
+
+    for (int motor = 0; motor < ARM_TOT_MOTOR; ++motor) {
+        for (Column &span : spans) {
+            span.lo = INT_MAX;
+            span.hi = INT_MIN;
+        }
+
+        // Each waypoint: hold for the dwell, step to the next one, wait for the other joints
+        for (int i = first; i < n && m_arrive.at(i) <= viewEnd; ++i) {
+            const arm_waypoint &from = m_waypoints.at(i);
+            const arm_waypoint &to = m_waypoints.at((i + 1) % n);
+            const qint64 leave = m_arrive.at(i) + from.dwell_ms;
+            const qint64 next = i + 1 < n ? m_arrive.at(i + 1) : m_cycleMs;
+            const int steps = (qAbs(to.duty[motor] - from.duty[motor]) + ARM_SEQ_STEP_US - 1) / ARM_SEQ_STEP_US;
+            const qint64 reached = leave + qint64(steps) * ARM_SEQ_TICK_MS;
+
+            addSegment(m_arrive.at(i), from.duty[motor], leave, from.duty[motor]);
+            addSegment(leave, from.duty[motor], reached, to.duty[motor]);
+            addSegment(reached, to.duty[motor], next, to.duty[motor]);
+        }
+
+        painter.setPen(motorColors[motor]);
+        for (int c = 0; c < columns; ++c) {
+            if (spans.at(c).lo > spans.at(c).hi)
+                continue;
+            const int y0 = area.bottom() - (spans.at(c).lo - dutyMin) * area.height() / (dutyMax - dutyMin);
+            const int y1 = area.bottom() - (spans.at(c).hi - dutyMin) * area.height() / (dutyMax - dutyMin);
+            painter.drawLine(area.left() + c, y0, area.left() + c, y1);
+        }
+    }
+}
+
+// Mirrors the sequence timer of arm.ko: every joint steps ARM_SEQ_STEP_US
+// each ARM_SEQ_TICK_MS, the next waypoint counts as reached when the
+// slowest joint gets there, then the dwell starts.
+void TimelineWindow::updateTimes(int first)
+{
+    const int n = m_waypoints.size();
+    m_arrive.resize(n);
+    first = qBound(0, first, n);
+
+    auto travel = [](const arm_waypoint &from, const arm_waypoint &to) {
+        int steps = 0;
+        for (int motor = 0; motor < ARM_TOT_MOTOR; ++motor)
+            steps = qMax(steps, (qAbs(to.duty[motor] - from.duty[motor]) + ARM_SEQ_STEP_US - 1) / ARM_SEQ_STEP_US);
+        return qint64(steps) * ARM_SEQ_TICK_MS;
+    };
+
+    if (first == 0 && n > 0)
+        m_arrive[0] = 0;
+    for (int i = qMax(first, 1); i < n; ++i)
+        m_arrive[i] = m_arrive.at(i - 1) + m_waypoints.at(i - 1).dwell_ms + travel(m_waypoints.at(i - 1), m_waypoints.at(i));
+
+    m_cycleMs = n > 0 ? m_arrive.at(n - 1) + m_waypoints.at(n - 1).dwell_ms + travel(m_waypoints.at(n - 1), m_waypoints.at(0)) : 0;
+
+    // Zoomed all the way out the view follows the length of the cycle
+    if (m_viewAll)
+        m_viewSpan = qMax(m_cycleMs, minViewSpan);
+    m_viewSpan = qBound<qint64>(minViewSpan, m_viewSpan, qMax(m_cycleMs, minViewSpan));
+    m_viewStart = qBound<qint64>(0, m_viewStart, qMax<qint64>(m_cycleMs - m_viewSpan, 0));
+
+    setStaticText(m_headerText, QStringLiteral("%1 waypoints, %2 s cycle%3")
+                      .arg(n).arg(m_cycleMs / 1000.0, 0, 'f', 1)
+                      .arg(m_modified ? QStringLiteral(" (modified)") : QString()));
+    renderLater(m_header);
+}
+
+int TimelineWindow::waypointAt(qint64 ms) const
+{
+    const auto it = std::upper_bound(m_arrive.constBegin(), m_arrive.constEnd(), ms);
+    return qMax(int(it - m_arrive.constBegin()) - 1, 0);
+}
+
+int TimelineWindow::timeToX(qint64 ms) const
+{
+    const QRect area = plotArea(m_plot);
+    return area.left() + int((ms - m_viewStart) * area.width() / m_viewSpan);
+}
+
+qint64 TimelineWindow::xToTime(int x) const
+{
+    const QRect area = plotArea(m_plot);
+    return m_viewStart + qint64(x - area.left()) * m_viewSpan / qMax(area.width(), 1);
+}
+
+QRect TimelineWindow::playheadRect(int stage) const
+{
+    if (stage < 0 || stage >= m_arrive.size())
+        return QRect();
+    return QRect(timeToX(m_arrive.at(stage)) - 1, m_plot.top(), 3, m_plot.height());
+}
+
+void TimelineWindow::updateRowText(int row)
+{
+    const int index = m_firstRow + row;
+    if (index >= m_waypoints.size()) {
+        setStaticText(m_rowText[row], QString());
+        return;
+    }
+
+    const arm_waypoint &w = m_waypoints.at(index);
+    setStaticText(m_rowText[row], QStringLiteral("%1  %2  %3  %4  %5 s")
+                      .arg(index + 1, -5)
+                      .arg(w.duty[0], 4).arg(w.duty[1], 4).arg(w.duty[2], 4)
+                      .arg(w.dwell_ms / 1000.0, 4, 'f', 1));
+}
+
+void TimelineWindow::setStatus(const QString &status)
+{
+    setStaticText(m_statusText, status);
+    renderLater(m_header);
+}
+
+bool TimelineWindow::download()
+{
+    QVector<arm_waypoint> waypoints;
+    if (!m_device->downloadSequence(&waypoints)) {
+        setStatus(m_device->errorString());
+        return false;
+    }
+
+    m_waypoints = waypoints;
+    m_modified = false;
+    m_kernelGeneration = m_shown.seq_generation;
+    updateTimes(0);
+
+    for (int row = 0; row < m_rows; ++row)
+        updateRowText(row);
+    select(qMin(m_selected, m_waypoints.size() - 1));
+    m_plotValid = false;
+    renderLater(m_list);
+    renderLater(m_plot);
+    return true;
+}
+
+void TimelineWindow::upload(bool start)
+{
+    if (!m_device->uploadSequence(m_waypoints, start)) {
+        setStatus(m_device->errorString());
+        return;
+    }
+
+    m_modified = false;
+    updateTimes(m_waypoints.size());
+    setStatus(start ? QStringLiteral("Uploaded, running") : QStringLiteral("Uploaded"));
+}
+
+// Everything from waypoint 'first' on may have moved in time
+void TimelineWindow::sequenceEdited(int first)
+{
+    m_modified = true;
+    updateTimes(first);
+
+    for (int row = 0; row < m_rows; ++row)
+        updateRowText(row);
+    m_plotValid = false;
+    renderLater(m_list);
+    renderLater(m_plot);
+}
+
+void TimelineWindow::renderRowLater(int index)
+{
+    const int row = index - m_firstRow;
+    if (row >= 0 && row < m_rows)
+        renderLater(listRow(m_list, row));
+}
+
+void TimelineWindow::select(int index)
+{
+    index = qBound(0, index, qMax(m_waypoints.size() - 1, 0));
+
+    const int old = m_selected;
+    const int oldFirst = m_firstRow;
+    m_selected = index;
+
+    // Keep the selection in the list, once it is laid out
+    if (m_selected < m_firstRow)
+        m_firstRow = m_selected;
+    else if (m_rows > 0 && m_selected >= m_firstRow + m_rows)
+        m_firstRow = m_selected - m_rows + 1;
+
+    if (m_firstRow != oldFirst) {
+        for (int row = 0; row < m_rows; ++row)
+            updateRowText(row);
+        renderLater(m_list);
+    } else {
+        renderRowLater(old);
+        renderRowLater(m_selected);
+    }
+
+    // And on the timeline
+    if (!m_arrive.isEmpty() && m_selected < m_arrive.size()) {
+        const qint64 t = m_arrive.at(m_selected);
+        if (t < m_viewStart || t >= m_viewStart + m_viewSpan) {
+            m_viewStart = qBound<qint64>(0, t - m_viewSpan / 4, qMax<qint64>(m_cycleMs - m_viewSpan, 0));
+            m_plotValid = false;
+        }
+    }
+    renderLater(m_plot);
+}
+
+void TimelineWindow::moveSelected(int delta)
+{
+    const int to = m_selected + delta;
+    if (to < 0 || to >= m_waypoints.size())
+        return;
+
+    std::swap(m_waypoints[m_selected], m_waypoints[to]);
+    sequenceEdited(qMin(m_selected, to));
+    select(to);
+}
+
+void TimelineWindow::retimeSelected(int deltaMs)
+{
+    if (m_waypoints.isEmpty())
+        return;
+
+    arm_waypoint &w = m_waypoints[m_selected];
+    w.dwell_ms = quint32(qBound(0, int(w.dwell_ms) + deltaMs, ARM_SEQ_MAX_DWELL_MS));
+    sequenceEdited(m_selected + 1);
+}
+
+void TimelineWindow::insertPose()
+{
+    arm_waypoint w;
+    for (int motor = 0; motor < ARM_TOT_MOTOR; ++motor)
+        w.duty[motor] = m_shown.joints.duty[motor];
+    w.dwell_ms = defaultDwellMs;
+
+    const int at = m_waypoints.isEmpty() ? 0 : m_selected + 1;
+    m_waypoints.insert(at, w);
+    sequenceEdited(at);
+    select(at);
+}
+
+void TimelineWindow::removeSelected()
+{
+    if (m_waypoints.isEmpty())
+        return;
+
+    m_waypoints.remove(m_selected);
+    sequenceEdited(m_selected);
+    select(m_selected);
+}
+
+void TimelineWindow::zoom(qreal factor)
+{
+    const qint64 span = qBound<qint64>(minViewSpan, qint64(m_viewSpan * factor), qMax(m_cycleMs, minViewSpan));
+    if (span == m_viewSpan)
+        return;
+
+    const qint64 centre = m_arrive.isEmpty() ? 0 : m_arrive.at(m_selected);
+    m_viewSpan = span;
+    m_viewAll = span >= m_cycleMs;
+    m_viewStart = qBound<qint64>(0, centre - span / 2, qMax<qint64>(m_cycleMs - span, 0));
+    m_plotValid = false;
+    renderLater(m_plot);
+}
+
+// The keyboard notifier of arm.ko already takes the arrows, 1-4, G/H, Enter
+// and ESC, so the editor uses other keys
+void TimelineWindow::keyPressEvent(QKeyEvent *event)
+{
+    const bool shift = event->modifiers() & Qt::ShiftModifier;
+
+    switch (event->key()) {
+    case Qt::Key_J:
+        if (shift)
+            moveSelected(1);
+        else
+            select(m_selected + 1);
+        break;
+    case Qt::Key_K:
+        if (shift)
+            moveSelected(-1);
+        else
+            select(m_selected - 1);
+        break;
+    case Qt::Key_PageDown:
+        select(m_selected + m_rows);
+        break;
+    case Qt::Key_PageUp:
+        select(m_selected - m_rows);
+        break;
+    case Qt::Key_BracketLeft:
+        retimeSelected(-ARM_SEQ_TICK_MS);
+        break;
+    case Qt::Key_BracketRight:
+        retimeSelected(ARM_SEQ_TICK_MS);
+        break;
+    case Qt::Key_BraceLeft:
+        retimeSelected(-1000);
+        break;
+    case Qt::Key_BraceRight:
+        retimeSelected(1000);
+        break;
+    case Qt::Key_C:
+        insertPose();
+        break;
+    case Qt::Key_X:
+    case Qt::Key_Delete:
+        removeSelected();
+        break;
+    case Qt::Key_Z:
+        zoom(shift ? 2.0 : 0.5);
+        break;
+    case Qt::Key_U:
+        upload(false);
+        break;
+    case Qt::Key_P:
+        upload(true);
+        break;
+    case Qt::Key_S:
+        if (!m_device->runSequence(false))
+            setStatus(m_device->errorString());
+        break;
+    case Qt::Key_R:
+        if (download())
+            setStatus(QStringLiteral("Reloaded"));
+        break;
+    default:
+        RasterWindow::keyPressEvent(event);
+        break;
+    }
+}
+
+void TimelineWindow::mousePressEvent(QMouseEvent *event)
+{
+    const QPoint pos = event->pos();
+    const int lineHeight = QFontMetrics(QGuiApplication::font()).height();
+
+    if (m_list.contains(pos)) {
+        const int row = (pos.y() - m_list.top()) / lineHeight - 1;
+        if (row >= 0 && m_firstRow + row < m_waypoints.size())
+            select(m_firstRow + row);
+    } else if (plotArea(m_plot).contains(pos) && !m_waypoints.isEmpty()) {
+        select(waypointAt(xToTime(pos.x())));
+    }
+}
+
+void TimelineWindow::wheelEvent(QWheelEvent *event)
+{
+    const int steps = event->angleDelta().y() / 120;
+    if (steps == 0)
+        return;
+
+    // Scrolls the list without moving the selection
+    const int first = qBound(0, m_firstRow - 3 * steps, qMax(m_waypoints.size() - m_rows, 0));
+    if (first == m_firstRow)
+        return;
+
+    m_firstRow = first;
+    for (int row = 0; row < m_rows; ++row)
+        updateRowText(row);
+    renderLater(m_list);
+}
+
+void TimelineWindow::telemetryChanged()
+{
+    const arm_telemetry &t = m_device->telemetry();
+    const bool running = t.seq_active != m_shown.seq_active || t.seq_stage != m_shown.seq_stage;
+    const bool limits = memcmp(t.duty_min, m_shown.duty_min, sizeof(t.duty_min)) != 0
+            || memcmp(t.duty_max, m_shown.duty_max, sizeof(t.duty_max)) != 0;
+
+    // Old and new position of the playhead and the running row
+    if (running) {
+        if (m_shown.seq_active) {
+            renderLater(playheadRect(m_shown.seq_stage));
+            renderRowLater(m_shown.seq_stage);
+        }
+        if (t.seq_active) {
+            renderLater(playheadRect(t.seq_stage));
+            renderRowLater(t.seq_stage);
+        }
+    }
+
+    m_shown = t;
+
+    if (limits) {
+        m_plotValid = false;
+        renderLater(m_plot);
+    }
+
+    // The sequence in the module changed, from the keys or another program
+    if (t.seq_generation != m_kernelGeneration) {
+        if (m_modified) {
+            setStatus(QStringLiteral("Changed in arm.ko, r reloads"));
+        } else {
+            download();
+        }
+        m_kernelGeneration = t.seq_generation;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef TIMELINEWINDOW_H
+#define TIMELINEWINDOW_H
+
+#include "rasterwindow.h"
+#include "armdevice.h"
+
+// Sequence editor: the waypoints as a list and the joint trajectories on a
+// timeline. Edits stay local until they are uploaded in one batch.
+//
+// The trajectories are drawn once into a cached image, decimated to one
+// min/max span per pixel column, so long sequences cost the same to draw as
+// short ones. Selection, scrolling and the playhead only repaint their rows
+// and columns.
+class TimelineWindow : public RasterWindow
+{
+    Q_OBJECT
+public:
+    explicit TimelineWindow(const QString &device = QStringLiteral("/dev/arm"), QWindow *parent = 0);
+
+    void render(QPainter *painter) override;
+
+protected:
+    void renderBackground(QPainter *painter) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+
+private slots:
+    void telemetryChanged();
+
+private:
+    void layoutPanels();
+    void renderHeader(QPainter *painter);
+    void renderList(QPainter *painter);
+    void renderPlot(QPainter *painter);
+    void updatePlotCache();
+
+    // Editing
+    bool download();
+    void upload(bool start);
+    void sequenceEdited(int first);
+    void select(int index);
+    void moveSelected(int delta);
+    void retimeSelected(int deltaMs);
+    void insertPose();
+    void removeSelected();
+    void zoom(qreal factor);
+    void setStatus(const QString &status);
+
+    // Timeline
+    void updateTimes(int first);
+    int waypointAt(qint64 ms) const;
+    int timeToX(qint64 ms) const;
+    qint64 xToTime(int x) const;
+    QRect playheadRect(int stage) const;
+    void updateRowText(int row);
+    void renderRowLater(int index);
+
+    ArmDevice *m_device;
+    arm_telemetry m_shown;
+
+    QVector<arm_waypoint> m_waypoints;
+    QVector<qint64> m_arrive;       // ms from the start of the cycle to reaching each waypoint
+    qint64 m_cycleMs;
+    bool m_modified;
+    quint32 m_kernelGeneration;     // of the sequence last downloaded
+
+    int m_selected;
+    int m_firstRow;
+    int m_rows;
+    qint64 m_viewStart;
+    qint64 m_viewSpan;
+    bool m_viewAll;                 // zoomed out to the whole cycle
+
+    QImage m_plotCache;
+    bool m_plotValid;
+
+    QStaticText m_headerText;
+    QStaticText m_statusText;
+    QVector<QStaticText> m_rowText;
+
+    QRect m_header;
+    QRect m_list;
+    QRect m_plot;
+    QRect m_help;
+};
+
+#endif // TIMELINEWINDOW_H